@@ -0,0 +1,423 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+  This is a reference remote bitbang server for the OpenOCD remote_bitbang
+  interface driver. It simulates a single JTAG TAP with a 4 bit instruction
+  register, an IDCODE register (instruction 0x1, selected on reset) and a
+  BYPASS register (every other instruction), so the driver and its block
+  mode extension can be tested without any hardware.
+
+  To compile run:
+  gcc -Wall -std=c99 -D_DEFAULT_SOURCE -o remote_bitbang_tap_sim remote_bitbang_tap_sim.c
+
+  Usage example:
+
+  ./remote_bitbang_tap_sim [-p port] [-i idcode] [-n] &
+  openocd -c "adapter driver remote_bitbang; remote_bitbang port 3335" \
+	  -c "remote_bitbang block_mode enable" \
+	  -c "transport select jtag; jtag newtap sim tap -irlen 4 -expected-id 0x1deadbef" \
+	  -c "init; shutdown"
+
+  -n disables the block mode extension, so the server behaves like the
+  plain ASCII protocol servers.
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define DEFAULT_PORT		3335
+#define DEFAULT_IDCODE		0x1deadbef
+#define BLOCK_VERSION		1
+#define BLOCK_MAX_BITS		(64 * 1024)
+
+#define SHIFT_TDI		0x01
+#define SHIFT_TDO		0x02
+#define SHIFT_TMS_LAST		0x04
+
+#define IR_LEN			4
+#define IR_IDCODE		0x1
+
+enum tap_state {
+	TEST_LOGIC_RESET, RUN_TEST_IDLE,
+	SELECT_DR_SCAN, CAPTURE_DR, SHIFT_DR, EXIT1_DR, PAUSE_DR, EXIT2_DR, UPDATE_DR,
+	SELECT_IR_SCAN, CAPTURE_IR, SHIFT_IR, EXIT1_IR, PAUSE_IR, EXIT2_IR, UPDATE_IR,
+};
+
+/* next state for TMS = 0 and TMS = 1 */
+static const enum tap_state tap_next[16][2] = {
+	[TEST_LOGIC_RESET] = { RUN_TEST_IDLE, TEST_LOGIC_RESET },
+	[RUN_TEST_IDLE] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+	[SELECT_DR_SCAN] = { CAPTURE_DR, SELECT_IR_SCAN },
+	[CAPTURE_DR] = { SHIFT_DR, EXIT1_DR },
+	[SHIFT_DR] = { SHIFT_DR, EXIT1_DR },
+	[EXIT1_DR] = { PAUSE_DR, UPDATE_DR },
+	[PAUSE_DR] = { PAUSE_DR, EXIT2_DR },
+	[EXIT2_DR] = { SHIFT_DR, UPDATE_DR },
+	[UPDATE_DR] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+	[SELECT_IR_SCAN] = { CAPTURE_IR, TEST_LOGIC_RESET },
+	[CAPTURE_IR] = { SHIFT_IR, EXIT1_IR },
+	[SHIFT_IR] = { SHIFT_IR, EXIT1_IR },
+	[EXIT1_IR] = { PAUSE_IR, UPDATE_IR },
+	[PAUSE_IR] = { PAUSE_IR, EXIT2_IR },
+	[EXIT2_IR] = { SHIFT_IR, UPDATE_IR },
+	[UPDATE_IR] = { RUN_TEST_IDLE, SELECT_DR_SCAN },
+};
+
+static struct {
+	enum tap_state state;
+	uint32_t idcode;
+	uint32_t ir;
+	uint32_t ir_shift;
+	uint32_t dr_shift;
+	unsigned int dr_len;
+	int tck;
+} tap;
+
+static int client_fd = -1;
+static uint8_t in_buf[4096];
+static size_t in_start, in_end;
+static uint8_t out_buf[4096];
+static size_t out_used;
+
+static void tap_reset(void)
+{
+	tap.state = TEST_LOGIC_RESET;
+	tap.ir = IR_IDCODE;
+	tap.tck = 0;
+}
+
+static int tap_tdo(void)
+{
+	if (tap.state == SHIFT_IR)
+		return tap.ir_shift & 1;
+	if (tap.state == SHIFT_DR)
+		return tap.dr_shift & 1;
+	return 0;
+}
+
+/* everything happens on the rising edge of TCK in this model */
+static void tap_clock(int tms, int tdi)
+{
+	switch (tap.state) {
+	case CAPTURE_IR:
+		/* the two LSBs of the captured IR must be 01 */
+		tap.ir_shift = 0x1;
+		break;
+	case SHIFT_IR:
+		tap.ir_shift = (tap.ir_shift >> 1) | ((uint32_t)tdi << (IR_LEN - 1));
+		break;
+	case CAPTURE_DR:
+		if (tap.ir == IR_IDCODE) {
+			tap.dr_shift = tap.idcode;
+			tap.dr_len = 32;
+		} else {
+			tap.dr_shift = 0;
+			tap.dr_len = 1;
+		}
+		break;
+	case SHIFT_DR:
+		tap.dr_shift = (tap.dr_shift >> 1) | ((uint32_t)tdi << (tap.dr_len - 1));
+		break;
+	default:
+		break;
+	}
+
+	tap.state = tap_next[tap.state][tms ? 1 : 0];
+
+	if (tap.state == UPDATE_IR)
+		tap.ir = tap.ir_shift & ((1 << IR_LEN) - 1);
+	else if (tap.state == TEST_LOGIC_RESET)
+		tap.ir = IR_IDCODE;
+}
+
+static void pins_write(int tck, int tms, int tdi)
+{
+	if (tck && !tap.tck)
+		tap_clock(tms, tdi);
+	tap.tck = tck;
+}
+
+static int flush_out(void)
+{
+	size_t offset = 0;
+
+	while (offset < out_used) {
+		ssize_t n = write(client_fd, out_buf + offset, out_used - offset);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("write");
+			return -1;
+		}
+		offset += n;
+	}
+	out_used = 0;
+	return 0;
+}
+
+static int put_bytes(const uint8_t *data, size_t len)
+{
+	while (len > 0) {
+		size_t chunk = sizeof(out_buf) - out_used;
+		if (chunk > len)
+			chunk = len;
+		memcpy(out_buf + out_used, data, chunk);
+		out_used += chunk;
+		data += chunk;
+		len -= chunk;
+		if (out_used == sizeof(out_buf) && flush_out() < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/* returns the next byte, or -1 on EOF/error; replies are flushed before blocking */
+static int get_byte(void)
+{
+	if (in_start == in_end) {
+		if (flush_out() < 0)
+			return -1;
+		ssize_t n;
+		do {
+			n = read(client_fd, in_buf, sizeof(in_buf));
+		} while (n < 0 && errno == EINTR);
+		if (n <= 0)
+			return -1;
+		in_start = 0;
+		in_end = n;
+	}
+	return in_buf[in_start++];
+}
+
+static int get_bytes(uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		int c = get_byte();
+		if (c < 0)
+			return -1;
+		data[i] = c;
+	}
+	return 0;
+}
+
+static int get_u32(uint32_t *value)
+{
+	uint8_t b[4];
+
+	if (get_bytes(b, sizeof(b)) < 0)
+		return -1;
+	*value = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+	return 0;
+}
+
+static int block_shift(void)
+{
+	static uint8_t tdi[BLOCK_MAX_BITS / 8];
+	static uint8_t tdo[BLOCK_MAX_BITS / 8];
+	int flags = get_byte();
+	uint32_t num_bits;
+
+	if (flags < 0 || get_u32(&num_bits) < 0)
+		return -1;
+	if (num_bits > BLOCK_MAX_BITS) {
+		fprintf(stderr, "shift of %u bits exceeds the announced limit\n", num_bits);
+		return -1;
+	}
+
+	size_t num_bytes = (num_bits + 7) / 8;
+	if (flags & SHIFT_TDI) {
+		if (get_bytes(tdi, num_bytes) < 0)
+			return -1;
+	} else {
+		memset(tdi, 0, num_bytes);
+	}
+	memset(tdo, 0, num_bytes);
+
+	for (uint32_t i = 0; i < num_bits; i++) {
+		int bit = (tdi[i / 8] >> (i % 8)) & 1;
+		int tms = (flags & SHIFT_TMS_LAST) && i == num_bits - 1;
+
+		pins_write(0, tms, bit);
+		if (tap_tdo())
+			tdo[i / 8] |= 1 << (i % 8);
+		pins_write(1, tms, bit);
+	}
+
+	if (flags & SHIFT_TDO)
+		return put_bytes(tdo, num_bytes);
+	return 0;
+}
+
+static int block_tms_seq(void)
+{
+	uint32_t num_bits;
+	int tms = 0;
+
+	if (get_u32(&num_bits) < 0)
+		return -1;
+
+	for (uint32_t i = 0; i < num_bits; i++) {
+		if (i % 8 == 0) {
+			int c = get_byte();
+			if (c < 0)
+				return -1;
+			for (int j = 0; j < 8 && i + j < num_bits; j++) {
+				tms = (c >> j) & 1;
+				pins_write(0, tms, 0);
+				pins_write(1, tms, 0);
+			}
+		}
+	}
+	pins_write(0, tms, 0);
+	return 0;
+}
+
+static int block_clocks(void)
+{
+	int tms = get_byte();
+	uint32_t num_cycles;
+
+	if (tms < 0 || get_u32(&num_cycles) < 0)
+		return -1;
+
+	for (uint32_t i = 0; i < num_cycles; i++) {
+		pins_write(0, tms & 1, 0);
+		pins_write(1, tms & 1, 0);
+	}
+	pins_write(0, tms & 1, 0);
+	return 0;
+}
+
+static int block_packet(void)
+{
+	switch (get_byte()) {
+	case 'S':
+		return block_shift();
+	case 'T':
+		return block_tms_seq();
+	case 'C':
+		return block_clocks();
+	default:
+		fprintf(stderr, "unknown block packet\n");
+		return -1;
+	}
+}
+
+static void process_remote_protocol(bool block_mode)
+{
+	for (;;) {
+		int c = get_byte();
+		int ret = 0;
+
+		if (c < 0 || c == 'Q')
+			break;
+		if (c == 'b' || c == 'B') {
+			continue;
+		} else if (c >= 'r' && c <= 'r' + 3) {
+			/* TRST resets the TAP, SRST is not modelled */
+			if ((c - 'r') & 2)
+				tap_reset();
+		} else if (c >= '0' && c <= '7') {
+			int d = c - '0';
+			pins_write(!!(d & 4), !!(d & 2), d & 1);
+		} else if (c == 'R') {
+			uint8_t r = '0' + tap_tdo();
+			ret = put_bytes(&r, 1);
+		} else if (c == 'X' && block_mode) {
+			uint8_t reply[6] = { 'X', BLOCK_VERSION,
+				BLOCK_MAX_BITS & 0xff, (BLOCK_MAX_BITS >> 8) & 0xff,
+				(BLOCK_MAX_BITS >> 16) & 0xff, (BLOCK_MAX_BITS >> 24) & 0xff };
+			ret = put_bytes(reply, sizeof(reply));
+		} else if (c == 'P' && block_mode) {
+			ret = block_packet();
+		} else {
+			fprintf(stderr, "Unknown command '%c' received\n", c);
+		}
+
+		if (ret < 0)
+			break;
+	}
+	flush_out();
+}
+
+int main(int argc, char *argv[])
+{
+	int port = DEFAULT_PORT;
+	bool block_mode = true;
+	int opt;
+
+	tap.idcode = DEFAULT_IDCODE;
+
+	while ((opt = getopt(argc, argv, "p:i:n")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'i':
+			tap.idcode = strtoul(optarg, NULL, 0) | 1;
+			break;
+		case 'n':
+			block_mode = false;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-p port] [-i idcode] [-n]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	int one = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			listen(listen_fd, 1) < 0) {
+		perror("bind/listen");
+		return 1;
+	}
+
+	fprintf(stderr, "remote_bitbang TAP simulator listening on port %d, "
+		"IDCODE 0x%08x, block mode %s\n", port, tap.idcode,
+		block_mode ? "enabled" : "disabled");
+
+	for (;;) {
+		client_fd = accept(listen_fd, NULL, NULL);
+		if (client_fd < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			return 1;
+		}
+		setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		tap_reset();
+		in_start = 0;
+		in_end = 0;
+		out_used = 0;
+		process_remote_protocol(block_mode);
+
+		close(client_fd);
+		client_fd = -1;
+	}
+
+	return 0;
+}
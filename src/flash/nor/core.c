@@ -16,6 +16,8 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <helper/crc32.h>
+#include <helper/time_support.h>
 
 /**
  * @file
@@ -31,6 +33,7 @@ int flash_driver_erase(struct flash_bank *bank, unsigned int first,
 {
 	int retval;
 
+	bank->erase_state_valid = false;
 	retval = bank->driver->erase(bank, first, last);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %u to %u", first, last);
@@ -87,6 +90,7 @@ int flash_driver_write(struct flash_bank *bank,
 {
 	int retval;
 
+	bank->erase_state_valid = false;
 	retval = bank->driver->write(bank, buffer, offset, count);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
@@ -161,8 +165,43 @@ int default_flash_verify(struct flash_bank *bank,
 		return ERROR_FAIL;
 }
 
+/* Code running on the target may change the flash behind our back */
+static void flash_erase_state_invalidate(struct target *target)
+{
+	for (struct flash_bank *bank = flash_banks; bank; bank = bank->next) {
+		if (bank->target == target)
+			bank->erase_state_valid = false;
+	}
+}
+
+static int flash_target_event_callback(struct target *target,
+		enum target_event event, void *priv)
+{
+	switch (event) {
+	case TARGET_EVENT_RESUMED:
+	case TARGET_EVENT_HALTED:
+		flash_erase_state_invalidate(target);
+		break;
+	default:
+		break;
+	}
+	return ERROR_OK;
+}
+
+static int flash_target_reset_callback(struct target *target,
+		enum target_reset_mode reset_mode, void *priv)
+{
+	flash_erase_state_invalidate(target);
+	return ERROR_OK;
+}
+
 void flash_bank_add(struct flash_bank *bank)
 {
+	if (!flash_banks) {
+		target_register_event_callback(flash_target_event_callback, NULL);
+		target_register_reset_callback(flash_target_reset_callback, NULL);
+	}
+
 	/* put flash bank in linked list */
 	unsigned bank_num = 0;
 	if (flash_banks) {
@@ -237,6 +276,11 @@ void flash_free_all_banks(void)
 		free(bank);
 		bank = next;
 	}
+
+	if (flash_banks) {
+		target_unregister_event_callback(flash_target_event_callback, NULL);
+		target_unregister_reset_callback(flash_target_reset_callback, NULL);
+	}
 	flash_banks = NULL;
 }
 
@@ -330,11 +374,33 @@ int get_flash_bank_by_addr(struct target *target,
 	return ERROR_OK;
 }
 
-static int default_flash_mem_blank_check(struct flash_bank *bank)
+/* Size of the reads of the host side erase check */
+#define FLASH_BLANK_CHECK_CHUNK		(64 * 1024)
+
+/* @returns true if all @a len bytes at @a buffer are @a value */
+static bool flash_buffer_is_filled(const uint8_t *buffer, size_t len, uint8_t value)
+{
+	uint64_t pattern;
+	memset(&pattern, value, sizeof(pattern));
+
+	size_t i = 0;
+	for (; i + sizeof(pattern) <= len; i += sizeof(pattern)) {
+		uint64_t word;
+		memcpy(&word, buffer + i, sizeof(word));
+		if (word != pattern)
+			return false;
+	}
+	for (; i < len; i++) {
+		if (buffer[i] != value)
+			return false;
+	}
+	return true;
+}
+
+/* Check the erase state of sectors from @a first on by reading them back */
+static int default_flash_mem_blank_check(struct flash_bank *bank, unsigned int first)
 {
 	struct target *target = bank->target;
-	const int buffer_size = 1024;
-	uint32_t n_bytes;
 	int retval = ERROR_OK;
 
 	if (bank->target->state != TARGET_HALTED) {
@@ -342,32 +408,44 @@ static int default_flash_mem_blank_check(struct flash_bank *bank)
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
+	uint32_t buffer_size = 0;
+	for (unsigned int i = first; i < bank->num_sectors; i++)
+		buffer_size = MAX(buffer_size, bank->sectors[i].size);
+	buffer_size = MIN(buffer_size, FLASH_BLANK_CHECK_CHUNK);
+
 	uint8_t *buffer = malloc(buffer_size);
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	for (unsigned int i = first; i < bank->num_sectors; i++) {
+		target_addr_t address = bank->base + bank->sectors[i].offset;
+		uint32_t left = bank->sectors[i].size;
 
-	for (unsigned int i = 0; i < bank->num_sectors; i++) {
-		uint32_t j;
 		bank->sectors[i].is_erased = 1;
 
-		for (j = 0; j < bank->sectors[i].size; j += buffer_size) {
-			uint32_t chunk;
-			chunk = buffer_size;
-			if (chunk > (bank->sectors[i].size - j))
-				chunk = (bank->sectors[i].size - j);
-
-			retval = target_read_memory(target,
-					bank->base + bank->sectors[i].offset + j,
-					4,
-					chunk/4,
-					buffer);
-			if (retval != ERROR_OK)
+		/* stop at the first byte which is not erased */
+		while (left > 0) {
+			uint32_t chunk = MIN(left, buffer_size);
+
+			if (address % 4 == 0 && chunk % 4 == 0)
+				retval = target_read_memory(target, address, 4, chunk / 4, buffer);
+			else
+				retval = target_read_memory(target, address, 1, chunk, buffer);
+			if (retval != ERROR_OK) {
+				bank->sectors[i].is_erased = -1;
 				goto done;
+			}
 
-			for (n_bytes = 0; n_bytes < chunk; n_bytes++) {
-				if (buffer[n_bytes] != bank->erased_value) {
-					bank->sectors[i].is_erased = 0;
-					break;
-				}
+			if (!flash_buffer_is_filled(buffer, chunk, bank->erased_value)) {
+				bank->sectors[i].is_erased = 0;
+				break;
 			}
+
+			address += chunk;
+			left -= chunk;
+			keep_alive();
 		}
 	}
 
@@ -387,10 +465,25 @@ int default_flash_blank_check(struct flash_bank *bank)
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
+	/* nothing written since the last check */
+	if (bank->erase_state_valid) {
+		bool known = true;
+		for (unsigned int i = 0; i < bank->num_sectors; i++) {
+			if (bank->sectors[i].is_erased != 0 && bank->sectors[i].is_erased != 1) {
+				known = false;
+				break;
+			}
+		}
+		if (known) {
+			LOG_DEBUG("erase state of %s still valid", bank->name);
+			return ERROR_OK;
+		}
+	}
+
 	struct target_memory_check_block *block_array;
 	block_array = malloc(bank->num_sectors * sizeof(struct target_memory_check_block));
 	if (!block_array)
-		return default_flash_mem_blank_check(bank);
+		return default_flash_mem_blank_check(bank, 0);
 
 	for (unsigned int i = 0; i < bank->num_sectors; i++) {
 		block_array[i].address = bank->base + bank->sectors[i].offset;
@@ -398,34 +491,36 @@ int default_flash_blank_check(struct flash_bank *bank)
 		block_array[i].result = UINT32_MAX; /* erase state unknown */
 	}
 
-	bool fast_check = true;
-	for (unsigned int i = 0; i < bank->num_sectors; ) {
+	/* Submit all sectors at once, the algorithm does as many as it can
+	 * per run. Sectors it doesn't get to are checked by the host. */
+	unsigned int checked = 0;
+	retval = ERROR_OK;
+	while (checked < bank->num_sectors) {
 		retval = target_blank_check_memory(target,
-				block_array + i, bank->num_sectors - i,
+				block_array + checked, bank->num_sectors - checked,
 				bank->erased_value);
-		if (retval < 1) {
-			/* Run slow fallback if the first run gives no result
-			 * otherwise use possibly incomplete results */
-			if (i == 0)
-				fast_check = false;
+		if (retval < 1)
 			break;
-		}
-		i += retval; /* add number of blocks done this round */
+		checked += retval; /* add number of blocks done this round */
+		retval = ERROR_OK;
 	}
 
-	if (fast_check) {
-		for (unsigned int i = 0; i < bank->num_sectors; i++)
-			bank->sectors[i].is_erased = block_array[i].result;
-		retval = ERROR_OK;
-	} else {
-		if (retval == ERROR_NOT_IMPLEMENTED)
+	for (unsigned int i = 0; i < checked; i++)
+		bank->sectors[i].is_erased = block_array[i].result;
+	free(block_array);
+
+	if (checked < bank->num_sectors) {
+		if (checked > 0)
+			LOG_USER("Running slow fallback erase check from sector %u", checked);
+		else if (retval == ERROR_NOT_IMPLEMENTED)
 			LOG_USER("Running slow fallback erase check");
 		else
 			LOG_USER("Running slow fallback erase check - add working memory");
 
-		retval = default_flash_mem_blank_check(bank);
+		retval = default_flash_mem_blank_check(bank, checked);
 	}
-	free(block_array);
+
+	bank->erase_state_valid = (retval == ERROR_OK);
 
 	return retval;
 }
@@ -727,8 +822,128 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
+/* Compare flash contents with a buffer, without logging mismatches */
+static int flash_range_matches(struct flash_bank *bank, const uint8_t *buffer,
+	uint32_t offset, uint32_t count, bool *matches)
+{
+	int retval;
+
+	/* Banks using the default verify are memory mapped, so let the
+	 * target checksum them and only transfer the result */
+	if (!bank->driver->verify) {
+		uint32_t target_crc;
+		retval = target_checksum_memory(bank->target, bank->base + offset, count, &target_crc);
+		if (retval == ERROR_OK) {
+			*matches = target_crc == crc32_gdb(0xffffffff, buffer, count);
+			return ERROR_OK;
+		}
+	}
+
+	uint8_t *data = malloc(count);
+	if (!data) {
+		LOG_ERROR("Out of memory for flash compare buffer");
+		return ERROR_FAIL;
+	}
+
+	retval = flash_driver_read(bank, data, offset, count);
+	if (retval == ERROR_OK)
+		*matches = !memcmp(data, buffer, count);
+
+	free(data);
+	return retval;
+}
+
+/* Erase and write a range already padded as flash_driver_write() needs it */
+static int flash_program_range(struct target *target, struct flash_bank *bank,
+	const uint8_t *buffer, uint32_t offset, uint32_t count, bool erase)
+{
+	int retval = ERROR_OK;
+
+	if (erase)
+		retval = flash_erase_address_range(target, true, bank->base + offset, count);
+	if (retval == ERROR_OK)
+		retval = flash_driver_write(bank, buffer, offset, count);
+
+	return retval;
+}
+
+/**
+ * Write a run of data, but only to sectors whose contents differ from it.
+ * Consecutive changed sectors are erased and written together.
+ */
+static int flash_write_changed_sectors(struct target *target, struct flash_bank *bank,
+	const uint8_t *buffer, uint32_t offset, uint32_t count, bool erase,
+	uint32_t *written)
+{
+	const uint32_t start = offset, end = offset + count;
+	uint32_t changed_start = 0, changed_size = 0;
+	unsigned int sector = 0;
+	int retval = ERROR_OK;
+
+	*written = 0;
+
+	while (offset < end) {
+		/* Part of the run within the current sector. Banks without
+		 * sector list are handled in one go. */
+		uint32_t piece_end = end;
+		for (; sector < bank->num_sectors; sector++) {
+			uint32_t sector_end = bank->sectors[sector].offset + bank->sectors[sector].size;
+			if (offset < sector_end) {
+				piece_end = MIN(end, sector_end);
+				break;
+			}
+		}
+		uint32_t piece_size = piece_end - offset;
+
+		bool unchanged;
+		retval = flash_range_matches(bank, buffer + (offset - start), offset,
+			piece_size, &unchanged);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (!unchanged) {
+			if (!changed_size)
+				changed_start = offset;
+			changed_size += piece_size;
+		} else {
+			LOG_DEBUG("flash at " TARGET_ADDR_FMT ", 0x%" PRIx32 " bytes unchanged",
+				bank->base + offset, piece_size);
+		}
+
+		offset = piece_end;
+
+		if (changed_size && (unchanged || offset == end)) {
+			retval = flash_program_range(target, bank, buffer + (changed_start - start),
+				changed_start, changed_size, erase);
+			if (retval != ERROR_OK)
+				return retval;
+			*written += changed_size;
+			changed_size = 0;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* writes of flash_write_parallel() in progress */
+static struct {
+	struct flash_parallel_write *writes;
+	unsigned int count;
+	unsigned int next;
+} flash_parallel;
+
+static struct flash_parallel_write *flash_parallel_write_for(struct target *target)
+{
+	for (unsigned int i = 0; i < flash_parallel.next; i++) {
+		if (flash_parallel.writes[i].target == target)
+			return &flash_parallel.writes[i];
+	}
+	return NULL;
+}
+
 int flash_write_unlock_verify(struct target *target, struct image *image,
-	uint32_t *written, bool erase, bool unlock, bool write, bool verify)
+	uint32_t *written, uint32_t *skipped, bool erase, bool unlock, bool write,
+	bool verify, bool incremental)
 {
 	int retval = ERROR_OK;
 
@@ -742,6 +957,8 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 
 	if (written)
 		*written = 0;
+	if (skipped)
+		*skipped = 0;
 
 	if (erase) {
 		/* assume all sectors need erasing - stops any problems
@@ -950,21 +1167,29 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 		}
 
 		retval = ERROR_OK;
+		uint32_t run_written = run_size;
 
 		if (unlock)
 			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
+
+		if (retval == ERROR_OK && write && incremental) {
+			/* only erase and write the sectors that differ */
+			retval = flash_write_changed_sectors(target, c, buffer,
+					run_address - c->base, run_size, erase, &run_written);
+		} else {
+			if (retval == ERROR_OK) {
+				if (erase) {
+					/* calculate and erase sectors */
+					retval = flash_erase_address_range(target,
+							true, run_address, run_size);
+				}
 			}
-		}
 
-		if (retval == ERROR_OK) {
-			if (write) {
-				/* write flash sectors */
-				retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+			if (retval == ERROR_OK) {
+				if (write) {
+					/* write flash sectors */
+					retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+				}
 			}
 		}
 
@@ -982,8 +1207,14 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			goto done;
 		}
 
+		if (write && flash_parallel_write_for(target))
+			LOG_INFO("%s: wrote %" PRIu32 " bytes to %s at " TARGET_ADDR_FMT,
+				target_name(target), run_written, c->name, run_address);
+
 		if (written)
-			*written += run_size;	/* add run size to total written counter */
+			*written += run_written;	/* add run size to total written counter */
+		if (skipped)
+			*skipped += run_size - run_written;
 	}
 
 done:
@@ -996,7 +1227,82 @@ done:
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, bool erase)
 {
-	return flash_write_unlock_verify(target, image, written, erase, false, true, false);
+	return flash_write_unlock_verify(target, image, written, NULL, erase, false, true,
+		false, false);
+}
+
+/*
+ * Start the next write. This is called from within the flash write algorithm
+ * of another target as soon as it is busy programming, so the write started
+ * here runs alongside it.
+ */
+static void flash_parallel_start_next(void *priv)
+{
+	struct flash_parallel_write *w = &flash_parallel.writes[flash_parallel.next++];
+
+	if (flash_parallel.next == flash_parallel.count)
+		target_async_algorithm_set_starter(NULL, NULL);
+
+	LOG_INFO("%s: starting flash write", target_name(w->target));
+
+	struct duration bench;
+	duration_start(&bench);
+
+	w->retval = flash_write_unlock_verify(w->target, w->image, &w->written, NULL,
+		w->erase, w->unlock, true, false, false);
+
+	if (duration_measure(&bench) == ERROR_OK)
+		w->elapsed = duration_elapsed(&bench);
+
+	if (w->retval == ERROR_OK)
+		LOG_INFO("%s: wrote %" PRIu32 " bytes in %fs", target_name(w->target),
+			w->written, w->elapsed);
+	else
+		LOG_ERROR("%s: flash write failed", target_name(w->target));
+}
+
+int flash_write_parallel(struct flash_parallel_write *writes, unsigned int count)
+{
+	/* a target runs one flash write algorithm at a time */
+	for (unsigned int i = 0; i < count; i++) {
+		for (unsigned int j = 0; j < i; j++) {
+			if (writes[i].target == writes[j].target) {
+				LOG_ERROR("%s is listed more than once", target_name(writes[i].target));
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+		writes[i].retval = ERROR_OK;
+		writes[i].written = 0;
+		writes[i].elapsed = 0;
+	}
+
+	if (flash_parallel.writes) {
+		LOG_ERROR("parallel flash write already in progress");
+		return ERROR_FAIL;
+	}
+
+	flash_parallel.writes = writes;
+	flash_parallel.count = count;
+	flash_parallel.next = 0;
+
+	if (count > 1)
+		target_async_algorithm_set_starter(flash_parallel_start_next, NULL);
+
+	/* Writes that don't go through an async flash algorithm, or that end
+	 * before the next one got started, leave the next one to this loop. */
+	while (flash_parallel.next < count)
+		flash_parallel_start_next(NULL);
+
+	flash_parallel.writes = NULL;
+
+	int retval = ERROR_OK;
+	for (unsigned int i = 0; i < count; i++) {
+		if (writes[i].retval != ERROR_OK) {
+			retval = writes[i].retval;
+			break;
+		}
+	}
+	return retval;
 }
 
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size,
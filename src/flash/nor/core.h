@@ -125,6 +125,13 @@ struct flash_bank {
 	/** Array of protection blocks, allocated and initialized by the flash driver */
 	struct flash_sector *prot_blocks;
 
+	/**
+	 * The is_erased fields of the sectors were set by
+	 * default_flash_blank_check() and nothing changed the flash since.
+	 * Cleared when the bank is written or erased and when the target runs.
+	 */
+	bool erase_state_valid;
+
 	struct flash_bank *next; /**< The next flash bank on this chip */
 };
 
@@ -211,9 +218,10 @@ int default_flash_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
 /**
- * Provides default erased-bank check handling. Checks to see if
- * the flash driver knows they are erased; if things look uncertain,
- * this routine will call default_flash_mem_blank_check() to confirm.
+ * Provides default erased-bank check handling. Checks all sectors with
+ * target_blank_check_memory(); sectors it can't check are read back by
+ * default_flash_mem_blank_check(). The result is reused until the bank
+ * is written or erased, or the target runs.
  * @returns ERROR_OK if successful; otherwise, an error code.
  */
 int default_flash_blank_check(struct flash_bank *bank);
@@ -37,8 +37,28 @@ int flash_driver_read(struct flash_bank *bank,
 int flash_driver_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
-/* write (optional verify) an image to flash memory of the given target */
+/* write (optional verify) an image to flash memory of the given target,
+ * incrementally skips the sectors that already hold the image data */
 int flash_write_unlock_verify(struct target *target, struct image *image,
-		uint32_t *written, bool erase, bool unlock, bool write, bool verify);
+		uint32_t *written, uint32_t *skipped, bool erase, bool unlock, bool write,
+		bool verify, bool incremental);
+
+/* one target's part of flash_write_parallel() */
+struct flash_parallel_write {
+	struct target *target;
+	struct image *image;
+	bool erase;
+	bool unlock;
+
+	/* filled in by flash_write_parallel() */
+	int retval;
+	uint32_t written;
+	float elapsed;
+};
+
+/* write images to the flash of several targets, running the flash write
+ * algorithms of the targets at the same time where the drivers use
+ * target_run_flash_async_algorithm() */
+int flash_write_parallel(struct flash_parallel_write *writes, unsigned int count);
 
 #endif /* OPENOCD_FLASH_NOR_IMP_H */
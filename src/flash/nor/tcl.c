@@ -401,6 +401,8 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool incremental = false;
+	uint32_t skipped;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -413,6 +415,11 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "incremental") == 0) {
+			incremental = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "incremental write enabled");
 		} else
 			break;
 	}
@@ -442,8 +449,8 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock_verify(target, &image, &written, auto_erase,
-		auto_unlock, true, false);
+	retval = flash_write_unlock_verify(target, &image, &written, &skipped, auto_erase,
+		auto_unlock, true, false, incremental);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -453,6 +460,8 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		command_print(CMD, "wrote %" PRIu32 " bytes from file %s "
 			"in %fs (%0.3f KiB/s)", written, CMD_ARGV[0],
 			duration_elapsed(&bench), duration_kbps(&bench, written));
+		if (incremental)
+			command_print(CMD, "skipped %" PRIu32 " unchanged bytes", skipped);
 	}
 
 	image_close(&image);
@@ -460,6 +469,100 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_flash_write_parallel_command)
+{
+	bool auto_erase = false;
+	bool auto_unlock = false;
+
+	while (CMD_ARGC) {
+		if (strcmp(CMD_ARGV[0], "erase") == 0) {
+			auto_erase = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+		} else if (strcmp(CMD_ARGV[0], "unlock") == 0) {
+			auto_unlock = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+		} else
+			break;
+	}
+
+	if (CMD_ARGC == 0 || CMD_ARGC % 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	unsigned int count = CMD_ARGC / 3;
+	struct flash_parallel_write *writes = calloc(count, sizeof(*writes));
+	struct image *images = calloc(count, sizeof(*images));
+	unsigned int opened = 0;
+	int retval = ERROR_OK;
+
+	if (!writes || !images) {
+		LOG_ERROR("Out of memory");
+		retval = ERROR_FAIL;
+		goto out;
+	}
+
+	for (; opened < count; opened++) {
+		const char **args = CMD_ARGV + 3 * opened;
+		struct image *image = &images[opened];
+
+		struct target *target = get_target(args[0]);
+		if (!target) {
+			command_print(CMD, "Target %s does not exist", args[0]);
+			retval = ERROR_COMMAND_ARGUMENT_INVALID;
+			goto out;
+		}
+
+		image->base_address_set = true;
+		retval = parse_llong(args[2], &image->base_address);
+		if (retval != ERROR_OK) {
+			command_print(CMD, "Invalid offset: %s", args[2]);
+			goto out;
+		}
+		image->start_address_set = false;
+
+		retval = image_open(image, args[1], NULL);
+		if (retval != ERROR_OK)
+			goto out;
+
+		writes[opened].target = target;
+		writes[opened].image = image;
+		writes[opened].erase = auto_erase;
+		writes[opened].unlock = auto_unlock;
+	}
+
+	struct duration bench;
+	duration_start(&bench);
+
+	retval = flash_write_parallel(writes, count);
+
+	uint32_t total = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		if (writes[i].retval != ERROR_OK) {
+			command_print(CMD, "%s: failed", target_name(writes[i].target));
+			continue;
+		}
+		command_print(CMD, "%s: wrote %" PRIu32 " bytes from file %s in %fs",
+			target_name(writes[i].target), writes[i].written,
+			CMD_ARGV[3 * i + 1], writes[i].elapsed);
+		total += writes[i].written;
+	}
+
+	if (retval == ERROR_OK && duration_measure(&bench) == ERROR_OK) {
+		command_print(CMD, "wrote %" PRIu32 " bytes to %u targets "
+			"in %fs (%0.3f KiB/s)", total, count,
+			duration_elapsed(&bench), duration_kbps(&bench, total));
+	}
+
+out:
+	for (unsigned int i = 0; i < opened; i++)
+		image_close(&images[i]);
+	free(images);
+	free(writes);
+
+	return retval;
+}
+
 COMMAND_HANDLER(handle_flash_verify_image_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -494,8 +597,8 @@ COMMAND_HANDLER(handle_flash_verify_image_command)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = flash_write_unlock_verify(target, &image, &verified, false,
-		false, false, true);
+	retval = flash_write_unlock_verify(target, &image, &verified, NULL, false,
+		false, false, true, false);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -1052,6 +1155,7 @@ void flash_set_dirty(void)
 	for (c = flash_bank_list(); c; c = c->next) {
 		for (unsigned int i = 0; i < c->num_sectors; i++)
 			c->sectors[i].is_erased = 0;
+		c->erase_state_valid = false;
 	}
 }
 
@@ -1182,11 +1286,19 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [incremental] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
 			"and/or erase the region to be used. Allow optional "
 			"offset from beginning of bank (defaults to zero)",
 	},
+	{
+		.name = "write_parallel",
+		.handler = handle_flash_write_parallel_command,
+		.mode = COMMAND_EXEC,
+		.usage = "[erase] [unlock] (target_name filename offset)...",
+		.help = "Write images to the flash of several targets, "
+			"programming the targets at the same time.",
+	},
 	{
 		.name = "verify_image",
 		.handler = handle_flash_verify_image_command,
@@ -13,9 +13,84 @@
 #endif
 
 #include "crc32.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+/*
+ * Table driven CRCs process 8 bytes per step ("slice-by-8"). Table 0 is the
+ * classic byte-at-a-time table, table k gives the contribution of a byte
+ * followed by k zero bytes. The tables are built on first use.
+ */
+#define CRC32_SLICES	8
+
+static uint32_t crc32_le_table[CRC32_SLICES][256];
+static bool crc32_le_table_valid;
+
+static uint32_t crc32_gdb_table[CRC32_SLICES][256];
+static bool crc32_gdb_table_valid;
+
+static void crc32_le_init_table(void)
+{
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY_LE : c >> 1;
+		crc32_le_table[0][i] = c;
+	}
+
+	for (unsigned int k = 1; k < CRC32_SLICES; k++)
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = crc32_le_table[k - 1][i];
+			crc32_le_table[k][i] = (c >> 8) ^ crc32_le_table[0][c & 0xff];
+		}
+
+	crc32_le_table_valid = true;
+}
+
+static void crc32_gdb_init_table(void)
+{
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i << 24;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 0x80000000) ? (c << 1) ^ CRC32_POLY_GDB : c << 1;
+		crc32_gdb_table[0][i] = c;
+	}
+
+	for (unsigned int k = 1; k < CRC32_SLICES; k++)
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = crc32_gdb_table[k - 1][i];
+			crc32_gdb_table[k][i] = (c << 8) ^ crc32_gdb_table[0][c >> 24];
+		}
+
+	crc32_gdb_table_valid = true;
+}
+
+static uint32_t crc32_le_table_driven(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	const uint32_t (*t)[256] = crc32_le_table;
+
+	if (!crc32_le_table_valid)
+		crc32_le_init_table();
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		uint32_t lo = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 |
+				(uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+		uint32_t hi = (uint32_t)data[4] | (uint32_t)data[5] << 8 |
+				(uint32_t)data[6] << 16 | (uint32_t)data[7] << 24;
+
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+			t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+			t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+			t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+	}
+
+	while (data_len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+
+	return crc;
+}
+
 static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 		unsigned int data_bits)
 {
@@ -33,6 +108,9 @@ static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 		size_t data_len)
 {
+	if (poly == CRC32_POLY_LE)
+		return crc32_le_table_driven(seed, _data, data_len);
+
 	if (((uintptr_t)_data & 0x3) || (data_len & 0x3)) {
 		/* data is unaligned, processing data one byte at a time */
 		const uint8_t *data = _data;
@@ -48,3 +126,29 @@ uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 
 	return seed;
 }
+
+uint32_t crc32_gdb(uint32_t crc, const void *_data, size_t data_len)
+{
+	const uint32_t (*t)[256] = crc32_gdb_table;
+	const uint8_t *data = _data;
+
+	if (!crc32_gdb_table_valid)
+		crc32_gdb_init_table();
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		uint32_t hi = crc ^ ((uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+				(uint32_t)data[2] << 8 | (uint32_t)data[3]);
+		uint32_t lo = (uint32_t)data[4] << 24 | (uint32_t)data[5] << 16 |
+				(uint32_t)data[6] << 8 | (uint32_t)data[7];
+
+		crc = t[7][hi >> 24] ^ t[6][(hi >> 16) & 0xff] ^
+			t[5][(hi >> 8) & 0xff] ^ t[4][hi & 0xff] ^
+			t[3][lo >> 24] ^ t[2][(lo >> 16) & 0xff] ^
+			t[1][(lo >> 8) & 0xff] ^ t[0][lo & 0xff];
+	}
+
+	while (data_len--)
+		crc = (crc << 8) ^ t[0][((crc >> 24) ^ *data++) & 0xff];
+
+	return crc;
+}
@@ -34,4 +34,20 @@
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *data,
 		size_t data_len);
 
+/**
+ * CRC32 polynomial used by GDB, most significant bit first
+ */
+#define CRC32_POLY_GDB	0x04c11db7
+
+/**
+ * Calculate the CRC32 used by GDB's qCRC packet and by verify_image
+ * @param	crc			The CRC of the data before, `0xffffffff` to start
+ * @param	data		The data to calculate the CRC32 of
+ * @param	data_len	The length of the data in @p data in bytes
+ * @return	The CRC value of the first @p data_len bytes at @p data
+ * @note	Like crc32_le(), this function can be called once per chunk of
+ *			a larger block of data.
+ */
+uint32_t crc32_gdb(uint32_t crc, const void *data, size_t data_len);
+
 #endif /* OPENOCD_HELPER_CRC32_H */
@@ -20,16 +20,31 @@
 #include "fileio.h"
 #include "replacements.h"
 
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 struct fileio {
 	char *url;
 	size_t size;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	/* contents mapped by fileio_map(), if any */
+	void *map;
 };
 
 static inline int fileio_close_local(struct fileio *fileio)
 {
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->map)
+		munmap(fileio->map, fileio->size);
+#endif
+	fileio->map = NULL;
+
 	int retval = fclose(fileio->file);
 	if (retval != 0) {
 		if (retval == EBADF)
@@ -117,6 +132,7 @@ int fileio_open(struct fileio **fileio, const char *url,
 	tmp->type = type;
 	tmp->access = access_type;
 	tmp->url = strdup(url);
+	tmp->map = NULL;
 
 	retval = fileio_open_local(tmp);
 
@@ -262,3 +278,48 @@ int fileio_size(struct fileio *fileio, size_t *size)
 
 	return ERROR_OK;
 }
+
+/**
+ * Map the contents of a file opened for reading into memory.
+ *
+ * The mapping stays valid until the file is closed. Where mapping is not
+ * available, callers are expected to fall back to fileio_read().
+ */
+int fileio_map(struct fileio *fileio, const uint8_t **data)
+{
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->access != FILEIO_READ || fileio->size == 0)
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+
+	if (!fileio->map) {
+		void *map = mmap(NULL, fileio->size, PROT_READ, MAP_PRIVATE,
+			fileno(fileio->file), 0);
+		if (map == MAP_FAILED) {
+			LOG_DEBUG("couldn't map %s: %s", fileio->url, strerror(errno));
+			return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+		}
+		fileio->map = map;
+	}
+
+	*data = fileio->map;
+	return ERROR_OK;
+#else
+	return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+#endif
+}
+
+/** Get the time of the last modification of the file. */
+int fileio_mtime(struct fileio *fileio, time_t *mtime)
+{
+#ifdef HAVE_SYS_STAT_H
+	struct stat st;
+
+	if (fstat(fileno(fileio->file), &st) != 0)
+		return ERROR_FILEIO_OPERATION_FAILED;
+
+	*mtime = st.st_mtime;
+	return ERROR_OK;
+#else
+	return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+#endif
+}
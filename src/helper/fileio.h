@@ -16,6 +16,8 @@
 
 #include "types.h"
 
+#include <time.h>
+
 #define FILEIO_MAX_ERROR_STRING		(128)
 
 enum fileio_type {
@@ -50,6 +52,8 @@ int fileio_write(struct fileio *fileio,
 int fileio_read_u32(struct fileio *fileio, uint32_t *data);
 int fileio_write_u32(struct fileio *fileio, uint32_t data);
 int fileio_size(struct fileio *fileio, size_t *size);
+int fileio_map(struct fileio *fileio, const uint8_t **data);
+int fileio_mtime(struct fileio *fileio, time_t *mtime);
 
 #define ERROR_FILEIO_LOCATION_UNKNOWN			(-1200)
 #define ERROR_FILEIO_NOT_FOUND					(-1201)
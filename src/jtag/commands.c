@@ -19,20 +19,43 @@
 #include "config.h"
 #endif
 
+#include <limits.h>
+
 #include <jtag/jtag.h>
 #include <transport/transport.h>
 #include "commands.h"
+#include "interface.h"
 
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
 	size_t used;
+	size_t size;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
 static struct cmd_queue_page *cmd_queue_pages;
 static struct cmd_queue_page *cmd_queue_pages_tail;
 
+/*
+ * Pages of a flushed queue are not returned to the heap but kept on
+ * this list and handed out again by cmd_queue_alloc(). Only pages of
+ * the standard size are retained; oversized pages are freed on reset.
+ *
+ * Every CMD_QUEUE_TRIM_INTERVAL resets the spare list is trimmed down
+ * to the highest number of pages used by any queue in that interval,
+ * so a single huge queue does not pin its memory forever.
+ */
+#define CMD_QUEUE_TRIM_INTERVAL 64
+static struct cmd_queue_page *cmd_queue_spare_pages;
+static unsigned int cmd_queue_spare_count;
+static unsigned int cmd_queue_page_count;
+static unsigned int cmd_queue_interval_peak;
+static unsigned int cmd_queue_interval_resets;
+static size_t cmd_queue_bytes;
+
+static struct jtag_command_queue_stats cmd_queue_stats;
+
 struct jtag_command *jtag_command_queue;
 static struct jtag_command **next_command_pointer = &jtag_command_queue;
 
@@ -108,40 +131,123 @@ void *cmd_queue_alloc(size_t size)
 	}
 
 	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
+		if (cmd_queue_spare_pages && size <= CMD_QUEUE_PAGE_SIZE) {
+			*p_page = cmd_queue_spare_pages;
+			cmd_queue_spare_pages = (*p_page)->next;
+			cmd_queue_spare_count--;
+			cmd_queue_stats.pages_recycled++;
+		} else {
+			*p_page = malloc(sizeof(struct cmd_queue_page));
+			(*p_page)->size = (size < CMD_QUEUE_PAGE_SIZE) ?
+						CMD_QUEUE_PAGE_SIZE : size;
+			(*p_page)->address = malloc((*p_page)->size);
+			cmd_queue_stats.pages_allocated++;
+		}
 		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
-					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
 		(*p_page)->next = NULL;
 		cmd_queue_pages_tail = *p_page;
+
+		cmd_queue_page_count++;
+		if (cmd_queue_page_count > cmd_queue_stats.peak_pages)
+			cmd_queue_stats.peak_pages = cmd_queue_page_count;
 	}
 
 	offset = (*p_page)->used;
 	(*p_page)->used += size;
+	cmd_queue_bytes += size;
 
 	t = (*p_page)->address;
 	return t + offset;
 }
 
-static void cmd_queue_free(void)
+static void cmd_queue_page_free(struct cmd_queue_page *page)
+{
+	free(page->address);
+	free(page);
+}
+
+/**
+ * Release the pages of the current queue to the spare list, then trim
+ * the spare list if a trim interval has elapsed.
+ */
+static void cmd_queue_recycle(void)
 {
 	struct cmd_queue_page *page = cmd_queue_pages;
 
 	while (page) {
-		struct cmd_queue_page *last = page;
-		free(page->address);
-		page = page->next;
-		free(last);
+		struct cmd_queue_page *next = page->next;
+
+		if (page->size == CMD_QUEUE_PAGE_SIZE) {
+			page->next = cmd_queue_spare_pages;
+			cmd_queue_spare_pages = page;
+			cmd_queue_spare_count++;
+		} else {
+			cmd_queue_page_free(page);
+		}
+		page = next;
 	}
 
 	cmd_queue_pages = NULL;
 	cmd_queue_pages_tail = NULL;
+
+	if (cmd_queue_page_count > cmd_queue_interval_peak)
+		cmd_queue_interval_peak = cmd_queue_page_count;
+	cmd_queue_page_count = 0;
+
+	if (++cmd_queue_interval_resets < CMD_QUEUE_TRIM_INTERVAL)
+		return;
+
+	while (cmd_queue_spare_count > cmd_queue_interval_peak) {
+		page = cmd_queue_spare_pages;
+		cmd_queue_spare_pages = page->next;
+		cmd_queue_spare_count--;
+		cmd_queue_page_free(page);
+		cmd_queue_stats.pages_trimmed++;
+	}
+
+	cmd_queue_interval_peak = 0;
+	cmd_queue_interval_resets = 0;
+}
+
+/**
+ * Check whether @a ptr points into memory handed out by cmd_queue_alloc()
+ * for the current queue. Such memory stays valid until the queue is
+ * reset, so it can be referenced by queued commands without a copy.
+ */
+bool cmd_queue_owns(const void *ptr)
+{
+	const uint8_t *p = ptr;
+
+	for (struct cmd_queue_page *page = cmd_queue_pages; page; page = page->next) {
+		const uint8_t *start = page->address;
+		if (p >= start && p < start + page->used)
+			return true;
+	}
+
+	return false;
+}
+
+void jtag_command_queue_get_stats(struct jtag_command_queue_stats *stats)
+{
+	*stats = cmd_queue_stats;
+	stats->retained_pages = cmd_queue_spare_count + cmd_queue_page_count;
+}
+
+void jtag_command_queue_reset_stats(void)
+{
+	memset(&cmd_queue_stats, 0, sizeof(cmd_queue_stats));
+	cmd_queue_stats.peak_pages = cmd_queue_page_count;
 }
 
 void jtag_command_queue_reset(void)
 {
-	cmd_queue_free();
+	if (jtag_command_queue) {
+		cmd_queue_stats.flushes++;
+		cmd_queue_stats.bytes_queued += cmd_queue_bytes;
+	}
+	cmd_queue_bytes = 0;
+
+	cmd_queue_recycle();
 
 	jtag_command_queue = NULL;
 	next_command_pointer = &jtag_command_queue;
@@ -150,13 +256,366 @@ void jtag_command_queue_reset(void)
 /**
  * Copy a struct scan_field for insertion into the queue.
  *
- * This allocates a new copy of out_value using cmd_queue_alloc.
+ * This allocates a new copy of out_value using cmd_queue_alloc, unless
+ * out_value already lives in the command queue and thus is guaranteed
+ * to outlive the queued scan.
  */
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src)
 {
 	dst->num_bits	= src->num_bits;
-	dst->out_value	= buf_cpy(src->out_value, cmd_queue_alloc(DIV_ROUND_UP(src->num_bits, 8)), src->num_bits);
 	dst->in_value	= src->in_value;
+
+	if (!src->out_value) {
+		dst->out_value = NULL;
+	} else if (cmd_queue_owns(src->out_value)) {
+		dst->out_value = src->out_value;
+		cmd_queue_stats.clones_avoided++;
+	} else {
+		dst->out_value = buf_cpy(src->out_value, cmd_queue_alloc(DIV_ROUND_UP(src->num_bits, 8)), src->num_bits);
+	}
+}
+
+/*
+ * Queue optimization.
+ *
+ * jtag_command_queue_optimize() rewrites the queue in place right before
+ * it is handed to the adapter driver. All rewrites preserve what the
+ * TAPs observe on the wire:
+ *  - an IR scan that loads the same value as the previous IR scan of the
+ *    queue is dropped, when it captures nothing, nothing in between
+ *    could have disturbed the IR and the TAP is already in its end state;
+ *  - back-to-back RUNTEST (the first one ending in Run-Test/Idle),
+ *    STABLECLOCKS, PATHMOVE and TMS commands are merged into one;
+ *  - for drivers advertising DEBUG_CAP_FLAT_STREAM, runs of state moves
+ *    and idle clocks between scans are replaced by a single TMS command.
+ */
+
+/* Longest TMS sequence built when flattening, in bits. */
+#define JTAG_FLAT_MAX_BITS 4096
+
+static void cmd_queue_unlink_next(struct jtag_command *cmd)
+{
+	struct jtag_command *victim = cmd->next;
+
+	cmd->next = victim->next;
+	if (next_command_pointer == &victim->next)
+		next_command_pointer = &cmd->next;
+	cmd_queue_stats.commands_removed++;
+}
+
+static bool jtag_scan_fields_equal(const struct scan_command *a, const struct scan_command *b)
+{
+	if (a->num_fields != b->num_fields)
+		return false;
+
+	for (int i = 0; i < a->num_fields; i++) {
+		const struct scan_field *fa = a->fields + i;
+		const struct scan_field *fb = b->fields + i;
+
+		if (fa->num_bits != fb->num_bits)
+			return false;
+		if (!fa->out_value || !fb->out_value)
+			return false;
+		if (buf_cmp(fa->out_value, fb->out_value, fa->num_bits))
+			return false;
+	}
+
+	return true;
+}
+
+static bool jtag_scan_captures(const struct scan_command *scan)
+{
+	for (int i = 0; i < scan->num_fields; i++)
+		if (scan->fields[i].in_value)
+			return true;
+	return false;
+}
+
+/**
+ * @returns the TAP state after @a cmd executed from @a state, or
+ * TAP_INVALID when it cannot be told.
+ */
+static tap_state_t jtag_command_end_state(const struct jtag_command *cmd, tap_state_t state)
+{
+	switch (cmd->type) {
+	case JTAG_SCAN:
+		return cmd->cmd.scan->end_state;
+	case JTAG_TLR_RESET:
+		return TAP_RESET;
+	case JTAG_RUNTEST:
+		return cmd->cmd.runtest->end_state;
+	case JTAG_PATHMOVE:
+		return cmd->cmd.pathmove->path[cmd->cmd.pathmove->num_states - 1];
+	case JTAG_STABLECLOCKS:
+	case JTAG_SLEEP:
+		return state;
+	case JTAG_TMS:
+		if (state == TAP_INVALID)
+			return TAP_INVALID;
+		for (unsigned int i = 0; i < cmd->cmd.tms->num_bits; i++)
+			state = tap_state_transition(state, buf_get_u32(cmd->cmd.tms->bits, i, 1));
+		return state;
+	case JTAG_RESET:
+		return cmd->cmd.reset->trst == 1 ? TAP_RESET : TAP_INVALID;
+	default:
+		return TAP_INVALID;
+	}
+}
+
+/** Approximate count of TCK cycles spent by an IR scan starting in @a state. */
+static unsigned int jtag_ir_scan_cycles(const struct scan_command *scan, tap_state_t state)
+{
+	unsigned int cycles = jtag_scan_size(scan);
+
+	if (tap_is_state_stable(state))
+		cycles += tap_get_tms_path_len(state, TAP_IRSHIFT);
+	if (tap_is_state_stable(scan->end_state))
+		cycles += 1 + tap_get_tms_path_len(TAP_IRPAUSE, scan->end_state);
+
+	return cycles;
+}
+
+static bool jtag_try_merge(struct jtag_command *cmd)
+{
+	struct jtag_command *next = cmd->next;
+
+	if (!next || next->type != cmd->type)
+		return false;
+
+	switch (cmd->type) {
+	case JTAG_RUNTEST:
+		if (cmd->cmd.runtest->end_state != TAP_IDLE)
+			return false;
+		if (next->cmd.runtest->num_cycles > INT_MAX - cmd->cmd.runtest->num_cycles)
+			return false;
+		cmd->cmd.runtest->num_cycles += next->cmd.runtest->num_cycles;
+		cmd->cmd.runtest->end_state = next->cmd.runtest->end_state;
+		break;
+	case JTAG_STABLECLOCKS:
+		if (next->cmd.stableclocks->num_cycles > INT_MAX - cmd->cmd.stableclocks->num_cycles)
+			return false;
+		cmd->cmd.stableclocks->num_cycles += next->cmd.stableclocks->num_cycles;
+		break;
+	case JTAG_PATHMOVE: {
+		struct pathmove_command *a = cmd->cmd.pathmove;
+		struct pathmove_command *b = next->cmd.pathmove;
+		tap_state_t *path = cmd_queue_alloc((a->num_states + b->num_states) * sizeof(*path));
+
+		memcpy(path, a->path, a->num_states * sizeof(*path));
+		memcpy(path + a->num_states, b->path, b->num_states * sizeof(*path));
+		a->path = path;
+		a->num_states += b->num_states;
+		break;
+	}
+	case JTAG_TMS: {
+		struct tms_command *a = cmd->cmd.tms;
+		struct tms_command *b = next->cmd.tms;
+		uint8_t *bits = cmd_queue_alloc(DIV_ROUND_UP(a->num_bits + b->num_bits, 8));
+
+		buf_set_buf(a->bits, 0, bits, 0, a->num_bits);
+		buf_set_buf(b->bits, 0, bits, a->num_bits, b->num_bits);
+		a->bits = bits;
+		a->num_bits += b->num_bits;
+		break;
+	}
+	default:
+		return false;
+	}
+
+	cmd_queue_unlink_next(cmd);
+	cmd_queue_stats.commands_merged++;
+	return true;
+}
+
+struct jtag_flat_tms {
+	uint8_t bits[JTAG_FLAT_MAX_BITS / 8];
+	unsigned int num_bits;
+	tap_state_t state;
+};
+
+static bool jtag_flat_push(struct jtag_flat_tms *flat, bool tms)
+{
+	if (flat->num_bits >= JTAG_FLAT_MAX_BITS)
+		return false;
+	buf_set_u32(flat->bits, flat->num_bits++, 1, tms);
+	flat->state = tap_state_transition(flat->state, tms);
+	return true;
+}
+
+static bool jtag_flat_move(struct jtag_flat_tms *flat, tap_state_t goal)
+{
+	if (!tap_is_state_stable(flat->state) || !tap_is_state_stable(goal))
+		return false;
+
+	int tms_bits = tap_get_tms_path(flat->state, goal);
+	int tms_count = tap_get_tms_path_len(flat->state, goal);
+
+	for (int i = 0; i < tms_count; i++)
+		if (!jtag_flat_push(flat, (tms_bits >> i) & 1))
+			return false;
+
+	return flat->state == goal;
+}
+
+/**
+ * Append the TMS bits equivalent to @a cmd to @a flat, the same way the
+ * bit-banging drivers clock it. On failure @a flat is left in an
+ * undefined state.
+ */
+static bool jtag_flat_append(struct jtag_flat_tms *flat, const struct jtag_command *cmd)
+{
+	switch (cmd->type) {
+	case JTAG_TLR_RESET:
+		return jtag_flat_move(flat, TAP_RESET);
+	case JTAG_RUNTEST: {
+		const struct runtest_command *rt = cmd->cmd.runtest;
+
+		if (flat->state != TAP_IDLE && !jtag_flat_move(flat, TAP_IDLE))
+			return false;
+		for (int i = 0; i < rt->num_cycles; i++)
+			if (!jtag_flat_push(flat, false))
+				return false;
+		if (rt->end_state != TAP_IDLE && !jtag_flat_move(flat, rt->end_state))
+			return false;
+		return true;
+	}
+	case JTAG_STABLECLOCKS: {
+		bool tms = flat->state == TAP_RESET;
+
+		for (int i = 0; i < cmd->cmd.stableclocks->num_cycles; i++)
+			if (!jtag_flat_push(flat, tms))
+				return false;
+		return flat->state != TAP_INVALID;
+	}
+	case JTAG_PATHMOVE: {
+		const struct pathmove_command *pm = cmd->cmd.pathmove;
+
+		for (int i = 0; i < pm->num_states; i++) {
+			bool tms;
+
+			if (tap_state_transition(flat->state, false) == pm->path[i])
+				tms = false;
+			else if (tap_state_transition(flat->state, true) == pm->path[i])
+				tms = true;
+			else
+				return false;
+			if (!jtag_flat_push(flat, tms))
+				return false;
+		}
+		return true;
+	}
+	case JTAG_TMS:
+		for (unsigned int i = 0; i < cmd->cmd.tms->num_bits; i++)
+			if (!jtag_flat_push(flat, buf_get_u32(cmd->cmd.tms->bits, i, 1)))
+				return false;
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Replace the run of state moves starting at @a cmd by one TMS command.
+ * @a idle_only is set if the flattened run consists of RUNTEST and
+ * STABLECLOCKS commands only, so it leaves the instruction registers alone.
+ * @returns the last command of the (possibly rewritten) run.
+ */
+static struct jtag_command *jtag_flatten_run(struct jtag_command *cmd,
+		tap_state_t state, bool *idle_only)
+{
+	static struct jtag_flat_tms flat;
+	struct jtag_command *last = cmd;
+	unsigned int count = 0;
+	bool idle = true;
+
+	if (state == TAP_INVALID)
+		return cmd;
+
+	flat.num_bits = 0;
+	flat.state = state;
+
+	for (struct jtag_command *c = cmd; c; c = c->next) {
+		unsigned int num_bits = flat.num_bits;
+		tap_state_t end_state = flat.state;
+
+		if (!jtag_flat_append(&flat, c)) {
+			flat.num_bits = num_bits;
+			flat.state = end_state;
+			break;
+		}
+		if (c->type != JTAG_RUNTEST && c->type != JTAG_STABLECLOCKS)
+			idle = false;
+		last = c;
+		count++;
+	}
+
+	if (count < 2)
+		return cmd;
+
+	struct tms_command *tms = cmd_queue_alloc(sizeof(*tms));
+	uint8_t *bits = cmd_queue_alloc(DIV_ROUND_UP(flat.num_bits, 8));
+
+	memcpy(bits, flat.bits, DIV_ROUND_UP(flat.num_bits, 8));
+	tms->num_bits = flat.num_bits;
+	tms->bits = bits;
+
+	cmd->type = JTAG_TMS;
+	cmd->cmd.tms = tms;
+	while (cmd->next != last->next)
+		cmd_queue_unlink_next(cmd);
+	cmd_queue_stats.commands_flattened += count;
+
+	*idle_only = idle;
+
+	return cmd;
+}
+
+void jtag_command_queue_optimize(bool flatten, tap_state_t state)
+{
+	const struct scan_command *last_ir = NULL;
+
+	if (!flatten)
+		state = TAP_INVALID;
+
+	for (struct jtag_command *cmd = jtag_command_queue; cmd; cmd = cmd->next) {
+		while (jtag_try_merge(cmd))
+			;
+
+		bool idle_only = false;
+		if (flatten && cmd->type != JTAG_SCAN)
+			cmd = jtag_flatten_run(cmd, state, &idle_only);
+
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			if (cmd->cmd.scan->ir_scan)
+				last_ir = cmd->cmd.scan;
+			break;
+		case JTAG_RUNTEST:
+		case JTAG_STABLECLOCKS:
+		case JTAG_SLEEP:
+			break;
+		default:
+			/* may pass Update-IR or reset the TAPs */
+			if (!idle_only)
+				last_ir = NULL;
+			break;
+		}
+
+		state = jtag_command_end_state(cmd, state);
+
+		/* drop IR scans following this command that would not change anything */
+		while (cmd->next && cmd->next->type == JTAG_SCAN && last_ir) {
+			const struct scan_command *scan = cmd->next->cmd.scan;
+
+			if (!scan->ir_scan || scan->end_state != state ||
+					jtag_scan_captures(scan) || !jtag_scan_fields_equal(scan, last_ir))
+				break;
+
+			cmd_queue_stats.ir_scans_dropped++;
+			cmd_queue_stats.bits_saved += jtag_ir_scan_cycles(scan, state);
+			cmd_queue_unlink_next(cmd);
+		}
+	}
 }
 
 enum scan_type jtag_scan_type(const struct scan_command *cmd)
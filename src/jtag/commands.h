@@ -153,10 +153,45 @@ struct jtag_command {
 extern struct jtag_command *jtag_command_queue;
 
 void *cmd_queue_alloc(size_t size);
+bool cmd_queue_owns(const void *ptr);
 
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
 
+/** Usage counters of the command queue allocator. */
+struct jtag_command_queue_stats {
+	/** Number of non-empty queues that have been reset. */
+	uint64_t flushes;
+	/** Total bytes handed out by cmd_queue_alloc() for those queues. */
+	uint64_t bytes_queued;
+	/** Highest number of pages used by a single queue. */
+	unsigned int peak_pages;
+	/** Pages currently held, in use or kept for reuse. */
+	unsigned int retained_pages;
+	uint64_t pages_allocated;
+	uint64_t pages_recycled;
+	uint64_t pages_trimmed;
+	/** Scan fields queued without copying out_value. */
+	uint64_t clones_avoided;
+
+	/* Counters of jtag_command_queue_optimize() */
+	/** Commands removed from the queue before execution. */
+	uint64_t commands_removed;
+	/** Commands folded into their predecessor of the same type. */
+	uint64_t commands_merged;
+	/** Commands turned into part of a single TMS sequence. */
+	uint64_t commands_flattened;
+	/** IR scans skipped because the IR already held their value. */
+	uint64_t ir_scans_dropped;
+	/** Approximate TCK cycles saved by skipped IR scans. */
+	uint64_t bits_saved;
+};
+
+void jtag_command_queue_optimize(bool flatten, tap_state_t state);
+
+void jtag_command_queue_get_stats(struct jtag_command_queue_stats *stats);
+void jtag_command_queue_reset_stats(void);
+
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src);
 enum scan_type jtag_scan_type(const struct scan_command *cmd);
 int jtag_scan_size(const struct scan_command *cmd);
@@ -88,6 +88,7 @@ static enum reset_types jtag_reset_config = RESET_NONE;
 tap_state_t cmd_queue_cur_state = TAP_RESET;
 
 static bool jtag_verify_capture_ir = true;
+static bool jtag_queue_optimize;
 static int jtag_verify = 1;
 
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
@@ -951,6 +952,11 @@ int default_interface_jtag_execute_queue(void)
 			return ERROR_OK;
 	}
 
+	if (jtag_queue_optimize) {
+		bool flatten = adapter_driver->jtag_ops->supported & DEBUG_CAP_FLAT_STREAM;
+		jtag_command_queue_optimize(flatten, tap_get_state());
+	}
+
 	int result = adapter_driver->jtag_ops->execute_queue();
 
 	struct jtag_command *cmd = jtag_command_queue;
@@ -1707,6 +1713,16 @@ bool jtag_will_verify_capture_ir(void)
 	return jtag_verify_capture_ir;
 }
 
+void jtag_set_queue_optimize(bool enable)
+{
+	jtag_queue_optimize = enable;
+}
+
+bool jtag_will_optimize_queue(void)
+{
+	return jtag_queue_optimize;
+}
+
 int jtag_power_dropout(int *dropout)
 {
 	if (!is_adapter_initialized()) {
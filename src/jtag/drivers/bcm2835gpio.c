@@ -199,6 +199,46 @@ static int bcm2835gpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+/* Whole scan in one tight loop, same waveform as bcm2835gpio_write() calls */
+static int bcm2835gpio_shift(const uint8_t *out, uint8_t *in, unsigned int num_bits, bool tms_last)
+{
+	const uint32_t tck_mask = 1 << adapter_gpio_config[ADAPTER_GPIO_IDX_TCK].gpio_num;
+	const uint32_t tms_mask = 1 << adapter_gpio_config[ADAPTER_GPIO_IDX_TMS].gpio_num;
+	const uint32_t tdi_mask = 1 << adapter_gpio_config[ADAPTER_GPIO_IDX_TDI].gpio_num;
+	const unsigned int tdo_shift = adapter_gpio_config[ADAPTER_GPIO_IDX_TDO].gpio_num;
+	const uint32_t tdo_invert = adapter_gpio_config[ADAPTER_GPIO_IDX_TDO].active_low ? 1 : 0;
+
+	for (unsigned int byte = 0; byte < DIV_ROUND_UP(num_bits, 8); byte++) {
+		unsigned int byte_bits = MIN(8U, num_bits - 8 * byte);
+		uint8_t tdi_byte = out ? out[byte] : 0;
+		uint8_t tdo_byte = 0;
+
+		for (unsigned int i = 0; i < byte_bits; i++) {
+			uint32_t set = ((tdi_byte >> i) & 1) ? tdi_mask : 0;
+			if (tms_last && 8 * byte + i == num_bits - 1)
+				set |= tms_mask;
+
+			GPIO_SET = set;
+			GPIO_CLR = (tck_mask | tms_mask | tdi_mask) & ~set;
+			bcm2835_gpio_synchronize();
+			bcm2835_delay();
+
+			tdo_byte |= (((GPIO_LEV >> tdo_shift) ^ tdo_invert) & 1) << i;
+
+			GPIO_SET = set | tck_mask;
+			bcm2835_gpio_synchronize();
+			bcm2835_delay();
+		}
+
+		if (in) {
+			uint8_t mask = 0xff >> (8 - byte_bits);
+			in[byte] = (in[byte] & ~mask) | tdo_byte;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 /* Requires push-pull drive mode for swclk and swdio */
 static int bcm2835gpio_swd_write_fast(int swclk, int swdio)
 {
@@ -271,6 +311,44 @@ static int bcm2835_swdio_read(void)
 	return value ^ (adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO].active_low ? 1 : 0);
 }
 
+/* Same waveform as bcm2835gpio_swd_write_fast() calls, push-pull only */
+static int bcm2835gpio_swd_shift_fast(const uint8_t *out, uint8_t *in,
+		unsigned int offset, unsigned int num_bits)
+{
+	const uint32_t swclk_mask = 1 << adapter_gpio_config[ADAPTER_GPIO_IDX_SWCLK].gpio_num;
+	const uint32_t swdio_mask = 1 << adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO].gpio_num;
+	const unsigned int swdio_shift = adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO].gpio_num;
+	const bool swclk_invert = adapter_gpio_config[ADAPTER_GPIO_IDX_SWCLK].active_low;
+	const bool swdio_invert = adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO].active_low;
+	const uint32_t clk_low = swclk_invert ? swclk_mask : 0;
+	const uint32_t clk_high = swclk_invert ? 0 : swclk_mask;
+
+	for (unsigned int i = offset; i < offset + num_bits; i++) {
+		bool swdio = out && ((out[i / 8] >> (i % 8)) & 1);
+		uint32_t dio = (swdio ^ swdio_invert) ? swdio_mask : 0;
+
+		GPIO_SET = clk_low | dio;
+		GPIO_CLR = (swclk_mask | swdio_mask) & ~(clk_low | dio);
+		bcm2835_gpio_synchronize();
+		bcm2835_delay();
+
+		if (in) {
+			bool bit = ((GPIO_LEV >> swdio_shift) & 1) ^ swdio_invert;
+			if (bit)
+				in[i / 8] |= 1 << (i % 8);
+			else
+				in[i / 8] &= ~(1 << (i % 8));
+		}
+
+		GPIO_SET = clk_high | dio;
+		GPIO_CLR = (swclk_mask | swdio_mask) & ~(clk_high | dio);
+		bcm2835_gpio_synchronize();
+		bcm2835_delay();
+	}
+
+	return ERROR_OK;
+}
+
 static int bcm2835gpio_khz(int khz, int *jtag_speed)
 {
 	if (!khz) {
@@ -423,6 +501,7 @@ static struct bitbang_interface bcm2835gpio_bitbang = {
 	.swdio_drive = bcm2835_swdio_drive,
 	.swd_write = bcm2835gpio_swd_write_generic,
 	.blink = bcm2835gpio_blink,
+	.shift = bcm2835gpio_shift,
 };
 
 static int bcm2835gpio_init(void)
@@ -519,9 +598,11 @@ LOG_INFO("pads conf set to %08x", pads_base[BCM2835_PADS_GPIO_0_27_OFFSET]);
 				adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO].drive == ADAPTER_GPIO_DRIVE_MODE_PUSH_PULL) {
 			LOG_DEBUG("BCM2835 GPIO using fast mode for SWD write");
 			bcm2835gpio_bitbang.swd_write = bcm2835gpio_swd_write_fast;
+			bcm2835gpio_bitbang.swd_shift = bcm2835gpio_swd_shift_fast;
 		} else {
 			LOG_DEBUG("BCM2835 GPIO using generic mode for SWD write");
 			bcm2835gpio_bitbang.swd_write = bcm2835gpio_swd_write_generic;
+			bcm2835gpio_bitbang.swd_shift = NULL;
 		}
 	}
 
@@ -66,6 +66,14 @@ static int bitbang_state_move(int skip)
 	uint8_t tms_scan = tap_get_tms_path(tap_get_state(), tap_get_end_state());
 	int tms_count = tap_get_tms_path_len(tap_get_state(), tap_get_end_state());
 
+	if (bitbang_interface->tms_seq) {
+		unsigned int num_bits = tms_count > skip ? tms_count - skip : 0;
+		if (bitbang_interface->tms_seq(&tms_scan, skip, num_bits) != ERROR_OK)
+			return ERROR_FAIL;
+		tap_set_state(tap_get_end_state());
+		return ERROR_OK;
+	}
+
 	for (i = skip; i < tms_count; i++) {
 		tms = (tms_scan >> i) & 1;
 		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
@@ -80,6 +88,23 @@ static int bitbang_state_move(int skip)
 	return ERROR_OK;
 }
 
+/**
+ * Follow the TAP state through a TMS sequence, so that a JTAG_TMS command
+ * may stand in for state moves (see DEBUG_CAP_FLAT_STREAM).
+ */
+static void bitbang_tms_track_state(const uint8_t *bits, unsigned int num_bits)
+{
+	tap_state_t state = tap_get_state();
+
+	if (state == TAP_INVALID)
+		return;
+
+	for (unsigned int i = 0; i < num_bits; i++)
+		state = tap_state_transition(state, (bits[i / 8] >> (i % 8)) & 1);
+
+	tap_set_state(state);
+}
+
 /**
  * Clock a bunch of TMS (or SWDIO) transitions, to change the JTAG
  * (or SWD) state machine.
@@ -91,6 +116,11 @@ static int bitbang_execute_tms(struct jtag_command *cmd)
 
 	LOG_DEBUG_IO("TMS: %d bits", num_bits);
 
+	bitbang_tms_track_state(bits, num_bits);
+
+	if (bitbang_interface->tms_seq)
+		return bitbang_interface->tms_seq(bits, 0, num_bits);
+
 	int tms = 0;
 	for (unsigned i = 0; i < num_bits; i++) {
 		tms = ((bits[i/8] >> (i % 8)) & 1);
@@ -110,6 +140,15 @@ static int bitbang_path_move(struct pathmove_command *cmd)
 	int num_states = cmd->num_states;
 	int state_count;
 	int tms = 0;
+	uint8_t *tms_bits = NULL;
+
+	if (bitbang_interface->tms_seq) {
+		tms_bits = calloc(DIV_ROUND_UP(num_states, 8), 1);
+		if (!tms_bits) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+	}
 
 	state_count = 0;
 	while (num_states) {
@@ -124,18 +163,28 @@ static int bitbang_path_move(struct pathmove_command *cmd)
 			exit(-1);
 		}
 
-		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
+		if (tms_bits) {
+			buf_set_u32(tms_bits, state_count, 1, tms);
+		} else {
+			if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
+				return ERROR_FAIL;
+			if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
+				return ERROR_FAIL;
+		}
 
 		tap_set_state(cmd->path[state_count]);
 		state_count++;
 		num_states--;
 	}
 
-	if (bitbang_interface->write(CLOCK_IDLE(), tms, 0) != ERROR_OK)
+	if (tms_bits) {
+		int retval = bitbang_interface->tms_seq(tms_bits, 0, state_count);
+		free(tms_bits);
+		if (retval != ERROR_OK)
+			return ERROR_FAIL;
+	} else if (bitbang_interface->write(CLOCK_IDLE(), tms, 0) != ERROR_OK) {
 		return ERROR_FAIL;
+	}
 
 	tap_set_end_state(tap_get_state());
 	return ERROR_OK;
@@ -155,14 +204,19 @@ static int bitbang_runtest(int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++) {
-		if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
+	if (bitbang_interface->clocks) {
+		if (bitbang_interface->clocks(num_cycles, 0) != ERROR_OK)
 			return ERROR_FAIL;
-		if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
+	} else {
+		for (i = 0; i < num_cycles; i++) {
+			if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
+				return ERROR_FAIL;
+			if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
+				return ERROR_FAIL;
+		}
+		if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK)
 			return ERROR_FAIL;
 	}
-	if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK)
-		return ERROR_FAIL;
 
 	/* finish in end_state */
 	bitbang_end_state(saved_end_state);
@@ -178,6 +232,10 @@ static int bitbang_stableclocks(int num_cycles)
 	int tms = (tap_get_state() == TAP_RESET ? 1 : 0);
 	int i;
 
+	/* TCK is low in stable states, so this is the same waveform */
+	if (bitbang_interface->clocks)
+		return bitbang_interface->clocks(num_cycles, tms);
+
 	/* send num_cycles clocks onto the cable */
 	for (i = 0; i < num_cycles; i++) {
 		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
@@ -189,84 +247,170 @@ static int bitbang_stableclocks(int num_cycles)
 	return ERROR_OK;
 }
 
-static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
-		unsigned scan_size)
+/* Read up to 32 bits starting at any bit offset, LSB first */
+static inline uint32_t bitbang_get_bits(const uint8_t *buf, unsigned int start,
+		unsigned int num_bits)
 {
-	tap_state_t saved_end_state = tap_get_end_state();
-	unsigned bit_cnt;
+	const uint8_t *p = buf + start / 8;
+	unsigned int shift = start % 8;
+	unsigned int num_bytes = DIV_ROUND_UP(shift + num_bits, 8);
+	uint64_t value = 0;
 
-	if (!((!ir_scan &&
-			(tap_get_state() == TAP_DRSHIFT)) ||
-			(ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
-		if (ir_scan)
-			bitbang_end_state(TAP_IRSHIFT);
-		else
-			bitbang_end_state(TAP_DRSHIFT);
+	for (unsigned int i = 0; i < num_bytes; i++)
+		value |= (uint64_t)p[i] << (8 * i);
+	value >>= shift;
 
-		if (bitbang_state_move(0) != ERROR_OK)
+	return num_bits == 32 ? (uint32_t)value : (uint32_t)value & ((1U << num_bits) - 1);
+}
+
+/* Write up to 32 bits starting at any bit offset, leaving other bits alone */
+static inline void bitbang_set_bits(uint8_t *buf, unsigned int start,
+		unsigned int num_bits, uint32_t value)
+{
+	uint8_t *p = buf + start / 8;
+	unsigned int shift = start % 8;
+	unsigned int num_bytes = DIV_ROUND_UP(shift + num_bits, 8);
+	uint64_t mask = ((num_bits == 32 ? 0xffffffffULL : ((1ULL << num_bits) - 1))) << shift;
+	uint64_t bits = ((uint64_t)value << shift) & mask;
+
+	for (unsigned int i = 0; i < num_bytes; i++) {
+		uint8_t m = mask >> (8 * i);
+		p[i] = (p[i] & ~m) | (uint8_t)(bits >> (8 * i));
+	}
+}
+
+/* Collects sampled bits in a word and stores them 32 at a time */
+struct bitbang_sampler {
+	uint8_t *buf;
+	unsigned int pos;
+	unsigned int count;
+	uint32_t word;
+};
+
+static inline void bitbang_sampler_flush(struct bitbang_sampler *s)
+{
+	if (s->count && s->buf)
+		bitbang_set_bits(s->buf, s->pos, s->count, s->word);
+	s->pos += s->count;
+	s->count = 0;
+	s->word = 0;
+}
+
+static inline void bitbang_sampler_push(struct bitbang_sampler *s, bool bit)
+{
+	s->word |= (uint32_t)bit << s->count;
+	if (++s->count == 32)
+		bitbang_sampler_flush(s);
+}
+
+/* Read back the TDO values buffered with sample() */
+static int bitbang_read_samples(struct bitbang_sampler *s, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		switch (bitbang_interface->read_sample()) {
+		case BB_LOW:
+			bitbang_sampler_push(s, false);
+			break;
+		case BB_HIGH:
+			bitbang_sampler_push(s, true);
+			break;
+		default:
 			return ERROR_FAIL;
-		bitbang_end_state(saved_end_state);
+		}
 	}
+	return ERROR_OK;
+}
 
+/**
+ * Generic implementation of bitbang_interface::shift() on top of write()
+ * and read() or sample()/read_sample(). The TDI bits are fetched and the
+ * TDO bits stored a word at a time.
+ */
+int bitbang_shift_generic(const uint8_t *out, uint8_t *in,
+		unsigned int num_bits, bool tms_last)
+{
+	struct bitbang_sampler sampler = { .buf = in };
 	size_t buffered = 0;
-	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
-		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
-		int tdi;
-		int bytec = bit_cnt/8;
-		int bcval = 1 << (bit_cnt % 8);
-
-		/* if we're just reading the scan, but don't care about the output
-		 * default to outputting 'low', this also makes valgrind traces more readable,
-		 * as it removes the dependency on an uninitialised value
-		 */
-		tdi = 0;
-		if ((type != SCAN_IN) && (buffer[bytec] & bcval))
-			tdi = 1;
 
-		if (bitbang_interface->write(0, tms, tdi) != ERROR_OK)
-			return ERROR_FAIL;
+	for (unsigned int word_start = 0; word_start < num_bits; word_start += 32) {
+		unsigned int word_bits = MIN(32U, num_bits - word_start);
+		/* when we don't care about the output, default to outputting 'low',
+		 * this also makes valgrind traces more readable, as it removes the
+		 * dependency on an uninitialised value */
+		uint32_t tdi_word = out ? bitbang_get_bits(out, word_start, word_bits) : 0;
 
-		if (type != SCAN_OUT) {
-			if (bitbang_interface->buf_size) {
-				if (bitbang_interface->sample() != ERROR_OK)
-					return ERROR_FAIL;
-				buffered++;
-			} else {
-				switch (bitbang_interface->read()) {
+		for (unsigned int i = 0; i < word_bits; i++, tdi_word >>= 1) {
+			int tms = (tms_last && word_start + i == num_bits - 1) ? 1 : 0;
+			int tdi = tdi_word & 1;
+
+			if (bitbang_interface->write(0, tms, tdi) != ERROR_OK)
+				return ERROR_FAIL;
+
+			if (in) {
+				if (bitbang_interface->buf_size) {
+					if (bitbang_interface->sample() != ERROR_OK)
+						return ERROR_FAIL;
+					buffered++;
+				} else {
+					switch (bitbang_interface->read()) {
 					case BB_LOW:
-						buffer[bytec] &= ~bcval;
+						bitbang_sampler_push(&sampler, false);
 						break;
 					case BB_HIGH:
-						buffer[bytec] |= bcval;
+						bitbang_sampler_push(&sampler, true);
 						break;
 					default:
 						return ERROR_FAIL;
+					}
 				}
 			}
-		}
 
-		if (bitbang_interface->write(1, tms, tdi) != ERROR_OK)
-			return ERROR_FAIL;
+			if (bitbang_interface->write(1, tms, tdi) != ERROR_OK)
+				return ERROR_FAIL;
 
-		if (type != SCAN_OUT && bitbang_interface->buf_size &&
-				(buffered == bitbang_interface->buf_size ||
-				 bit_cnt == scan_size - 1)) {
-			for (unsigned i = bit_cnt + 1 - buffered; i <= bit_cnt; i++) {
-				switch (bitbang_interface->read_sample()) {
-					case BB_LOW:
-						buffer[i/8] &= ~(1 << (i % 8));
-						break;
-					case BB_HIGH:
-						buffer[i/8] |= 1 << (i % 8);
-						break;
-					default:
-						return ERROR_FAIL;
-				}
+			if (buffered == bitbang_interface->buf_size && buffered) {
+				if (bitbang_read_samples(&sampler, buffered) != ERROR_OK)
+					return ERROR_FAIL;
+				buffered = 0;
 			}
-			buffered = 0;
 		}
 	}
 
+	if (bitbang_read_samples(&sampler, buffered) != ERROR_OK)
+		return ERROR_FAIL;
+	bitbang_sampler_flush(&sampler);
+
+	return ERROR_OK;
+}
+
+static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
+		unsigned scan_size)
+{
+	tap_state_t saved_end_state = tap_get_end_state();
+
+	if (!((!ir_scan &&
+			(tap_get_state() == TAP_DRSHIFT)) ||
+			(ir_scan && (tap_get_state() == TAP_IRSHIFT)))) {
+		if (ir_scan)
+			bitbang_end_state(TAP_IRSHIFT);
+		else
+			bitbang_end_state(TAP_DRSHIFT);
+
+		if (bitbang_state_move(0) != ERROR_OK)
+			return ERROR_FAIL;
+		bitbang_end_state(saved_end_state);
+	}
+
+	const uint8_t *out = type != SCAN_IN ? buffer : NULL;
+	uint8_t *in = type != SCAN_OUT ? buffer : NULL;
+	int retval;
+	if (bitbang_interface->shift)
+		retval = bitbang_interface->shift(out, in, scan_size, true);
+	else
+		retval = bitbang_shift_generic(out, in, scan_size, true);
+	if (retval != ERROR_OK)
+		return ERROR_FAIL;
+
 	if (tap_get_state() != tap_get_end_state()) {
 		/* we *KNOW* the above loop transitioned out of
 		 * the shift state, so we skip the first state
@@ -378,6 +522,31 @@ static int bitbang_swd_init(void)
 	return ERROR_OK;
 }
 
+/* Generic SWD bit transfer on top of swd_write() and swdio_read() */
+static void bitbang_swd_shift_generic(const uint8_t *out, uint8_t *in,
+		unsigned int offset, unsigned int bit_cnt)
+{
+	struct bitbang_sampler sampler = { .buf = in, .pos = offset };
+
+	for (unsigned int word_start = 0; word_start < bit_cnt; word_start += 32) {
+		unsigned int word_bits = MIN(32U, bit_cnt - word_start);
+		uint32_t swdio_word = out ? bitbang_get_bits(out, offset + word_start, word_bits) : 0;
+
+		for (unsigned int i = 0; i < word_bits; i++, swdio_word >>= 1) {
+			int swdio = swdio_word & 1;
+
+			bitbang_interface->swd_write(0, swdio);
+
+			if (in)
+				bitbang_sampler_push(&sampler, bitbang_interface->swdio_read());
+
+			bitbang_interface->swd_write(1, swdio);
+		}
+	}
+
+	bitbang_sampler_flush(&sampler);
+}
+
 static void bitbang_swd_exchange(bool rnw, uint8_t buf[], unsigned int offset, unsigned int bit_cnt)
 {
 	if (bitbang_interface->blink) {
@@ -385,22 +554,14 @@ static void bitbang_swd_exchange(bool rnw, uint8_t buf[], unsigned int offset, u
 		bitbang_interface->blink(1);
 	}
 
-	for (unsigned int i = offset; i < bit_cnt + offset; i++) {
-		int bytec = i/8;
-		int bcval = 1 << (i % 8);
-		int swdio = !rnw && (buf[bytec] & bcval);
-
-		bitbang_interface->swd_write(0, swdio);
+	const uint8_t *out = rnw ? NULL : buf;
+	uint8_t *in = rnw ? buf : NULL;
 
-		if (rnw && buf) {
-			if (bitbang_interface->swdio_read())
-				buf[bytec] |= bcval;
-			else
-				buf[bytec] &= ~bcval;
-		}
-
-		bitbang_interface->swd_write(1, swdio);
-	}
+	/* FIXME: we should manage errors */
+	if (bitbang_interface->swd_shift)
+		bitbang_interface->swd_shift(out, in, offset, bit_cnt);
+	else
+		bitbang_swd_shift_generic(out, in, offset, bit_cnt);
 
 	if (bitbang_interface->blink) {
 		/* FIXME: we should manage errors */
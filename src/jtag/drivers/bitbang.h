@@ -54,12 +54,41 @@ struct bitbang_interface {
 
 	/** Set SWCLK and SWDIO to the given value. */
 	int (*swd_write)(int swclk, int swdio);
+
+	/** Shift @a num_bits bits through TDI (optional).
+	 * Each bit is clocked like write(0, tms, tdi), sample TDO, then
+	 * write(1, tms, tdi), with TMS low except for the last bit when
+	 * @a tms_last is set. TCK is left high.
+	 * @param out bits to shift out, LSB first, or NULL to shift zeros.
+	 * @param in buffer for the sampled TDO bits or NULL to discard them;
+	 * may be the same as @a out. */
+	int (*shift)(const uint8_t *out, uint8_t *in, unsigned int num_bits, bool tms_last);
+
+	/** Clock out @a num_bits TMS bits of @a bits, starting at bit @a offset,
+	 * with TDI low, then drive TCK low keeping the last TMS value (or 0 if
+	 * @a num_bits is 0) (optional). */
+	int (*tms_seq)(const uint8_t *bits, unsigned int offset, unsigned int num_bits);
+
+	/** Clock @a num_cycles TCK cycles with constant @a tms and TDI low, then
+	 * drive TCK low (optional). */
+	int (*clocks)(unsigned int num_cycles, int tms);
+
+	/** Clock @a num_bits SWD bits starting at bit @a offset (optional).
+	 * Each bit is clocked like swd_write(0, swdio), sample SWDIO,
+	 * swd_write(1, swdio).
+	 * @param out bits to drive on SWDIO, or NULL to drive zeros.
+	 * @param in buffer for the sampled SWDIO bits or NULL to discard them. */
+	int (*swd_shift)(const uint8_t *out, uint8_t *in, unsigned int offset,
+			unsigned int num_bits);
 };
 
 extern const struct swd_driver bitbang_swd;
 
 int bitbang_execute_queue(void);
 
+int bitbang_shift_generic(const uint8_t *out, uint8_t *in,
+		unsigned int num_bits, bool tms_last);
+
 extern struct bitbang_interface *bitbang_interface;
 
 #endif /* OPENOCD_JTAG_DRIVERS_BITBANG_H */
@@ -185,9 +185,12 @@ static int jtag_add_plain_scan(int num_bits, const uint8_t *out_bits,
 	scan->fields = out_fields;
 	scan->end_state = state;
 
-	out_fields->num_bits = num_bits;
-	out_fields->out_value = buf_cpy(out_bits, cmd_queue_alloc(DIV_ROUND_UP(num_bits, 8)), num_bits);
-	out_fields->in_value = in_bits;
+	struct scan_field field = {
+		.num_bits = num_bits,
+		.out_value = out_bits,
+		.in_value = in_bits,
+	};
+	jtag_scan_field_clone(out_fields, &field);
 
 	return ERROR_OK;
 }
@@ -10,6 +10,7 @@
 #endif
 
 #include <jtag/interface.h>
+#include <helper/time_support.h>
 #include "bitbang.h"
 #include "hello.h"
 
@@ -77,10 +78,30 @@ static int dummy_led(int on)
 	return ERROR_OK;
 }
 
+static int dummy_shift(const uint8_t *out, uint8_t *in, unsigned int num_bits, bool tms_last)
+{
+	for (unsigned int i = 0; i < num_bits; i++) {
+		int tms = (tms_last && i == num_bits - 1) ? 1 : 0;
+		int tdi = out ? (out[i / 8] >> (i % 8)) & 1 : 0;
+
+		dummy_write(0, tms, tdi);
+		bb_value_t tdo = dummy_read();
+		if (in) {
+			if (tdo == BB_HIGH)
+				in[i / 8] |= 1 << (i % 8);
+			else
+				in[i / 8] &= ~(1 << (i % 8));
+		}
+		dummy_write(1, tms, tdi);
+	}
+	return ERROR_OK;
+}
+
 static struct bitbang_interface dummy_bitbang = {
 		.read = &dummy_read,
 		.write = &dummy_write,
 		.blink = &dummy_led,
+		.shift = &dummy_shift,
 	};
 
 static int dummy_khz(int khz, int *jtag_speed)
@@ -119,12 +140,96 @@ static int dummy_quit(void)
 	return ERROR_OK;
 }
 
+static int dummy_bench_scans(unsigned int num_bits, unsigned int count,
+		uint8_t *out, uint8_t *in, int64_t *elapsed_ms)
+{
+	int64_t start = timeval_ms();
+
+	for (unsigned int i = 0; i < count; i++) {
+		jtag_add_plain_dr_scan(num_bits, out, in, TAP_IDLE);
+		int retval = jtag_execute_queue();
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	*elapsed_ms = timeval_ms() - start;
+	return ERROR_OK;
+}
+
+/* Compare the generic bitbang shift with the driver's bulk shift() */
+COMMAND_HANDLER(dummy_handle_bitbang_bench_command)
+{
+	unsigned int num_bits = 4096;
+	unsigned int count = 1000;
+
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC > 0)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], num_bits);
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], count);
+	if (num_bits == 0 || count == 0)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	if (bitbang_interface != &dummy_bitbang) {
+		command_print(CMD, "dummy adapter is not initialized");
+		return ERROR_FAIL;
+	}
+
+	uint8_t *out = malloc(DIV_ROUND_UP(num_bits, 8));
+	uint8_t *in = malloc(DIV_ROUND_UP(num_bits, 8));
+	if (!out || !in) {
+		free(out);
+		free(in);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	for (unsigned int i = 0; i < DIV_ROUND_UP(num_bits, 8); i++)
+		out[i] = i * 0x35;
+
+	int64_t generic_ms, bulk_ms;
+	dummy_bitbang.shift = NULL;
+	int retval = dummy_bench_scans(num_bits, count, out, in, &generic_ms);
+	dummy_bitbang.shift = &dummy_shift;
+	if (retval == ERROR_OK)
+		retval = dummy_bench_scans(num_bits, count, out, in, &bulk_ms);
+
+	free(out);
+	free(in);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint64_t total_bits = (uint64_t)num_bits * count;
+	command_print(CMD, "%u scans of %u bits", count, num_bits);
+	command_print(CMD, "generic shift: %" PRId64 " ms (%" PRIu64 " kbit/s)", generic_ms,
+		generic_ms ? total_bits / generic_ms : 0);
+	command_print(CMD, "bulk shift:    %" PRId64 " ms (%" PRIu64 " kbit/s)", bulk_ms,
+		bulk_ms ? total_bits / bulk_ms : 0);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration dummy_subcommand_handlers[] = {
+	{
+		.name = "bitbang_bench",
+		.handler = &dummy_handle_bitbang_bench_command,
+		.mode = COMMAND_EXEC,
+		.help = "time plain DR scans through the generic bitbang shift "
+			"and through the driver bulk shift",
+		.usage = "[num_bits [count]]",
+	},
+	{
+		.chain = hello_command_handlers,
+	},
+	COMMAND_REGISTRATION_DONE,
+};
+
 static const struct command_registration dummy_command_handlers[] = {
 	{
 		.name = "dummy",
 		.mode = COMMAND_ANY,
 		.help = "dummy interface driver commands",
-		.chain = hello_command_handlers,
+		.chain = dummy_subcommand_handlers,
 		.usage = "",
 	},
 	COMMAND_REGISTRATION_DONE,
@@ -134,7 +239,7 @@ static const struct command_registration dummy_command_handlers[] = {
  * where the target is unresponsive.
  */
 static struct jtag_interface dummy_interface = {
-	.supported = DEBUG_CAP_TMS_SEQ,
+	.supported = DEBUG_CAP_TMS_SEQ | DEBUG_CAP_FLAT_STREAM,
 	.execute_queue = &bitbang_execute_queue,
 };
 
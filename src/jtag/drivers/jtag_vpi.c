@@ -37,6 +37,44 @@
 #define CMD_SCAN_CHAIN		2
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
+#define CMD_GET_CAPS		5
+#define CMD_BATCH		6
+
+/*
+ * Batched protocol extension.
+ *
+ * When enabled with "jtag_vpi batch on", OpenOCD sends a CMD_GET_CAPS
+ * vpi_cmd after connecting. A server that supports the extension answers
+ * with a vpi_cmd whose buffer_in holds four little endian words: magic,
+ * version, maximum frame size and maximum number of frames in flight.
+ * Servers that do not answer within VPI_CAPS_TIMEOUT_MS are driven with
+ * the original one-command protocol.
+ *
+ * A batch frame is a 16 byte header (cmd = CMD_BATCH, sequence number,
+ * number of ops, payload length) followed by the ops. Each op has an 8 byte
+ * header (op, flags, 2 reserved bytes, nb_bits) followed by the TDI bytes
+ * unless VPI_OP_FLAG_NO_TDI is set. The reply uses the same header and its
+ * payload is the concatenated TDO bytes of every op that did not set
+ * VPI_OP_FLAG_NO_TDO. All words are little endian.
+ */
+#define VPI_CAPS_MAGIC		0x42495056	/* "VPIB" */
+#define VPI_BATCH_VERSION	1
+#define VPI_CAPS_TIMEOUT_MS	1000
+
+#define VPI_OP_RESET		0
+#define VPI_OP_TMS_SEQ		1
+#define VPI_OP_SCAN		2
+#define VPI_OP_SCAN_FLIP_TMS	3
+
+#define VPI_OP_FLAG_NO_TDI	0x01	/* shift ones, no TDI bytes in the frame */
+#define VPI_OP_FLAG_NO_TDO	0x02	/* captured TDO is not returned */
+
+#define VPI_BATCH_HDR_SIZE	16
+#define VPI_OP_HDR_SIZE		8
+
+#define DEFAULT_BATCH_FRAME_SIZE	(64 * 1024)
+#define DEFAULT_BATCH_WINDOW		4
+#define MIN_BATCH_FRAME_SIZE		(VPI_BATCH_HDR_SIZE + VPI_OP_HDR_SIZE + XFERT_MAX_SIZE)
 
 /* jtag_vpi server port and address to connect to */
 static int server_port = DEFAULT_SERVER_PORT;
@@ -48,6 +86,53 @@ static bool stop_sim_on_exit;
 static int sockfd;
 static struct sockaddr_in serv_addr;
 
+/* Batched protocol configuration, as requested by the user */
+static bool batch_requested;
+static uint32_t batch_frame_size = DEFAULT_BATCH_FRAME_SIZE;
+static unsigned int batch_window = DEFAULT_BATCH_WINDOW;
+
+/* Where the TDO bytes of one op of a batch frame end up */
+struct vpi_tdo_dest {
+	uint8_t *buf;
+	uint32_t len;
+};
+
+struct vpi_batch_frame {
+	uint32_t seq;
+	uint32_t nb_ops;
+	/* outgoing frame, header included */
+	uint8_t *data;
+	uint32_t len;
+	/* expected length of the reply payload */
+	uint32_t tdo_len;
+	struct vpi_tdo_dest *dests;
+	unsigned int nb_dests;
+	unsigned int max_dests;
+};
+
+/* A scan whose TDO is still in flight, finished at the end of the queue */
+struct vpi_pending_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+};
+
+static struct {
+	/* set once the server accepted the batched protocol */
+	bool active;
+	uint32_t frame_size;
+	unsigned int window;
+	uint32_t next_seq;
+	/* frames[0..window-1] form a ring: in flight frames start at 'first' */
+	struct vpi_batch_frame *frames;
+	unsigned int first;
+	unsigned int in_flight;
+	/* the frame being filled, or NULL */
+	struct vpi_batch_frame *current;
+	struct vpi_pending_scan *scans;
+	unsigned int nb_scans;
+	unsigned int max_scans;
+} batch;
+
 /* One jtag_vpi "packet" as sent over a TCP channel. */
 struct vpi_cmd {
 	union {
@@ -195,6 +280,342 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 	return ERROR_OK;
 }
 
+static int jtag_vpi_write_all(const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0) {
+		int retval = write_socket(sockfd, p, len);
+		if (retval < 0) {
+#ifdef _WIN32
+			if (WSAGetLastError() == WSAEINTR)
+				continue;
+#else
+			if (errno == EINTR)
+				continue;
+#endif
+			log_socket_error("jtag_vpi xmit");
+			return ERROR_FAIL;
+		}
+		p += retval;
+		len -= retval;
+	}
+
+	return ERROR_OK;
+}
+
+static int jtag_vpi_read_all(void *data, size_t len)
+{
+	char *p = data;
+
+	while (len > 0) {
+		int retval = read_socket(sockfd, p, len);
+		if (retval < 0) {
+#ifdef _WIN32
+			if (WSAGetLastError() == WSAEINTR)
+				continue;
+#else
+			if (errno == EINTR)
+				continue;
+#endif
+			log_socket_error("jtag_vpi recv");
+			return ERROR_FAIL;
+		} else if (retval == 0) {
+			LOG_ERROR("Connection prematurely closed by jtag_vpi server.");
+			return ERROR_FAIL;
+		}
+		p += retval;
+		len -= retval;
+	}
+
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_negotiate_batch - ask the server for the batched protocol
+ *
+ * Returns ERROR_OK in any case but the fatal socket errors; batch.active
+ * tells if the server accepted.
+ */
+static int jtag_vpi_negotiate_batch(void)
+{
+	struct vpi_cmd vpi;
+	memset(&vpi, 0, sizeof(struct vpi_cmd));
+
+	vpi.cmd = CMD_GET_CAPS;
+	h_u32_to_le(vpi.buffer_out, VPI_CAPS_MAGIC);
+	h_u32_to_le(vpi.buffer_out + 4, VPI_BATCH_VERSION);
+	h_u32_to_le(vpi.buffer_out + 8, batch_frame_size);
+	h_u32_to_le(vpi.buffer_out + 12, batch_window);
+	vpi.length = 16;
+
+	int retval = jtag_vpi_send_cmd(&vpi);
+	if (retval != ERROR_OK)
+		return retval;
+
+	fd_set read_fds;
+	struct timeval tv;
+	FD_ZERO(&read_fds);
+	FD_SET(sockfd, &read_fds);
+	tv.tv_sec = VPI_CAPS_TIMEOUT_MS / 1000;
+	tv.tv_usec = (VPI_CAPS_TIMEOUT_MS % 1000) * 1000;
+	if (socket_select(sockfd + 1, &read_fds, NULL, NULL, &tv) <= 0) {
+		LOG_INFO("jtag_vpi: server does not support batched commands, "
+			"using one command per transfer");
+		return ERROR_OK;
+	}
+
+	retval = jtag_vpi_receive_cmd(&vpi);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (vpi.cmd != CMD_GET_CAPS || le_to_h_u32(vpi.buffer_in) != VPI_CAPS_MAGIC
+			|| le_to_h_u32(vpi.buffer_in + 4) < VPI_BATCH_VERSION) {
+		LOG_WARNING("jtag_vpi: unexpected reply to capability request, "
+			"using one command per transfer");
+		return ERROR_OK;
+	}
+
+	batch.frame_size = MIN(batch_frame_size, le_to_h_u32(vpi.buffer_in + 8));
+	batch.window = MIN(batch_window, le_to_h_u32(vpi.buffer_in + 12));
+	if (batch.frame_size < MIN_BATCH_FRAME_SIZE || batch.window == 0) {
+		LOG_WARNING("jtag_vpi: server batch limits too small (frame %" PRIu32
+			" bytes, window %u), using one command per transfer",
+			batch.frame_size, batch.window);
+		return ERROR_OK;
+	}
+
+	batch.frames = calloc(batch.window, sizeof(*batch.frames));
+	if (!batch.frames) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	for (unsigned int i = 0; i < batch.window; i++) {
+		batch.frames[i].data = malloc(batch.frame_size);
+		if (!batch.frames[i].data) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+	}
+
+	/* The replies of the frames in flight must fit in the receive buffer,
+	 * otherwise a single threaded server blocks on writing them while we
+	 * block on sending the next frame. */
+	int rcvbuf = batch.frame_size * batch.window;
+	setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (char *)&rcvbuf, sizeof(rcvbuf));
+
+	batch.active = true;
+	LOG_INFO("jtag_vpi: using batched commands, %" PRIu32 " bytes per frame, "
+		"%u frames in flight", batch.frame_size, batch.window);
+
+	return ERROR_OK;
+}
+
+static void jtag_vpi_batch_free(void)
+{
+	if (batch.frames) {
+		for (unsigned int i = 0; i < batch.window; i++) {
+			free(batch.frames[i].data);
+			free(batch.frames[i].dests);
+		}
+	}
+	free(batch.frames);
+	free(batch.scans);
+	memset(&batch, 0, sizeof(batch));
+}
+
+/* Receive the reply to the oldest frame in flight and scatter its TDO */
+static int jtag_vpi_batch_receive(void)
+{
+	struct vpi_batch_frame *frame = &batch.frames[batch.first];
+	uint8_t hdr[VPI_BATCH_HDR_SIZE];
+
+	int retval = jtag_vpi_read_all(hdr, sizeof(hdr));
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint32_t cmd = le_to_h_u32(hdr);
+	uint32_t seq = le_to_h_u32(hdr + 4);
+	uint32_t len = le_to_h_u32(hdr + 12);
+	if (cmd != CMD_BATCH || seq != frame->seq || len != frame->tdo_len) {
+		LOG_ERROR("jtag_vpi: bad batch reply (cmd %" PRIu32 ", seq %" PRIu32
+			", len %" PRIu32 "), expected seq %" PRIu32 ", len %" PRIu32,
+			cmd, seq, len, frame->seq, frame->tdo_len);
+		return ERROR_FAIL;
+	}
+
+	for (unsigned int i = 0; i < frame->nb_dests; i++) {
+		retval = jtag_vpi_read_all(frame->dests[i].buf, frame->dests[i].len);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	LOG_DEBUG_IO("recvd JTAG VPI batch reply: seq=%" PRIu32 ", len=%" PRIu32,
+		seq, len);
+
+	batch.first = (batch.first + 1) % batch.window;
+	batch.in_flight--;
+
+	return ERROR_OK;
+}
+
+/* Send the frame being filled, keeping at most batch.window frames in flight */
+static int jtag_vpi_batch_send(void)
+{
+	struct vpi_batch_frame *frame = batch.current;
+
+	if (!frame)
+		return ERROR_OK;
+
+	h_u32_to_le(frame->data, CMD_BATCH);
+	h_u32_to_le(frame->data + 4, frame->seq);
+	h_u32_to_le(frame->data + 8, frame->nb_ops);
+	h_u32_to_le(frame->data + 12, frame->len - VPI_BATCH_HDR_SIZE);
+
+	LOG_DEBUG_IO("sending JTAG VPI batch: seq=%" PRIu32 ", ops=%" PRIu32
+		", len=%" PRIu32, frame->seq, frame->nb_ops, frame->len);
+
+	batch.current = NULL;
+	batch.in_flight++;
+
+	return jtag_vpi_write_all(frame->data, frame->len);
+}
+
+/* Send the frame being filled and wait for all the replies */
+static int jtag_vpi_batch_flush(void)
+{
+	int retval = jtag_vpi_batch_send();
+
+	while (retval == ERROR_OK && batch.in_flight > 0)
+		retval = jtag_vpi_batch_receive();
+
+	return retval;
+}
+
+/* Return a frame with room for 'len' more bytes */
+static int jtag_vpi_batch_reserve(uint32_t len, struct vpi_batch_frame **out)
+{
+	int retval;
+
+	if (batch.current && batch.current->len + len > batch.frame_size) {
+		retval = jtag_vpi_batch_send();
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (!batch.current) {
+		if (batch.in_flight == batch.window) {
+			retval = jtag_vpi_batch_receive();
+			if (retval != ERROR_OK)
+				return retval;
+		}
+
+		struct vpi_batch_frame *frame =
+			&batch.frames[(batch.first + batch.in_flight) % batch.window];
+		frame->seq = batch.next_seq++;
+		frame->nb_ops = 0;
+		frame->len = VPI_BATCH_HDR_SIZE;
+		frame->tdo_len = 0;
+		frame->nb_dests = 0;
+		batch.current = frame;
+	}
+
+	*out = batch.current;
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_batch_add_op - append an op to the frame being filled
+ * @param op one of VPI_OP_xxx
+ * @param tdi bits to shift, or NULL to shift ones
+ * @param tdo where to store the captured bits, or NULL to discard them
+ * @param nb_bits number of bits
+ */
+static int jtag_vpi_batch_add_op(uint8_t op, const uint8_t *tdi, uint8_t *tdo,
+		uint32_t nb_bits)
+{
+	uint32_t nb_bytes = DIV_ROUND_UP(nb_bits, 8);
+	uint8_t flags = 0;
+	struct vpi_batch_frame *frame;
+
+	if (!tdi)
+		flags |= VPI_OP_FLAG_NO_TDI;
+	if (!tdo)
+		flags |= VPI_OP_FLAG_NO_TDO;
+
+	int retval = jtag_vpi_batch_reserve(VPI_OP_HDR_SIZE + (tdi ? nb_bytes : 0), &frame);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (tdo && nb_bytes > 0) {
+		if (frame->nb_dests == frame->max_dests) {
+			unsigned int max_dests = frame->max_dests ? 2 * frame->max_dests : 32;
+			struct vpi_tdo_dest *dests = realloc(frame->dests, max_dests * sizeof(*dests));
+			if (!dests) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+			frame->dests = dests;
+			frame->max_dests = max_dests;
+		}
+		frame->dests[frame->nb_dests].buf = tdo;
+		frame->dests[frame->nb_dests].len = nb_bytes;
+		frame->nb_dests++;
+		frame->tdo_len += nb_bytes;
+	}
+
+	uint8_t *p = frame->data + frame->len;
+	p[0] = op;
+	p[1] = flags;
+	p[2] = 0;
+	p[3] = 0;
+	h_u32_to_le(p + 4, nb_bits);
+	if (tdi)
+		memcpy(p + VPI_OP_HDR_SIZE, tdi, nb_bytes);
+
+	frame->len += VPI_OP_HDR_SIZE + (tdi ? nb_bytes : 0);
+	frame->nb_ops++;
+
+	return ERROR_OK;
+}
+
+/* Remember a scan whose TDO buffer is filled in when its frame returns */
+static int jtag_vpi_batch_add_scan(struct scan_command *cmd, uint8_t *buf)
+{
+	if (batch.nb_scans == batch.max_scans) {
+		unsigned int max_scans = batch.max_scans ? 2 * batch.max_scans : 64;
+		struct vpi_pending_scan *scans = realloc(batch.scans, max_scans * sizeof(*scans));
+		if (!scans) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		batch.scans = scans;
+		batch.max_scans = max_scans;
+	}
+
+	batch.scans[batch.nb_scans].cmd = cmd;
+	batch.scans[batch.nb_scans].buf = buf;
+	batch.nb_scans++;
+
+	return ERROR_OK;
+}
+
+/* Wait for all frames and hand the captured bits to the scan fields */
+static int jtag_vpi_batch_complete(int retval)
+{
+	if (retval == ERROR_OK)
+		retval = jtag_vpi_batch_flush();
+
+	for (unsigned int i = 0; i < batch.nb_scans; i++) {
+		if (retval == ERROR_OK)
+			retval = jtag_read_buffer(batch.scans[i].buf, batch.scans[i].cmd);
+		free(batch.scans[i].buf);
+	}
+	batch.nb_scans = 0;
+
+	return retval;
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @param trst 1 if TRST is to be asserted
@@ -202,6 +623,9 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
  */
 static int jtag_vpi_reset(int trst, int srst)
 {
+	if (batch.active)
+		return jtag_vpi_batch_add_op(VPI_OP_RESET, NULL, NULL, 0);
+
 	struct vpi_cmd vpi;
 	memset(&vpi, 0, sizeof(struct vpi_cmd));
 
@@ -226,6 +650,9 @@ static int jtag_vpi_tms_seq(const uint8_t *bits, int nb_bits)
 	struct vpi_cmd vpi;
 	int nb_bytes;
 
+	if (batch.active)
+		return jtag_vpi_batch_add_op(VPI_OP_TMS_SEQ, bits, NULL, nb_bits);
+
 	memset(&vpi, 0, sizeof(struct vpi_cmd));
 	nb_bytes = DIV_ROUND_UP(nb_bits, 8);
 
@@ -294,6 +721,10 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
 	struct vpi_cmd vpi;
 	int nb_bytes = DIV_ROUND_UP(nb_bits, 8);
 
+	if (batch.active)
+		return jtag_vpi_batch_add_op(tap_shift ? VPI_OP_SCAN_FLIP_TMS : VPI_OP_SCAN,
+				bits, bits, nb_bits);
+
 	memset(&vpi, 0, sizeof(struct vpi_cmd));
 
 	vpi.cmd = tap_shift ? CMD_SCAN_CHAIN_FLIP_TMS : CMD_SCAN_CHAIN;
@@ -337,7 +768,11 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
  */
 static int jtag_vpi_queue_tdi(uint8_t *bits, int nb_bits, int tap_shift)
 {
-	int nb_xfer = DIV_ROUND_UP(nb_bits, XFERT_MAX_SIZE * 8);
+	int xfer_max_size = XFERT_MAX_SIZE;
+	if (batch.active)
+		xfer_max_size = batch.frame_size - VPI_BATCH_HDR_SIZE - VPI_OP_HDR_SIZE;
+
+	int nb_xfer = DIV_ROUND_UP(nb_bits, xfer_max_size * 8);
 	int retval;
 
 	while (nb_xfer) {
@@ -346,12 +781,12 @@ static int jtag_vpi_queue_tdi(uint8_t *bits, int nb_bits, int tap_shift)
 			if (retval != ERROR_OK)
 				return retval;
 		} else {
-			retval = jtag_vpi_queue_tdi_xfer(bits, XFERT_MAX_SIZE * 8, NO_TAP_SHIFT);
+			retval = jtag_vpi_queue_tdi_xfer(bits, xfer_max_size * 8, NO_TAP_SHIFT);
 			if (retval != ERROR_OK)
 				return retval;
-			nb_bits -= XFERT_MAX_SIZE * 8;
+			nb_bits -= xfer_max_size * 8;
 			if (bits)
-				bits += XFERT_MAX_SIZE;
+				bits += xfer_max_size;
 		}
 
 		nb_xfer--;
@@ -425,11 +860,20 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
+	if (batch.active) {
+		/* the captured bits arrive with a later frame */
+		retval = jtag_vpi_batch_add_scan(cmd, buf);
+		if (retval != ERROR_OK) {
+			free(buf);
+			return retval;
+		}
+	} else {
+		retval = jtag_read_buffer(buf, cmd);
+		if (retval != ERROR_OK)
+			return retval;
 
-	free(buf);
+		free(buf);
+	}
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
@@ -508,6 +952,9 @@ static int jtag_vpi_execute_queue(void)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
+			/* the simulator has to catch up before we sleep */
+			if (batch.active)
+				retval = jtag_vpi_batch_flush();
 			jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
@@ -521,6 +968,9 @@ static int jtag_vpi_execute_queue(void)
 		}
 	}
 
+	if (batch.active)
+		retval = jtag_vpi_batch_complete(retval);
+
 	return retval;
 }
 
@@ -564,6 +1014,9 @@ static int jtag_vpi_init(void)
 
 	LOG_INFO("jtag_vpi: Connection to %s : %u successful", server_address, server_port);
 
+	if (batch_requested)
+		return jtag_vpi_negotiate_batch();
+
 	return ERROR_OK;
 }
 
@@ -587,6 +1040,7 @@ static int jtag_vpi_quit(void)
 		LOG_WARNING("jtag_vpi: could not close jtag_vpi client socket");
 		log_socket_error("jtag_vpi");
 	}
+	jtag_vpi_batch_free();
 	free(server_address);
 	return ERROR_OK;
 }
@@ -630,6 +1084,32 @@ COMMAND_HANDLER(jtag_vpi_stop_sim_on_exit_handler)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_batch_handler)
+{
+	if (CMD_ARGC < 1 || CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], batch_requested);
+
+	if (CMD_ARGC > 1) {
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], batch_frame_size);
+		if (batch_frame_size < MIN_BATCH_FRAME_SIZE) {
+			command_print(CMD, "frame size must be at least %d bytes", MIN_BATCH_FRAME_SIZE);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	if (CMD_ARGC > 2) {
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], batch_window);
+		if (batch_window == 0) {
+			command_print(CMD, "at least one frame must be allowed in flight");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 	{
 		.name = "set_port",
@@ -653,6 +1133,15 @@ static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 			"before OpenOCD exits (default: off)",
 		.usage = "<on|off>",
 	},
+	{
+		.name = "batch",
+		.handler = &jtag_vpi_batch_handler,
+		.mode = COMMAND_CONFIG,
+		.help = "Negotiate the batched protocol extension with the server, "
+			"packing the commands of a queue into frames kept in flight "
+			"(default: off, 65536 bytes, 4 frames)",
+		.usage = "<on|off> [max_frame_bytes [max_frames_in_flight]]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -22,9 +22,22 @@
 /* arbitrary limit on host name length: */
 #define REMOTE_BITBANG_HOST_MAX 255
 
+/* Block mode extension, see doc/manual/jtag/drivers/remote_bitbang.txt */
+#define REMOTE_BITBANG_BLOCK_VERSION	1
+#define REMOTE_BITBANG_BLOCK_TIMEOUT_MS	1000
+#define REMOTE_BITBANG_BLOCK_REPLY_SIZE	6
+
+#define REMOTE_BITBANG_SHIFT_TDI	0x01
+#define REMOTE_BITBANG_SHIFT_TDO	0x02
+#define REMOTE_BITBANG_SHIFT_TMS_LAST	0x04
+
 static char *remote_bitbang_host;
 static char *remote_bitbang_port;
 
+static bool remote_bitbang_block_requested;
+/* maximum number of bits per packet, 0 when block mode is not in use */
+static uint32_t remote_bitbang_block_max_bits;
+
 static int remote_bitbang_fd;
 static uint8_t remote_bitbang_send_buf[512];
 static unsigned int remote_bitbang_send_buf_used;
@@ -148,6 +161,60 @@ static int remote_bitbang_queue(int c, flush_bool_t flush)
 	return ERROR_OK;
 }
 
+static int remote_bitbang_queue_buf(const uint8_t *data, size_t len)
+{
+	while (len > 0) {
+		size_t chunk = MIN(len, ARRAY_SIZE(remote_bitbang_send_buf) -
+				remote_bitbang_send_buf_used);
+		memcpy(remote_bitbang_send_buf + remote_bitbang_send_buf_used, data, chunk);
+		remote_bitbang_send_buf_used += chunk;
+		data += chunk;
+		len -= chunk;
+		if (remote_bitbang_send_buf_used == ARRAY_SIZE(remote_bitbang_send_buf) &&
+				remote_bitbang_flush() != ERROR_OK)
+			return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+/* Flush the send buffer and block until 'len' reply bytes arrived. */
+static int remote_bitbang_recv(uint8_t *data, size_t len)
+{
+	if (remote_bitbang_flush() != ERROR_OK)
+		return ERROR_FAIL;
+
+	/* no 'R' is sent in block mode, but drain anything already buffered */
+	while (len > 0 && !remote_bitbang_recv_buf_empty()) {
+		*data++ = remote_bitbang_recv_buf[remote_bitbang_recv_buf_start];
+		remote_bitbang_recv_buf_start =
+			(remote_bitbang_recv_buf_start + 1) % sizeof(remote_bitbang_recv_buf);
+		len--;
+	}
+
+	socket_block(remote_bitbang_fd);
+	while (len > 0) {
+		ssize_t count = read_socket(remote_bitbang_fd, data, len);
+		if (count == 0) {
+			LOG_ERROR("remote_bitbang: connection closed by remote end");
+			socket_nonblock(remote_bitbang_fd);
+			return ERROR_FAIL;
+		} else if (count < 0) {
+#ifndef _WIN32
+			if (errno == EINTR)
+				continue;
+#endif
+			log_socket_error("remote_bitbang_recv");
+			socket_nonblock(remote_bitbang_fd);
+			return ERROR_FAIL;
+		}
+		data += count;
+		len -= count;
+	}
+	socket_nonblock(remote_bitbang_fd);
+
+	return ERROR_OK;
+}
+
 static int remote_bitbang_quit(void)
 {
 	if (remote_bitbang_queue('Q', FLUSH_SEND_BUF) == ERROR_FAIL)
@@ -220,6 +287,85 @@ static int remote_bitbang_blink(int on)
 	return remote_bitbang_queue(c, FLUSH_SEND_BUF);
 }
 
+/* Chunks are kept byte aligned so TDI/TDO can be copied without shifting. */
+static uint32_t remote_bitbang_block_chunk_bits(unsigned int num_bits)
+{
+	return MIN(num_bits, remote_bitbang_block_max_bits & ~7U);
+}
+
+static int remote_bitbang_block_shift(const uint8_t *out, uint8_t *in,
+		unsigned int num_bits, bool tms_last)
+{
+	while (num_bits > 0) {
+		uint32_t chunk = remote_bitbang_block_chunk_bits(num_bits);
+		unsigned int nbytes = DIV_ROUND_UP(chunk, 8);
+		uint8_t hdr[7];
+
+		hdr[0] = 'P';
+		hdr[1] = 'S';
+		hdr[2] = (out ? REMOTE_BITBANG_SHIFT_TDI : 0) |
+			(in ? REMOTE_BITBANG_SHIFT_TDO : 0) |
+			((tms_last && chunk == num_bits) ? REMOTE_BITBANG_SHIFT_TMS_LAST : 0);
+		h_u32_to_le(hdr + 3, chunk);
+
+		if (remote_bitbang_queue_buf(hdr, sizeof(hdr)) != ERROR_OK)
+			return ERROR_FAIL;
+		if (out) {
+			if (remote_bitbang_queue_buf(out, nbytes) != ERROR_OK)
+				return ERROR_FAIL;
+			out += nbytes;
+		}
+		/* out and in may alias: the TDI bytes are already queued */
+		if (in) {
+			if (remote_bitbang_recv(in, nbytes) != ERROR_OK)
+				return ERROR_FAIL;
+			in += nbytes;
+		}
+
+		num_bits -= chunk;
+	}
+
+	return ERROR_OK;
+}
+
+static int remote_bitbang_block_tms_seq(const uint8_t *bits, unsigned int offset,
+		unsigned int num_bits)
+{
+	do {
+		uint32_t chunk = remote_bitbang_block_chunk_bits(num_bits);
+		uint8_t hdr[6];
+		uint8_t tms[64];
+
+		chunk = MIN(chunk, sizeof(tms) * 8);
+		hdr[0] = 'P';
+		hdr[1] = 'T';
+		h_u32_to_le(hdr + 2, chunk);
+		buf_set_buf(bits, offset, tms, 0, chunk);
+
+		if (remote_bitbang_queue_buf(hdr, sizeof(hdr)) != ERROR_OK)
+			return ERROR_FAIL;
+		if (remote_bitbang_queue_buf(tms, DIV_ROUND_UP(chunk, 8)) != ERROR_OK)
+			return ERROR_FAIL;
+
+		offset += chunk;
+		num_bits -= chunk;
+	} while (num_bits > 0);
+
+	return ERROR_OK;
+}
+
+static int remote_bitbang_block_clocks(unsigned int num_cycles, int tms)
+{
+	uint8_t pkt[7];
+
+	pkt[0] = 'P';
+	pkt[1] = 'C';
+	pkt[2] = tms ? 1 : 0;
+	h_u32_to_le(pkt + 3, num_cycles);
+
+	return remote_bitbang_queue_buf(pkt, sizeof(pkt));
+}
+
 static struct bitbang_interface remote_bitbang_bitbang = {
 	.buf_size = sizeof(remote_bitbang_recv_buf) - 1,
 	.sample = &remote_bitbang_sample,
@@ -305,6 +451,50 @@ static int remote_bitbang_init_unix(void)
 	return fd;
 }
 
+/* Offer the block mode extension, servers that do not answer keep the
+ * one character per TCK edge protocol. */
+static int remote_bitbang_negotiate_block_mode(void)
+{
+	uint8_t reply[REMOTE_BITBANG_BLOCK_REPLY_SIZE];
+
+	remote_bitbang_block_max_bits = 0;
+	remote_bitbang_bitbang.shift = NULL;
+	remote_bitbang_bitbang.tms_seq = NULL;
+	remote_bitbang_bitbang.clocks = NULL;
+
+	if (remote_bitbang_queue('X', FLUSH_SEND_BUF) != ERROR_OK)
+		return ERROR_FAIL;
+
+	fd_set read_fds;
+	struct timeval tv;
+	FD_ZERO(&read_fds);
+	FD_SET(remote_bitbang_fd, &read_fds);
+	tv.tv_sec = REMOTE_BITBANG_BLOCK_TIMEOUT_MS / 1000;
+	tv.tv_usec = (REMOTE_BITBANG_BLOCK_TIMEOUT_MS % 1000) * 1000;
+	if (socket_select(remote_bitbang_fd + 1, &read_fds, NULL, NULL, &tv) <= 0) {
+		LOG_INFO("remote_bitbang: server does not support block mode");
+		return ERROR_OK;
+	}
+
+	if (remote_bitbang_recv(reply, sizeof(reply)) != ERROR_OK)
+		return ERROR_FAIL;
+
+	uint32_t max_bits = le_to_h_u32(reply + 2);
+	if (reply[0] != 'X' || reply[1] < REMOTE_BITBANG_BLOCK_VERSION || max_bits < 8) {
+		LOG_ERROR("remote_bitbang: invalid block mode reply");
+		return ERROR_FAIL;
+	}
+
+	remote_bitbang_block_max_bits = max_bits;
+	remote_bitbang_bitbang.shift = &remote_bitbang_block_shift;
+	remote_bitbang_bitbang.tms_seq = &remote_bitbang_block_tms_seq;
+	remote_bitbang_bitbang.clocks = &remote_bitbang_block_clocks;
+
+	LOG_INFO("remote_bitbang: using block mode, up to %" PRIu32 " bits per packet",
+		max_bits);
+	return ERROR_OK;
+}
+
 static int remote_bitbang_init(void)
 {
 	bitbang_interface = &remote_bitbang_bitbang;
@@ -323,6 +513,10 @@ static int remote_bitbang_init(void)
 
 	socket_nonblock(remote_bitbang_fd);
 
+	if (remote_bitbang_block_requested &&
+			remote_bitbang_negotiate_block_mode() != ERROR_OK)
+		return ERROR_FAIL;
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -349,6 +543,15 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_host_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_block_mode_command)
+{
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], remote_bitbang_block_requested);
+		return ERROR_OK;
+	}
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
 static const struct command_registration remote_bitbang_subcommand_handlers[] = {
 	{
 		.name = "port",
@@ -366,6 +569,14 @@ static const struct command_registration remote_bitbang_subcommand_handlers[] =
 			"  if port is 0 or unset, this is the name of the unix socket to use.",
 		.usage = "host_name",
 	},
+	{
+		.name = "block_mode",
+		.handler = remote_bitbang_handle_remote_bitbang_block_mode_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Offer the binary block mode extension to the remote jtag.\n"
+			"  Whole scans, TMS sequences and clock runs are then sent as packets.",
+		.usage = "(enable|disable)",
+	},
 	COMMAND_REGISTRATION_DONE,
 };
 
@@ -396,6 +607,7 @@ static int remote_bitbang_execute_queue(void)
 }
 
 static struct jtag_interface remote_bitbang_interface = {
+	.supported = DEBUG_CAP_FLAT_STREAM,
 	.execute_queue = &remote_bitbang_execute_queue,
 };
 
@@ -185,6 +185,11 @@ struct jtag_interface {
 	 */
 	unsigned supported;
 #define DEBUG_CAP_TMS_SEQ	(1 << 0)
+/**
+ * The driver clocks JTAG_TMS commands of any length and follows the TAP
+ * state through them, so state moves may be flattened into TMS sequences.
+ */
+#define DEBUG_CAP_FLAT_STREAM	(1 << 1)
 
 	/**
 	 * Execute queued commands.
@@ -253,6 +253,11 @@ void jtag_set_verify_capture_ir(bool enable);
 /** @returns True if IR scan verification will be performed. */
 bool jtag_will_verify_capture_ir(void);
 
+/** Enable or disable rewriting of the command queue before it is executed. */
+void jtag_set_queue_optimize(bool enable);
+/** @returns True if the command queue is optimized before execution. */
+bool jtag_will_optimize_queue(void);
+
 /** Set ms to sleep after jtag_execute_queue() flushes queue. Debug purposes. */
 void jtag_set_flush_queue_sleep(int ms);
 
@@ -215,6 +215,55 @@ COMMAND_HANDLER(handle_jtag_flush_count)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_jtag_queue_stats)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		jtag_command_queue_reset_stats();
+		return ERROR_OK;
+	}
+
+	struct jtag_command_queue_stats stats;
+	jtag_command_queue_get_stats(&stats);
+
+	command_print(CMD, "flushes:         %" PRIu64, stats.flushes);
+	command_print(CMD, "bytes queued:    %" PRIu64, stats.bytes_queued);
+	command_print(CMD, "peak pages:      %u", stats.peak_pages);
+	command_print(CMD, "retained pages:  %u", stats.retained_pages);
+	command_print(CMD, "pages allocated: %" PRIu64, stats.pages_allocated);
+	command_print(CMD, "pages recycled:  %" PRIu64, stats.pages_recycled);
+	command_print(CMD, "pages trimmed:   %" PRIu64, stats.pages_trimmed);
+	command_print(CMD, "clones avoided:  %" PRIu64, stats.clones_avoided);
+	command_print(CMD, "commands removed:   %" PRIu64, stats.commands_removed);
+	command_print(CMD, "commands merged:    %" PRIu64, stats.commands_merged);
+	command_print(CMD, "commands flattened: %" PRIu64, stats.commands_flattened);
+	command_print(CMD, "IR scans dropped:   %" PRIu64, stats.ir_scans_dropped);
+	command_print(CMD, "TCK cycles saved:   %" PRIu64, stats.bits_saved);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_queue_optimize)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_set_queue_optimize(enable);
+	}
+
+	const char *status = jtag_will_optimize_queue() ? "enabled" : "disabled";
+	command_print(CMD, "JTAG queue optimization is %s", status);
+
+	return ERROR_OK;
+}
+
 /* REVISIT Just what about these should "move" ... ?
  * These registrations, into the main JTAG table?
  *
@@ -801,6 +850,21 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 		.help = "Returns list of all JTAG tap names.",
 		.usage = "",
 	},
+	{
+		.name = "queue_optimize",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_optimize,
+		.help = "Display or assign flag controlling whether redundant "
+			"commands are removed from the JTAG queue before execution.",
+		.usage = "['enable'|'disable']",
+	},
+	{
+		.name = "queue_stats",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_stats,
+		.help = "Show or reset the JTAG command queue allocator statistics.",
+		.usage = "['reset']",
+	},
 	{
 		.chain = jtag_command_handlers_to_move,
 	},
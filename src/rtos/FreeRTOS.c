@@ -103,6 +103,7 @@ enum freertos_symbol_values {
 	FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS = 9,
 	FREERTOS_VAL_UX_TOP_USED_PRIORITY = 10,
 	FREERTOS_VAL_X_SCHEDULER_RUNNING = 11,
+	FREERTOS_VAL_UX_TASK_NUMBER = 12,
 };
 
 struct symbols {
@@ -123,18 +124,180 @@ static const struct symbols freertos_symbol_list[] = {
 	{ "uxCurrentNumberOfTasks", false },
 	{ "uxTopUsedPriority", true }, /* Unavailable since v7.5.3 */
 	{ "xSchedulerRunning", false },
+	{ "uxTaskNumber", true }, /* Static, not always visible */
 	{ NULL, false }
 };
 
-/* TODO: */
-/* this is not safe for little endian yet */
-/* may be problems reading if sizes are not 32 bit long integers. */
-/* test mallocs for failure */
+#define FREERTOS_THREAD_NAME_STR_SIZE (200)
+
+static int freertos_add_thread(struct rtos *rtos, const struct freertos_params *param,
+		struct rtos_threadlist_diff *diff, threadid_t threadid)
+{
+	struct thread_detail *detail = &rtos->thread_details[rtos->thread_count];
+
+	detail->threadid = threadid;
+	detail->exists = true;
+	detail->extra_info_str = NULL;
+
+	/* Names are set when a task is created, so the name of a known task
+	 * does not have to be read again */
+	detail->thread_name_str = rtos_threadlist_diff_take_name(diff, threadid);
+	if (!detail->thread_name_str) {
+		char tmp_str[FREERTOS_THREAD_NAME_STR_SIZE];
+
+		int retval = target_read_buffer(rtos->target,
+				threadid + param->thread_name_offset,
+				FREERTOS_THREAD_NAME_STR_SIZE,
+				(uint8_t *)&tmp_str);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Error reading thread name in FreeRTOS thread list");
+			return retval;
+		}
+		tmp_str[FREERTOS_THREAD_NAME_STR_SIZE - 1] = '\x00';
+		LOG_DEBUG("FreeRTOS: Read Thread Name at 0x%" PRIx64 ", value '%s'",
+				threadid + param->thread_name_offset, tmp_str);
+
+		if (tmp_str[0] == '\x00')
+			strcpy(tmp_str, "No Name");
+
+		detail->thread_name_str = strdup(tmp_str);
+		if (!detail->thread_name_str) {
+			LOG_ERROR("Error allocating memory for thread name");
+			return ERROR_FAIL;
+		}
+	}
+
+	if (threadid == rtos->current_thread) {
+		detail->extra_info_str = strdup("State: Running");
+		if (!detail->extra_info_str) {
+			free(detail->thread_name_str);
+			LOG_ERROR("Error allocating memory for thread state");
+			return ERROR_FAIL;
+		}
+	}
+
+	rtos->thread_count++;
+	return ERROR_OK;
+}
+
+/* Walk one task list, given the header read from the target */
+static int freertos_walk_list(struct rtos *rtos, const struct freertos_params *param,
+		struct rtos_threadlist_diff *diff, const uint8_t *list_header,
+		unsigned int thread_list_size)
+{
+	uint32_t list_thread_count = target_buffer_get_u32(rtos->target, list_header);
+	if (list_thread_count == 0)
+		return ERROR_OK;
+
+	/* The next and content pointers of an item are read together */
+	uint8_t item[32];
+	unsigned int item_size = MAX(param->list_elem_next_offset,
+			param->list_elem_content_offset) + param->pointer_width;
+	assert(item_size <= sizeof(item));
+
+	uint32_t prev_list_elem_ptr = -1;
+	uint32_t list_elem_ptr = target_buffer_get_u32(rtos->target,
+			list_header + param->list_next_offset);
+
+	while ((list_thread_count > 0) && (list_elem_ptr != 0) &&
+			(list_elem_ptr != prev_list_elem_ptr) &&
+			((unsigned int)rtos->thread_count < thread_list_size)) {
+		int retval = target_read_buffer(rtos->target, list_elem_ptr, item_size, item);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Error reading thread list item in FreeRTOS thread list");
+			return retval;
+		}
+
+		threadid_t threadid = target_buffer_get_u32(rtos->target,
+				item + param->list_elem_content_offset);
+		LOG_DEBUG("FreeRTOS: Read Thread ID at 0x%" PRIx32 ", value 0x%" PRIx64,
+				list_elem_ptr + param->list_elem_content_offset, threadid);
+
+		retval = freertos_add_thread(rtos, param, diff, threadid);
+		if (retval != ERROR_OK)
+			return retval;
+
+		list_thread_count--;
+		prev_list_elem_ptr = list_elem_ptr;
+		list_elem_ptr = target_buffer_get_u32(rtos->target,
+				item + param->list_elem_next_offset);
+		LOG_DEBUG("FreeRTOS: Read next thread location at 0x%" PRIx32 ", value 0x%" PRIx32,
+				prev_list_elem_ptr + param->list_elem_next_offset, list_elem_ptr);
+	}
+
+	return ERROR_OK;
+}
+
+static int freertos_read_lists(struct rtos *rtos, const struct freertos_params *param,
+		struct rtos_threadlist_diff *diff, uint32_t top_used_priority,
+		unsigned int thread_list_size)
+{
+	/* uxTopUsedPriority was defined as configMAX_PRIORITIES - 1
+	 * in old FreeRTOS versions (before V7.5.3)
+	 * Use contrib/rtos-helpers/FreeRTOS-openocd.c to get compatible symbol
+	 * in newer FreeRTOS versions.
+	 * Here we restore the original configMAX_PRIORITIES value */
+	unsigned int config_max_priorities = top_used_priority + 1;
+
+	static const enum freertos_symbol_values other_lists[] = {
+		FREERTOS_VAL_X_DELAYED_TASK_LIST1,
+		FREERTOS_VAL_X_DELAYED_TASK_LIST2,
+		FREERTOS_VAL_X_PENDING_READY_LIST,
+		FREERTOS_VAL_X_SUSPENDED_TASK_LIST,
+		FREERTOS_VAL_X_TASKS_WAITING_TERMINATION,
+	};
+
+	/* The ready lists form an array, fetch all their headers at once */
+	uint8_t *headers = malloc(param->list_width *
+			(config_max_priorities + ARRAY_SIZE(other_lists)));
+	if (!headers) {
+		LOG_ERROR("Error allocating memory for %u priorities", config_max_priorities);
+		return ERROR_FAIL;
+	}
+
+	int retval = target_read_buffer(rtos->target,
+			rtos->symbols[FREERTOS_VAL_PX_READY_TASKS_LISTS].address,
+			param->list_width * config_max_priorities, headers);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading FreeRTOS ready lists");
+		goto out;
+	}
+
+	unsigned int num_lists = config_max_priorities;
+	for (unsigned int i = 0; i < ARRAY_SIZE(other_lists); i++) {
+		symbol_address_t address = rtos->symbols[other_lists[i]].address;
+		uint8_t *header = headers + num_lists++ * param->list_width;
+
+		if (address == 0) {
+			memset(header, 0, param->list_width);
+			continue;
+		}
+
+		retval = target_read_buffer(rtos->target, address, param->list_width, header);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("Error reading FreeRTOS thread list at 0x%" PRIx64, address);
+			goto out;
+		}
+	}
+
+	for (unsigned int i = 0; i < num_lists; i++) {
+		LOG_DEBUG("FreeRTOS: Read thread count for list %u, value %" PRIu32,
+				i, target_buffer_get_u32(rtos->target, headers + i * param->list_width));
+
+		retval = freertos_walk_list(rtos, param, diff,
+				headers + i * param->list_width, thread_list_size);
+		if (retval != ERROR_OK)
+			break;
+	}
+
+out:
+	free(headers);
+	return retval;
+}
 
 static int freertos_update_threads(struct rtos *rtos)
 {
 	int retval;
-	unsigned int tasks_found = 0;
 	const struct freertos_params *param;
 
 	if (!rtos->rtos_specific_params)
@@ -152,238 +315,93 @@ static int freertos_update_threads(struct rtos *rtos)
 		return -2;
 	}
 
-	uint32_t thread_list_size = 0;
-	retval = target_read_u32(rtos->target,
-			rtos->symbols[FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS].address,
-			&thread_list_size);
-	LOG_DEBUG("FreeRTOS: Read uxCurrentNumberOfTasks at 0x%" PRIx64 ", value %" PRIu32,
-										rtos->symbols[FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS].address,
-										thread_list_size);
-
+	/* The scheduler variables are neighbours in tasks.c, read them together */
+	static const enum freertos_symbol_values state_symbols[] = {
+		FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS,
+		FREERTOS_VAL_PX_CURRENT_TCB,
+		FREERTOS_VAL_X_SCHEDULER_RUNNING,
+		FREERTOS_VAL_UX_TOP_USED_PRIORITY,
+		FREERTOS_VAL_UX_TASK_NUMBER,
+	};
+	symbol_address_t addresses[ARRAY_SIZE(state_symbols)];
+	uint32_t values[ARRAY_SIZE(state_symbols)];
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(state_symbols); i++)
+		addresses[i] = rtos->symbols[state_symbols[i]].address;
+
+	retval = rtos_read_u32_symbols(rtos->target, addresses, ARRAY_SIZE(state_symbols), values);
 	if (retval != ERROR_OK) {
-		LOG_ERROR("Could not read FreeRTOS thread count from target");
+		LOG_ERROR("Could not read FreeRTOS scheduler state from target");
 		return retval;
 	}
 
-	/* wipe out previous thread details if any */
-	rtos_free_threadlist(rtos);
+	uint32_t thread_list_size = values[0];
+	uint32_t current_tcb = values[1];
+	uint32_t scheduler_running = values[2];
+	uint32_t top_used_priority = values[3];
+	uint32_t task_number = values[4];
+	LOG_DEBUG("FreeRTOS: uxCurrentNumberOfTasks %" PRIu32 ", pxCurrentTCB 0x%" PRIx32
+			", xSchedulerRunning %" PRIu32 ", uxTopUsedPriority %" PRIu32 ", uxTaskNumber %" PRIu32,
+			thread_list_size, current_tcb, scheduler_running, top_used_priority, task_number);
 
-	/* read the current thread */
-	uint32_t pointer_casts_are_bad;
-	retval = target_read_u32(rtos->target,
-			rtos->symbols[FREERTOS_VAL_PX_CURRENT_TCB].address,
-			&pointer_casts_are_bad);
-	if (retval != ERROR_OK) {
-		LOG_ERROR("Error reading current thread in FreeRTOS thread list");
-		return retval;
-	}
-	rtos->current_thread = pointer_casts_are_bad;
-	LOG_DEBUG("FreeRTOS: Read pxCurrentTCB at 0x%" PRIx64 ", value 0x%" PRIx64,
-										rtos->symbols[FREERTOS_VAL_PX_CURRENT_TCB].address,
-										rtos->current_thread);
+	/* Keep what is known about the previous threads, unless tasks were
+	 * created since, which may have reused the memory of deleted ones */
+	struct rtos_threadlist_diff diff;
+	rtos_threadlist_diff_begin(rtos, &diff, task_number,
+			rtos->symbols[FREERTOS_VAL_UX_TASK_NUMBER].address != 0);
 
-	/* read scheduler running */
-	uint32_t scheduler_running;
-	retval = target_read_u32(rtos->target,
-			rtos->symbols[FREERTOS_VAL_X_SCHEDULER_RUNNING].address,
-			&scheduler_running);
-	if (retval != ERROR_OK) {
-		LOG_ERROR("Error reading FreeRTOS scheduler state");
-		return retval;
-	}
-	LOG_DEBUG("FreeRTOS: Read xSchedulerRunning at 0x%" PRIx64 ", value 0x%" PRIx32,
-										rtos->symbols[FREERTOS_VAL_X_SCHEDULER_RUNNING].address,
-										scheduler_running);
+	rtos->current_thread = current_tcb;
 
 	if ((thread_list_size  == 0) || (rtos->current_thread == 0) || (scheduler_running != 1)) {
 		/* Either : No RTOS threads - there is always at least the current execution though */
 		/* OR     : No current thread - all threads suspended - show the current execution
 		 * of idling */
-		char tmp_str[] = "Current Execution";
 		thread_list_size++;
-		tasks_found++;
 		rtos->thread_details = malloc(
 				sizeof(struct thread_detail) * thread_list_size);
 		if (!rtos->thread_details) {
 			LOG_ERROR("Error allocating memory for %d threads", thread_list_size);
-			return ERROR_FAIL;
+			retval = ERROR_FAIL;
+			goto out;
 		}
 		rtos->current_thread = 1;
 		rtos->thread_details->threadid = rtos->current_thread;
 		rtos->thread_details->exists = true;
 		rtos->thread_details->extra_info_str = NULL;
-		rtos->thread_details->thread_name_str = malloc(sizeof(tmp_str));
-		strcpy(rtos->thread_details->thread_name_str, tmp_str);
+		rtos->thread_details->thread_name_str = strdup("Current Execution");
+		rtos->thread_count = 1;
 
-		if (thread_list_size == 1) {
-			rtos->thread_count = 1;
-			return ERROR_OK;
-		}
+		if (thread_list_size == 1)
+			goto out;
 	} else {
 		/* create space for new thread details */
 		rtos->thread_details = malloc(
 				sizeof(struct thread_detail) * thread_list_size);
 		if (!rtos->thread_details) {
 			LOG_ERROR("Error allocating memory for %d threads", thread_list_size);
-			return ERROR_FAIL;
+			retval = ERROR_FAIL;
+			goto out;
 		}
 	}
 
 	/* Find out how many lists are needed to be read from pxReadyTasksLists, */
 	if (rtos->symbols[FREERTOS_VAL_UX_TOP_USED_PRIORITY].address == 0) {
 		LOG_ERROR("FreeRTOS: uxTopUsedPriority is not defined, consult the OpenOCD manual for a work-around");
-		return ERROR_FAIL;
+		retval = ERROR_FAIL;
+		goto out;
 	}
-	uint32_t top_used_priority = 0;
-	retval = target_read_u32(rtos->target,
-			rtos->symbols[FREERTOS_VAL_UX_TOP_USED_PRIORITY].address,
-			&top_used_priority);
-	if (retval != ERROR_OK)
-		return retval;
-	LOG_DEBUG("FreeRTOS: Read uxTopUsedPriority at 0x%" PRIx64 ", value %" PRIu32,
-										rtos->symbols[FREERTOS_VAL_UX_TOP_USED_PRIORITY].address,
-										top_used_priority);
 	if (top_used_priority > FREERTOS_MAX_PRIORITIES) {
 		LOG_ERROR("FreeRTOS top used priority is unreasonably big, not proceeding: %" PRIu32,
 			top_used_priority);
-		return ERROR_FAIL;
-	}
-
-	/* uxTopUsedPriority was defined as configMAX_PRIORITIES - 1
-	 * in old FreeRTOS versions (before V7.5.3)
-	 * Use contrib/rtos-helpers/FreeRTOS-openocd.c to get compatible symbol
-	 * in newer FreeRTOS versions.
-	 * Here we restore the original configMAX_PRIORITIES value */
-	unsigned int config_max_priorities = top_used_priority + 1;
-
-	symbol_address_t *list_of_lists =
-		malloc(sizeof(symbol_address_t) * (config_max_priorities + 5));
-	if (!list_of_lists) {
-		LOG_ERROR("Error allocating memory for %u priorities", config_max_priorities);
-		return ERROR_FAIL;
+		retval = ERROR_FAIL;
+		goto out;
 	}
 
-	unsigned int num_lists;
-	for (num_lists = 0; num_lists < config_max_priorities; num_lists++)
-		list_of_lists[num_lists] = rtos->symbols[FREERTOS_VAL_PX_READY_TASKS_LISTS].address +
-			num_lists * param->list_width;
-
-	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_DELAYED_TASK_LIST1].address;
-	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_DELAYED_TASK_LIST2].address;
-	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_PENDING_READY_LIST].address;
-	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_SUSPENDED_TASK_LIST].address;
-	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_TASKS_WAITING_TERMINATION].address;
-
-	for (unsigned int i = 0; i < num_lists; i++) {
-		if (list_of_lists[i] == 0)
-			continue;
+	retval = freertos_read_lists(rtos, param, &diff, top_used_priority, thread_list_size);
 
-		/* Read the number of threads in this list */
-		uint32_t list_thread_count = 0;
-		retval = target_read_u32(rtos->target,
-				list_of_lists[i],
-				&list_thread_count);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading number of threads in FreeRTOS thread list");
-			free(list_of_lists);
-			return retval;
-		}
-		LOG_DEBUG("FreeRTOS: Read thread count for list %u at 0x%" PRIx64 ", value %" PRIu32,
-										i, list_of_lists[i], list_thread_count);
-
-		if (list_thread_count == 0)
-			continue;
-
-		/* Read the location of first list item */
-		uint32_t prev_list_elem_ptr = -1;
-		uint32_t list_elem_ptr = 0;
-		retval = target_read_u32(rtos->target,
-				list_of_lists[i] + param->list_next_offset,
-				&list_elem_ptr);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-			free(list_of_lists);
-			return retval;
-		}
-		LOG_DEBUG("FreeRTOS: Read first item for list %u at 0x%" PRIx64 ", value 0x%" PRIx32,
-										i, list_of_lists[i] + param->list_next_offset, list_elem_ptr);
-
-		while ((list_thread_count > 0) && (list_elem_ptr != 0) &&
-				(list_elem_ptr != prev_list_elem_ptr) &&
-				(tasks_found < thread_list_size)) {
-			/* Get the location of the thread structure. */
-			retval = target_read_u32(rtos->target,
-					list_elem_ptr + param->list_elem_content_offset,
-					&pointer_casts_are_bad);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading thread list item object in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			rtos->thread_details[tasks_found].threadid = pointer_casts_are_bad;
-			LOG_DEBUG("FreeRTOS: Read Thread ID at 0x%" PRIx32 ", value 0x%" PRIx64,
-										list_elem_ptr + param->list_elem_content_offset,
-										rtos->thread_details[tasks_found].threadid);
-
-			/* get thread name */
-
-			#define FREERTOS_THREAD_NAME_STR_SIZE (200)
-			char tmp_str[FREERTOS_THREAD_NAME_STR_SIZE];
-
-			/* Read the thread name */
-			retval = target_read_buffer(rtos->target,
-					rtos->thread_details[tasks_found].threadid + param->thread_name_offset,
-					FREERTOS_THREAD_NAME_STR_SIZE,
-					(uint8_t *)&tmp_str);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			tmp_str[FREERTOS_THREAD_NAME_STR_SIZE-1] = '\x00';
-			LOG_DEBUG("FreeRTOS: Read Thread Name at 0x%" PRIx64 ", value '%s'",
-										rtos->thread_details[tasks_found].threadid + param->thread_name_offset,
-										tmp_str);
-
-			if (tmp_str[0] == '\x00')
-				strcpy(tmp_str, "No Name");
-
-			rtos->thread_details[tasks_found].thread_name_str =
-				malloc(strlen(tmp_str)+1);
-			strcpy(rtos->thread_details[tasks_found].thread_name_str, tmp_str);
-			rtos->thread_details[tasks_found].exists = true;
-
-			if (rtos->thread_details[tasks_found].threadid == rtos->current_thread) {
-				char running_str[] = "State: Running";
-				rtos->thread_details[tasks_found].extra_info_str = malloc(
-						sizeof(running_str));
-				strcpy(rtos->thread_details[tasks_found].extra_info_str,
-					running_str);
-			} else
-				rtos->thread_details[tasks_found].extra_info_str = NULL;
-
-			tasks_found++;
-			list_thread_count--;
-			rtos->thread_count = tasks_found;
-
-			prev_list_elem_ptr = list_elem_ptr;
-			list_elem_ptr = 0;
-			retval = target_read_u32(rtos->target,
-					prev_list_elem_ptr + param->list_elem_next_offset,
-					&list_elem_ptr);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading next thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			LOG_DEBUG("FreeRTOS: Read next thread location at 0x%" PRIx32 ", value 0x%" PRIx32,
-										prev_list_elem_ptr + param->list_elem_next_offset,
-										list_elem_ptr);
-		}
-	}
-
-	free(list_of_lists);
-	return 0;
+out:
+	rtos_threadlist_diff_end(&diff);
+	return retval;
 }
 
 static int freertos_get_thread_reg_list(struct rtos *rtos, int64_t thread_id,
@@ -691,17 +691,22 @@ int rtos_update_threads(struct target *target)
 	return ERROR_OK;
 }
 
+static void rtos_free_thread_details(struct thread_detail *thread_details,
+		int thread_count)
+{
+	for (int j = 0; j < thread_count; j++) {
+		free(thread_details[j].thread_name_str);
+		free(thread_details[j].extra_info_str);
+	}
+	free(thread_details);
+}
+
 void rtos_free_threadlist(struct rtos *rtos)
 {
-	if (rtos->thread_details) {
-		int j;
+	rtos->thread_list_generation_valid = false;
 
-		for (j = 0; j < rtos->thread_count; j++) {
-			struct thread_detail *current_thread = &rtos->thread_details[j];
-			free(current_thread->thread_name_str);
-			free(current_thread->extra_info_str);
-		}
-		free(rtos->thread_details);
+	if (rtos->thread_details) {
+		rtos_free_thread_details(rtos->thread_details, rtos->thread_count);
 		rtos->thread_details = NULL;
 		rtos->thread_count = 0;
 		rtos->current_threadid = -1;
@@ -709,6 +714,123 @@ void rtos_free_threadlist(struct rtos *rtos)
 	}
 }
 
+/**
+ * Start rebuilding the thread list of @a rtos. The previous list is moved
+ * into @a diff, which leaves @a rtos in the same state as
+ * rtos_free_threadlist().
+ *
+ * @a generation is an RTOS specific value that changes whenever a thread is
+ * created, e.g. a task counter. When it matches the value of the previous
+ * update, the details of threads found again can be taken from @a diff
+ * instead of being read from the target. Pass @a generation_valid false if
+ * the RTOS has no such value.
+ */
+void rtos_threadlist_diff_begin(struct rtos *rtos, struct rtos_threadlist_diff *diff,
+		uint64_t generation, bool generation_valid)
+{
+	diff->prev = rtos->thread_details;
+	diff->prev_count = rtos->thread_details ? rtos->thread_count : 0;
+	diff->hint = 0;
+	diff->keep_details = generation_valid && rtos->thread_list_generation_valid &&
+		rtos->thread_list_generation == generation;
+
+	rtos->thread_details = NULL;
+	rtos->thread_count = 0;
+	rtos->current_threadid = -1;
+	rtos->current_thread = 0;
+	rtos->thread_list_generation = generation;
+	rtos->thread_list_generation_valid = generation_valid;
+}
+
+/**
+ * Take the name of thread @a threadid from the previous thread list.
+ * @returns the name, now owned by the caller, or NULL if it has to be
+ * read from the target.
+ */
+char *rtos_threadlist_diff_take_name(struct rtos_threadlist_diff *diff,
+		threadid_t threadid)
+{
+	if (!diff->keep_details)
+		return NULL;
+
+	/* Threads are usually found in the same order as last time, so start
+	 * after the previous match. */
+	for (int n = 0; n < diff->prev_count; n++) {
+		int i = (diff->hint + n) % diff->prev_count;
+		struct thread_detail *detail = &diff->prev[i];
+
+		if (detail->threadid != threadid)
+			continue;
+
+		diff->hint = i + 1;
+		char *name = detail->thread_name_str;
+		detail->thread_name_str = NULL;
+		return name;
+	}
+
+	return NULL;
+}
+
+/** Release what is left of the previous thread list. */
+void rtos_threadlist_diff_end(struct rtos_threadlist_diff *diff)
+{
+	rtos_free_thread_details(diff->prev, diff->prev_count);
+	diff->prev = NULL;
+	diff->prev_count = 0;
+}
+
+/* Largest distance between RTOS variables that are still fetched with a
+ * single read. */
+#define RTOS_SYMBOL_SPAN_MAX	256
+
+/**
+ * Read 32 bit RTOS variables. Variables at address 0 are skipped and read
+ * as 0. When the variables are close to each other, as globals of the same
+ * source file usually are, they are fetched with a single block read.
+ */
+int rtos_read_u32_symbols(struct target *target, const symbol_address_t *addresses,
+		unsigned int count, uint32_t *values)
+{
+	symbol_address_t low = 0, high = 0;
+	bool found = false;
+
+	for (unsigned int i = 0; i < count; i++) {
+		values[i] = 0;
+		if (!addresses[i])
+			continue;
+		if (!found || addresses[i] < low)
+			low = addresses[i];
+		if (!found || addresses[i] > high)
+			high = addresses[i];
+		found = true;
+	}
+
+	if (!found)
+		return ERROR_OK;
+
+	if (high - low + 4 <= RTOS_SYMBOL_SPAN_MAX) {
+		uint8_t buffer[RTOS_SYMBOL_SPAN_MAX];
+		int retval = target_read_buffer(target, low, high - low + 4, buffer);
+		if (retval != ERROR_OK)
+			return retval;
+
+		for (unsigned int i = 0; i < count; i++)
+			if (addresses[i])
+				values[i] = target_buffer_get_u32(target, buffer + (addresses[i] - low));
+		return ERROR_OK;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (!addresses[i])
+			continue;
+		int retval = target_read_u32(target, addresses[i], &values[i]);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 int rtos_read_buffer(struct target *target, target_addr_t address,
 		uint32_t size, uint8_t *buffer)
 {
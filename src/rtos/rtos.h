@@ -45,11 +45,30 @@ struct rtos {
 	threadid_t current_thread;
 	struct thread_detail *thread_details;
 	int thread_count;
+	/* RTOS specific counter that changes whenever threads are created, used
+	 * to decide whether details of known threads can be kept across updates.
+	 * See rtos_threadlist_diff_begin(). */
+	uint64_t thread_list_generation;
+	bool thread_list_generation_valid;
 	int (*gdb_thread_packet)(struct connection *connection, char const *packet, int packet_size);
 	int (*gdb_target_for_threadid)(struct connection *connection, int64_t thread_id, struct target **p_target);
 	void *rtos_specific_params;
 };
 
+/**
+ * State of a thread list update that reuses the details of threads which
+ * were already known, instead of reading them again from the target.
+ */
+struct rtos_threadlist_diff {
+	/** Thread list of the previous update, owned by the diff. */
+	struct thread_detail *prev;
+	int prev_count;
+	/** Where to start looking for the next thread in @a prev. */
+	int hint;
+	/** Whether the details in @a prev are still valid. */
+	bool keep_details;
+};
+
 struct rtos_reg {
 	uint32_t number;
 	uint32_t size;
@@ -128,6 +147,13 @@ int rtos_get_gdb_reg(struct connection *connection, int reg_num);
 int rtos_get_gdb_reg_list(struct connection *connection);
 int rtos_update_threads(struct target *target);
 void rtos_free_threadlist(struct rtos *rtos);
+void rtos_threadlist_diff_begin(struct rtos *rtos, struct rtos_threadlist_diff *diff,
+		uint64_t generation, bool generation_valid);
+char *rtos_threadlist_diff_take_name(struct rtos_threadlist_diff *diff,
+		threadid_t threadid);
+void rtos_threadlist_diff_end(struct rtos_threadlist_diff *diff);
+int rtos_read_u32_symbols(struct target *target, const symbol_address_t *addresses,
+		unsigned int count, uint32_t *values);
 int rtos_smp_init(struct target *target);
 /*  function for handling symbol access */
 int rtos_qsymbol(struct connection *connection, char const *packet, int packet_size);
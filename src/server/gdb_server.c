@@ -95,6 +95,12 @@ struct gdb_connection {
 	char *thread_list;
 	/* flag to mask the output from gdb_log_callback() */
 	enum gdb_output_flag output_flag;
+	/* incoming packet, packet_size bytes plus null-termination */
+	char *packet_buffer;
+	unsigned int packet_size;
+	/* outgoing frame ('$', payload, '#', checksum) of in place encoded replies */
+	char *frame_buffer;
+	size_t frame_size;
 };
 
 #if 0
@@ -135,6 +141,12 @@ static int gdb_report_data_abort;
  * default. */
 static int gdb_report_register_access_error;
 
+/* maximum packet size advertised to gdb in qSupported, taken over by new
+ * connections. Large sizes let gdb read and write memory in fewer packets. */
+#define GDB_PACKET_SIZE_MIN 1024
+#define GDB_PACKET_SIZE_MAX (1024 * 1024)
+static unsigned int gdb_packet_size = GDB_BUFFER_SIZE;
+
 /* set if we are sending target descriptions to gdb
  * via qXfer:features:read packet */
 /* enabled by default */
@@ -392,12 +404,75 @@ static void gdb_log_outgoing_packet(struct connection *connection, char *packet_
 			checksum);
 }
 
+/**
+ * Wait for gdb to acknowledge the packet just sent.
+ * @param retry is set when gdb asks for the packet again.
+ */
+static int gdb_get_ack(struct connection *connection, bool *retry)
+{
+	int reply;
+	int retval;
+	struct gdb_connection *gdb_con = connection->priv;
+
+	*retry = false;
+
+	retval = gdb_get_char(connection, &reply);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (reply == '+') {
+		gdb_log_incoming_packet(connection, "+");
+		return ERROR_OK;
+	} else if (reply == '-') {
+		/* Stop sending output packets for now */
+		gdb_con->output_flag = GDB_OUTPUT_NO;
+		gdb_log_incoming_packet(connection, "-");
+		LOG_WARNING("negative reply, retrying");
+		*retry = true;
+		return ERROR_OK;
+	} else if (reply == 0x3) {
+		gdb_con->ctrl_c = true;
+		gdb_log_incoming_packet(connection, "<Ctrl-C>");
+		retval = gdb_get_char(connection, &reply);
+		if (retval != ERROR_OK)
+			return retval;
+		if (reply == '+') {
+			gdb_log_incoming_packet(connection, "+");
+			return ERROR_OK;
+		} else if (reply == '-') {
+			/* Stop sending output packets for now */
+			gdb_con->output_flag = GDB_OUTPUT_NO;
+			gdb_log_incoming_packet(connection, "-");
+			LOG_WARNING("negative reply, retrying");
+			*retry = true;
+			return ERROR_OK;
+		} else if (reply == '$') {
+			LOG_ERROR("GDB missing ack(1) - assumed good");
+			gdb_putback_char(connection, reply);
+			return ERROR_OK;
+		} else {
+			LOG_ERROR("unknown character(1) 0x%2.2x in reply, dropping connection", reply);
+			gdb_con->closed = true;
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+	} else if (reply == '$') {
+		LOG_ERROR("GDB missing ack(2) - assumed good");
+		gdb_putback_char(connection, reply);
+		return ERROR_OK;
+	}
+
+	LOG_ERROR("unknown character(2) 0x%2.2x in reply, dropping connection",
+		reply);
+	gdb_con->closed = true;
+	return ERROR_SERVER_REMOTE_CLOSED;
+}
+
 static int gdb_put_packet_inner(struct connection *connection,
 		char *buffer, int len)
 {
 	int i;
 	unsigned char my_checksum = 0;
-	int reply;
+	bool retry;
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
 
@@ -412,6 +487,7 @@ static int gdb_put_packet_inner(struct connection *connection,
 	 */
 	int gotdata;
 	for (;; ) {
+		int reply;
 		retval = check_pending(connection, 0, &gotdata);
 		if (retval != ERROR_OK)
 			return retval;
@@ -438,9 +514,11 @@ static int gdb_put_packet_inner(struct connection *connection,
 		local_buffer[0] = '$';
 		if ((size_t)len + 4 <= sizeof(local_buffer)) {
 			/* performance gain on smaller packets by only a single call to gdb_write() */
-			memcpy(local_buffer + 1, buffer, len++);
-			len += snprintf(local_buffer + len, sizeof(local_buffer) - len, "#%02x", my_checksum);
-			retval = gdb_write(connection, local_buffer, len);
+			memcpy(local_buffer + 1, buffer, len);
+			int frame_len = len + 1;
+			frame_len += snprintf(local_buffer + frame_len, sizeof(local_buffer) - frame_len,
+					"#%02x", my_checksum);
+			retval = gdb_write(connection, local_buffer, frame_len);
 			if (retval != ERROR_OK)
 				return retval;
 		} else {
@@ -461,51 +539,11 @@ static int gdb_put_packet_inner(struct connection *connection,
 		if (gdb_con->noack_mode)
 			break;
 
-		retval = gdb_get_char(connection, &reply);
+		retval = gdb_get_ack(connection, &retry);
 		if (retval != ERROR_OK)
 			return retval;
-
-		if (reply == '+') {
-			gdb_log_incoming_packet(connection, "+");
+		if (!retry)
 			break;
-		} else if (reply == '-') {
-			/* Stop sending output packets for now */
-			gdb_con->output_flag = GDB_OUTPUT_NO;
-			gdb_log_incoming_packet(connection, "-");
-			LOG_WARNING("negative reply, retrying");
-		} else if (reply == 0x3) {
-			gdb_con->ctrl_c = true;
-			gdb_log_incoming_packet(connection, "<Ctrl-C>");
-			retval = gdb_get_char(connection, &reply);
-			if (retval != ERROR_OK)
-				return retval;
-			if (reply == '+') {
-				gdb_log_incoming_packet(connection, "+");
-				break;
-			} else if (reply == '-') {
-				/* Stop sending output packets for now */
-				gdb_con->output_flag = GDB_OUTPUT_NO;
-				gdb_log_incoming_packet(connection, "-");
-				LOG_WARNING("negative reply, retrying");
-			} else if (reply == '$') {
-				LOG_ERROR("GDB missing ack(1) - assumed good");
-				gdb_putback_char(connection, reply);
-				return ERROR_OK;
-			} else {
-				LOG_ERROR("unknown character(1) 0x%2.2x in reply, dropping connection", reply);
-				gdb_con->closed = true;
-				return ERROR_SERVER_REMOTE_CLOSED;
-			}
-		} else if (reply == '$') {
-			LOG_ERROR("GDB missing ack(2) - assumed good");
-			gdb_putback_char(connection, reply);
-			return ERROR_OK;
-		} else {
-			LOG_ERROR("unknown character(2) 0x%2.2x in reply, dropping connection",
-				reply);
-			gdb_con->closed = true;
-			return ERROR_SERVER_REMOTE_CLOSED;
-		}
 	}
 	if (gdb_con->closed)
 		return ERROR_SERVER_REMOTE_CLOSED;
@@ -513,6 +551,59 @@ static int gdb_put_packet_inner(struct connection *connection,
 	return ERROR_OK;
 }
 
+/**
+ * Make sure the connection's frame buffer holds at least @a size bytes.
+ * The buffer is kept for the lifetime of the connection.
+ */
+static char *gdb_frame_reserve(struct gdb_connection *gdb_con, size_t size)
+{
+	if (gdb_con->frame_size < size) {
+		char *frame = realloc(gdb_con->frame_buffer, size);
+		if (!frame) {
+			LOG_ERROR("Out of memory");
+			return NULL;
+		}
+		gdb_con->frame_buffer = frame;
+		gdb_con->frame_size = size;
+	}
+
+	return gdb_con->frame_buffer;
+}
+
+/**
+ * Send a frame prepared in the connection's frame buffer: '$' followed by
+ * @a len bytes of payload. '#' and the checksum are appended here.
+ */
+static int gdb_put_frame(struct connection *connection, size_t len, unsigned char checksum)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	char *frame = gdb_con->frame_buffer;
+	bool retry;
+	int retval;
+
+	frame[0] = '$';
+	snprintf(frame + 1 + len, 4, "#%02x", checksum);
+
+	gdb_con->busy = true;
+	do {
+		gdb_log_outgoing_packet(connection, frame + 1, len, checksum);
+
+		retval = gdb_write(connection, frame, len + 4);
+		if (retval != ERROR_OK || gdb_con->noack_mode)
+			break;
+
+		retval = gdb_get_ack(connection, &retry);
+	} while (retval == ERROR_OK && retry);
+	gdb_con->busy = false;
+
+	kept_alive();
+
+	if (retval == ERROR_OK && gdb_con->closed)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	return retval;
+}
+
 int gdb_put_packet(struct connection *connection, char *buffer, int len)
 {
 	struct gdb_connection *gdb_con = connection->priv;
@@ -972,6 +1063,19 @@ static int gdb_new_connection(struct connection *connection)
 	int retval;
 	int initial_ack;
 
+	if (!gdb_connection)
+		return ERROR_FAIL;
+
+	gdb_connection->packet_size = gdb_packet_size;
+	gdb_connection->packet_buffer = malloc(gdb_packet_size + 1);
+	gdb_connection->frame_buffer = NULL;
+	gdb_connection->frame_size = 0;
+	if (!gdb_connection->packet_buffer) {
+		LOG_ERROR("Out of memory");
+		free(gdb_connection);
+		return ERROR_FAIL;
+	}
+
 	target = get_target_from_connection(connection);
 	connection->priv = gdb_connection;
 	connection->cmd_ctx->current_target = target;
@@ -1110,6 +1214,8 @@ static int gdb_connection_closed(struct connection *connection)
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, target);
 
+	free(gdb_connection->packet_buffer);
+	free(gdb_connection->frame_buffer);
 	free(connection->priv);
 	connection->priv = NULL;
 
@@ -1482,20 +1588,65 @@ static int gdb_error(struct connection *connection, int retval)
 	return ERROR_OK;
 }
 
+/*
+ * Encode @a len bytes found at @a data in the frame buffer as hex digits
+ * or as escaped binary, and send them. @a data must lie inside the frame
+ * buffer at least 'len + 1' bytes behind the start of the payload, so the
+ * encoded output never overtakes the input it is generated from.
+ */
+static int gdb_put_memory_reply(struct connection *connection, bool binary,
+		const uint8_t *data, uint32_t len)
+{
+	static const char hex_digits[] = "0123456789abcdef";
+	struct gdb_connection *gdb_con = connection->priv;
+	char *payload = gdb_con->frame_buffer + 1;
+	char *out = payload;
+	unsigned char checksum = 0;
+
+	if (binary) {
+		*out++ = 'b';
+		checksum += 'b';
+	}
+
+	for (uint32_t i = 0; i < len; i++) {
+		uint8_t b = data[i];
+
+		if (!binary) {
+			out[0] = hex_digits[b >> 4];
+			out[1] = hex_digits[b & 0xf];
+			checksum += out[0] + out[1];
+			out += 2;
+		} else if (b == '#' || b == '$' || b == '}' || b == '*') {
+			out[0] = '}';
+			out[1] = b ^ 0x20;
+			checksum += out[0] + out[1];
+			out += 2;
+		} else {
+			*out++ = b;
+			checksum += b;
+		}
+	}
+
+	return gdb_put_frame(connection, out - payload, checksum);
+}
+
 /* We don't have to worry about the default 2 second timeout for GDB packets,
  * because GDB breaks up large memory reads into smaller reads.
+ *
+ * Handles both the hex 'm' and the binary 'x' packet. Target memory is read
+ * straight into the tail of the connection's frame buffer and encoded in
+ * place, so no intermediate buffers are involved.
  */
 static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
 	struct target *target = get_target_from_connection(connection);
+	struct gdb_connection *gdb_con = connection->priv;
+	bool binary = packet[0] == 'x';
 	char *separator;
 	uint64_t addr = 0;
 	uint32_t len = 0;
 
-	uint8_t *buffer;
-	char *hex_buffer;
-
 	int retval = ERROR_OK;
 
 	/* skip command character */
@@ -1511,12 +1662,27 @@ static int gdb_read_memory_packet(struct connection *connection,
 	len = strtoul(separator + 1, NULL, 16);
 
 	if (!len) {
+		if (binary)
+			return gdb_put_packet(connection, "b", 1);
 		LOG_WARNING("invalid read memory packet received (len == 0)");
 		gdb_put_packet(connection, "", 0);
 		return ERROR_OK;
 	}
 
-	buffer = malloc(len);
+	/* gdb copes with shorter replies and asks for the remainder */
+	uint32_t max_len = binary ? gdb_con->packet_size - 1 : gdb_con->packet_size / 2;
+	if (len > max_len) {
+		LOG_DEBUG("clamping read of 0x%8.8" PRIx32 " bytes to 0x%8.8" PRIx32, len, max_len);
+		len = max_len;
+	}
+
+	/* '$', optional 'b', up to two characters per byte, "#xx" and the
+	 * terminator of snprintf(), with the raw data parked in the upper half */
+	size_t prefix = binary ? 1 : 0;
+	char *frame = gdb_frame_reserve(gdb_con, 2 * (size_t)len + prefix + 5);
+	if (!frame)
+		return gdb_error(connection, ERROR_FAIL);
+	uint8_t *buffer = (uint8_t *)frame + 1 + prefix + len;
 
 	LOG_DEBUG("addr: 0x%16.16" PRIx64 ", len: 0x%8.8" PRIx32 "", addr, len);
 
@@ -1544,19 +1710,11 @@ static int gdb_read_memory_packet(struct connection *connection,
 		retval = ERROR_OK;
 	}
 
-	if (retval == ERROR_OK) {
-		hex_buffer = malloc(len * 2 + 1);
-
-		size_t pkt_len = hexify(hex_buffer, buffer, len, len * 2 + 1);
-
-		gdb_put_packet(connection, hex_buffer, pkt_len);
-
-		free(hex_buffer);
-	} else
+	if (retval == ERROR_OK)
+		retval = gdb_put_memory_reply(connection, binary, buffer, len);
+	else
 		retval = gdb_error(connection, retval);
 
-	free(buffer);
-
 	return retval;
 }
 
@@ -2880,8 +3038,8 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+",
-			GDB_BUFFER_SIZE,
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+;binary-upload+",
+			gdb_connection->packet_size,
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
 			(gdb_target_desc_supported == 1) ? '+' : '-');
 
@@ -3486,14 +3644,12 @@ static void gdb_sig_halted(struct connection *connection)
 
 static int gdb_input_inner(struct connection *connection)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for null-termination */
-
 	struct target *target;
-	char const *packet = gdb_packet_buffer;
 	int packet_size;
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
+	char *gdb_packet_buffer = gdb_con->packet_buffer;
+	char const *packet = gdb_packet_buffer;
 	static bool warn_use_ext;
 
 	target = get_target_from_connection(connection);
@@ -3510,7 +3666,7 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE;
+		packet_size = gdb_con->packet_size;
 		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
@@ -3550,6 +3706,7 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_set_register_packet(connection, packet, packet_size);
 					break;
 				case 'm':
+				case 'x':
 					retval = gdb_read_memory_packet(connection, packet, packet_size);
 					break;
 				case 'M':
@@ -3937,6 +4094,26 @@ COMMAND_HANDLER(handle_gdb_report_register_access_error)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_packet_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int size;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+		if (size < GDB_PACKET_SIZE_MIN || size > GDB_PACKET_SIZE_MAX) {
+			command_print(CMD, "packet size must be between %u and %u bytes",
+				GDB_PACKET_SIZE_MIN, GDB_PACKET_SIZE_MAX);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		gdb_packet_size = size;
+	}
+
+	command_print(CMD, "%u", gdb_packet_size);
+	return ERROR_OK;
+}
+
 /* gdb_breakpoint_override */
 COMMAND_HANDLER(handle_gdb_breakpoint_override_command)
 {
@@ -4065,6 +4242,14 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable reporting register access errors",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_packet_size",
+		.handler = handle_gdb_packet_size_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or set the maximum packet size advertised to gdb. "
+			"Applies to new connections.",
+		.usage = "[bytes]",
+	},
 	{
 		.name = "gdb_breakpoint_override",
 		.handler = handle_gdb_breakpoint_override_command,
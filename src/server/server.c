@@ -34,6 +34,10 @@
 #include <netinet/tcp.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 static struct service *services;
 
 enum shutdown_reason {
@@ -53,6 +57,248 @@ static int polling_period = 100;
 /* address by name on which to listen for incoming TCP/IP connections */
 static char *bindto_name;
 
+/*
+ * Event backends for server_loop().
+ *
+ * Every fd the server listens on is registered once, when the service or
+ * connection is created, and unregistered when it goes away. A backend
+ * waits for input and marks the ready fds by queueing their server_event
+ * on ready_events; server_loop() then dispatches only those.
+ */
+struct server_event_backend {
+	const char *name;
+	int (*init)(void);
+	void (*quit)(void);
+	int (*add)(struct server_event *event);
+	void (*del)(struct server_event *event);
+	/* returns the number of ready fds, 0 on timeout or -1 on error */
+	int (*wait)(int timeout_ms);
+};
+
+static const struct server_event_backend *event_backend;
+static struct server_event *ready_events;
+
+static void server_event_mark_ready(struct server_event *event)
+{
+	if (event->ready)
+		return;
+	event->ready = true;
+	event->next_ready = ready_events;
+	ready_events = event;
+}
+
+static struct server_event *server_event_pop_ready(void)
+{
+	struct server_event *event = ready_events;
+
+	if (event) {
+		ready_events = event->next_ready;
+		event->next_ready = NULL;
+		event->ready = false;
+	}
+	return event;
+}
+
+static int select_backend_init(void)
+{
+	return ERROR_OK;
+}
+
+static void select_backend_quit(void)
+{
+}
+
+static int select_backend_add(struct server_event *event)
+{
+	return ERROR_OK;
+}
+
+static void select_backend_del(struct server_event *event)
+{
+}
+
+static int select_backend_wait(int timeout_ms)
+{
+	fd_set read_fds;
+	int fd_max = 0;
+
+	FD_ZERO(&read_fds);
+
+	for (struct service *service = services; service; service = service->next) {
+		if (service->event.fd != -1) {
+			FD_SET(service->event.fd, &read_fds);
+			fd_max = MAX(fd_max, service->event.fd);
+		}
+		for (struct connection *c = service->connections; c; c = c->next) {
+			if (c->event.fd != -1) {
+				FD_SET(c->event.fd, &read_fds);
+				fd_max = MAX(fd_max, c->event.fd);
+			}
+		}
+	}
+
+	struct timeval tv;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	int retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+	if (retval <= 0)
+		return retval;
+
+	for (struct service *service = services; service; service = service->next) {
+		if (service->event.fd != -1 && FD_ISSET(service->event.fd, &read_fds))
+			server_event_mark_ready(&service->event);
+		for (struct connection *c = service->connections; c; c = c->next)
+			if (c->event.fd != -1 && FD_ISSET(c->event.fd, &read_fds))
+				server_event_mark_ready(&c->event);
+	}
+
+	return retval;
+}
+
+static const struct server_event_backend select_backend = {
+	.name = "select",
+	.init = select_backend_init,
+	.quit = select_backend_quit,
+	.add = select_backend_add,
+	.del = select_backend_del,
+	.wait = select_backend_wait,
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+#define EPOLL_MAX_EVENTS	64
+
+static int epoll_fd = -1;
+
+static int epoll_backend_init(void)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		LOG_DEBUG("epoll_create1 failed: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static void epoll_backend_quit(void)
+{
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	epoll_fd = -1;
+}
+
+static int epoll_backend_add(struct server_event *event)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.ptr = event,
+	};
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event->fd, &ev) == -1) {
+		/* e.g. EPERM when stdin is redirected from a regular file */
+		LOG_DEBUG("epoll_ctl(%d) failed: %s", event->fd, strerror(errno));
+		return ERROR_FAIL;
+	}
+	return ERROR_OK;
+}
+
+static void epoll_backend_del(struct server_event *event)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, event->fd, NULL);
+}
+
+static int epoll_backend_wait(int timeout_ms)
+{
+	struct epoll_event events[EPOLL_MAX_EVENTS];
+
+	int retval = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, timeout_ms);
+	for (int i = 0; i < retval; i++)
+		server_event_mark_ready(events[i].data.ptr);
+
+	return retval;
+}
+
+static const struct server_event_backend epoll_backend = {
+	.name = "epoll",
+	.init = epoll_backend_init,
+	.quit = epoll_backend_quit,
+	.add = epoll_backend_add,
+	.del = epoll_backend_del,
+	.wait = epoll_backend_wait,
+};
+#endif
+
+static void server_event_init(void)
+{
+	if (event_backend)
+		return;
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (epoll_backend_init() == ERROR_OK) {
+		event_backend = &epoll_backend;
+		LOG_DEBUG("server event backend: %s", event_backend->name);
+		return;
+	}
+#endif
+
+	event_backend = &select_backend;
+	event_backend->init();
+	LOG_DEBUG("server event backend: %s", event_backend->name);
+}
+
+static void server_event_quit(void)
+{
+	if (event_backend)
+		event_backend->quit();
+	event_backend = NULL;
+	ready_events = NULL;
+}
+
+/* the select backend finds registered fds by walking the service list */
+static void server_event_fallback_to_select(void)
+{
+	LOG_DEBUG("server event backend: falling back from %s to select",
+		event_backend->name);
+	event_backend->quit();
+	event_backend = &select_backend;
+	event_backend->init();
+}
+
+static void server_event_add(struct server_event *event, int fd)
+{
+	server_event_init();
+
+	event->fd = fd;
+	event->ready = false;
+	event->next_ready = NULL;
+	if (fd == -1)
+		return;
+
+	if (event_backend->add(event) != ERROR_OK)
+		server_event_fallback_to_select();
+}
+
+static void server_event_del(struct server_event *event)
+{
+	if (event->fd == -1)
+		return;
+
+	if (event_backend)
+		event_backend->del(event);
+	event->fd = -1;
+
+	/* drop it from the list of fds still to be dispatched */
+	if (event->ready) {
+		for (struct server_event **p = &ready_events; *p; p = &(*p)->next_ready) {
+			if (*p == event) {
+				*p = event->next_ready;
+				break;
+			}
+		}
+		event->ready = false;
+		event->next_ready = NULL;
+	}
+}
+
 static int add_connection(struct service *service, struct command_context *cmd_ctx)
 {
 	socklen_t address_size;
@@ -67,6 +313,11 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	c->cmd_ctx = copy_command_context(cmd_ctx);
 	c->service = service;
 	c->input_pending = false;
+	c->event.service = service;
+	c->event.connection = c;
+	c->event.fd = -1;
+	c->event.ready = false;
+	c->event.next_ready = NULL;
 	c->priv = NULL;
 	c->next = NULL;
 
@@ -107,6 +358,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 
 		/* do not check for new connections again on stdin */
 		service->fd = -1;
+		server_event_del(&service->event);
 
 		LOG_INFO("accepting '%s' connection from pipe", service->name);
 		retval = service->new_connection(c);
@@ -120,12 +372,15 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 		c->fd = service->fd;
 		/* do not check for new connections again on stdin */
 		service->fd = -1;
+		server_event_del(&service->event);
 
 		char *out_file = alloc_printf("%so", service->port);
 		c->fd_out = open(out_file, O_WRONLY);
 		free(out_file);
 		if (c->fd_out == -1) {
 			LOG_ERROR("could not open %s", service->port);
+			service->fd = c->fd;
+			server_event_add(&service->event, service->fd);
 			command_done(c->cmd_ctx);
 			free(c);
 			return ERROR_FAIL;
@@ -135,6 +390,8 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 		retval = service->new_connection(c);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("attempted '%s' connection rejected", service->name);
+			service->fd = c->fd;
+			server_event_add(&service->event, service->fd);
 			command_done(c->cmd_ctx);
 			free(c);
 			return retval;
@@ -146,6 +403,8 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 		;
 	*p = c;
 
+	server_event_add(&c->event, c->fd);
+
 	if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 		service->max_connections--;
 
@@ -161,11 +420,13 @@ static int remove_connection(struct service *service, struct connection *connect
 	while ((c = *p)) {
 		if (c->fd == connection->fd) {
 			service->connection_closed(c);
+			server_event_del(&c->event);
 			if (service->type == CONNECTION_TCP)
 				close_socket(c->fd);
 			else if (service->type == CONNECTION_PIPE) {
 				/* The service will listen to the pipe again */
 				c->service->fd = c->fd;
+				server_event_add(&c->service->event, c->service->fd);
 			}
 
 			command_done(c->cmd_ctx);
@@ -213,6 +474,11 @@ int add_service(const struct service_driver *driver, const char *port,
 	c->input = driver->input_handler;
 	c->connection_closed = driver->connection_closed_handler;
 	c->keep_client_alive = driver->keep_client_alive_handler;
+	c->event.service = c;
+	c->event.connection = NULL;
+	c->event.fd = -1;
+	c->event.ready = false;
+	c->event.next_ready = NULL;
 	c->priv = priv;
 	c->next = NULL;
 	long portnumber;
@@ -333,6 +599,8 @@ int add_service(const struct service_driver *driver, const char *port,
 		;
 	*p = c;
 
+	server_event_add(&c->event, c->fd);
+
 	return ERROR_OK;
 }
 
@@ -367,6 +635,7 @@ int remove_service(const char *name, const char *port)
 			else
 				prev->next = tmp->next;
 
+			server_event_del(&tmp->event);
 			if (tmp->type != CONNECTION_STDINOUT)
 				close_socket(tmp->fd);
 
@@ -389,6 +658,7 @@ static int remove_services(void)
 		struct service *next = c->next;
 
 		remove_connections(c);
+		server_event_del(&c->event);
 
 		free(c->name);
 
@@ -418,17 +688,46 @@ void server_keep_clients_alive(void)
 				s->keep_client_alive(c);
 }
 
-int server_loop(struct command_context *command_context)
+static void server_accept(struct service *service, struct command_context *command_context)
 {
-	struct service *service;
+	if (service->max_connections != 0) {
+		add_connection(service, command_context);
+		return;
+	}
 
-	bool poll_ok = true;
+	if (service->type == CONNECTION_TCP) {
+		struct sockaddr_in sin;
+		socklen_t address_size = sizeof(sin);
+		int tmp_fd;
+		tmp_fd = accept(service->fd,
+				(struct sockaddr *)&service->sin,
+				&address_size);
+		close_socket(tmp_fd);
+	}
+	LOG_INFO("rejected '%s' connection, no more connections allowed",
+		service->name);
+}
 
-	/* used in select() */
-	fd_set read_fds;
-	int fd_max;
+static void server_input(struct service *service, struct connection *c)
+{
+	int retval = service->input(c);
+	if (retval == ERROR_OK)
+		return;
+
+	if (service->type == CONNECTION_PIPE ||
+			service->type == CONNECTION_STDINOUT) {
+		/* if connection uses a pipe then
+		 * shutdown openocd on error */
+		shutdown_openocd = SHUTDOWN_REQUESTED;
+	}
+	remove_connection(service, c);
+	LOG_INFO("dropped '%s' connection", service->name);
+}
+
+int server_loop(struct command_context *command_context)
+{
+	bool poll_ok = true;
 
-	/* used in accept() */
 	int retval;
 
 	int64_t next_event = timeval_ms() + polling_period;
@@ -438,69 +737,37 @@ int server_loop(struct command_context *command_context)
 		LOG_ERROR("couldn't set SIGPIPE to SIG_IGN");
 #endif
 
-	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
-		/* monitor sockets for activity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
-
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next) {
-			if (service->fd != -1) {
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
-
-				if (service->fd > fd_max)
-					fd_max = service->fd;
-			}
-
-			if (service->connections) {
-				struct connection *c;
-
-				for (c = service->connections; c; c = c->next) {
-					/* check for activity on the connection */
-					FD_SET(c->fd, &read_fds);
-					if (c->fd > fd_max)
-						fd_max = c->fd;
-				}
-			}
-		}
+	server_event_init();
 
-		struct timeval tv;
-		tv.tv_sec = 0;
-		if (poll_ok) {
-			/* we're just polling this iteration, this is faster on embedded
-			 * hosts */
-			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
-		} else {
-			/* Timeout socket_select() when a target timer expires or every polling_period */
-			int timeout_ms = next_event - timeval_ms();
+	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
+		int timeout_ms = 0;
+		if (!poll_ok) {
+			/* Sleep until a target timer expires or at most for polling_period.
+			 * Only while we're sleeping we'll let others run */
+			timeout_ms = next_event - timeval_ms();
 			if (timeout_ms < 0)
 				timeout_ms = 0;
 			else if (timeout_ms > polling_period)
 				timeout_ms = polling_period;
-			tv.tv_usec = timeout_ms * 1000;
-			/* Only while we're sleeping we'll let others run */
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
 		}
+		/* otherwise we're just polling this iteration, this is faster on
+		 * embedded hosts */
+
+		retval = event_backend->wait(timeout_ms);
 
 		if (retval == -1) {
 #ifdef _WIN32
 
 			errno = WSAGetLastError();
 
-			if (errno == WSAEINTR)
-				FD_ZERO(&read_fds);
-			else {
+			if (errno != WSAEINTR) {
 				LOG_ERROR("error during select: %s", strerror(errno));
 				return ERROR_FAIL;
 			}
 #else
 
-			if (errno == EINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
+			if (errno != EINTR) {
+				LOG_ERROR("error during %s: %s", event_backend->name, strerror(errno));
 				return ERROR_FAIL;
 			}
 #endif
@@ -509,15 +776,13 @@ int server_loop(struct command_context *command_context)
 		if (retval == 0) {
 			/* Execute callbacks of expired timers when
 			 * - there was nothing to do if poll_ok was true
-			 * - socket_select() timed out if poll_ok was false, now one or more
+			 * - the wait timed out if poll_ok was false, now one or more
 			 *   timers expired or the polling period elapsed
 			 */
 			target_call_timer_callbacks();
 			next_event = target_timer_next_event();
 			process_jim_events(command_context);
 
-			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
-
 			/* We timed out/there was nothing to do, timeout rather than poll next time
 			 **/
 			poll_ok = false;
@@ -533,52 +798,23 @@ int server_loop(struct command_context *command_context)
 		 */
 		poll_ok = poll_ok || target_got_message();
 
-		for (service = services; service; service = service->next) {
-			/* handle new connections on listeners */
-			if ((service->fd != -1)
-				&& (FD_ISSET(service->fd, &read_fds))) {
-				if (service->max_connections != 0)
-					add_connection(service, command_context);
-				else {
-					if (service->type == CONNECTION_TCP) {
-						struct sockaddr_in sin;
-						socklen_t address_size = sizeof(sin);
-						int tmp_fd;
-						tmp_fd = accept(service->fd,
-								(struct sockaddr *)&service->sin,
-								&address_size);
-						close_socket(tmp_fd);
-					}
-					LOG_INFO(
-						"rejected '%s' connection, no more connections allowed",
-						service->name);
-				}
-			}
+		/* dispatch only the fds the backend reported as ready; handlers
+		 * may remove other connections, which unlinks them from the list */
+		struct server_event *event;
+		while ((event = server_event_pop_ready())) {
+			if (event->connection)
+				server_input(event->service, event->connection);
+			else if (event->service->fd != -1)
+				server_accept(event->service, command_context);
+		}
 
-			/* handle activity on connections */
-			if (service->connections) {
-				struct connection *c;
-
-				for (c = service->connections; c; ) {
-					if ((c->fd >= 0 && FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
-						retval = service->input(c);
-						if (retval != ERROR_OK) {
-							struct connection *next = c->next;
-							if (service->type == CONNECTION_PIPE ||
-									service->type == CONNECTION_STDINOUT) {
-								/* if connection uses a pipe then
-								 * shutdown openocd on error */
-								shutdown_openocd = SHUTDOWN_REQUESTED;
-							}
-							remove_connection(service, c);
-							LOG_INFO("dropped '%s' connection",
-								service->name);
-							c = next;
-							continue;
-						}
-					}
-					c = c->next;
-				}
+		/* connections that still hold buffered input from a previous read */
+		for (struct service *service = services; service; service = service->next) {
+			for (struct connection *c = service->connections; c; ) {
+				struct connection *next = c->next;
+				if (c->input_pending)
+					server_input(service, c);
+				c = next;
 			}
 		}
 
@@ -697,6 +933,7 @@ int server_init(struct command_context *cmd_ctx)
 int server_quit(void)
 {
 	remove_services();
+	server_event_quit();
 	target_quit();
 
 #ifdef _WIN32
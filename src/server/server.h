@@ -33,6 +33,25 @@ enum connection_type {
 
 #define CONNECTION_LIMIT_UNLIMITED		(-1)
 
+struct service;
+struct connection;
+
+/**
+ * Readiness bookkeeping for one file descriptor watched by server_loop().
+ * It is embedded in both services (listening fd) and connections, and is
+ * only manipulated by the event backend in server.c.
+ */
+struct server_event {
+	struct service *service;
+	/** the owning connection, or NULL for the listening fd of a service */
+	struct connection *connection;
+	/** fd currently registered with the event backend, -1 if none */
+	int fd;
+	/** set by the backend when the fd has input, cleared on dispatch */
+	bool ready;
+	struct server_event *next_ready;
+};
+
 struct connection {
 	int fd;
 	int fd_out;	/* When using pipes we're writing to a different fd */
@@ -40,6 +59,7 @@ struct connection {
 	struct command_context *cmd_ctx;
 	struct service *service;
 	bool input_pending;
+	struct server_event event;
 	void *priv;
 	struct connection *next;
 };
@@ -78,6 +98,7 @@ struct service {
 	int (*input)(struct connection *connection);
 	int (*connection_closed)(struct connection *connection);
 	void (*keep_client_alive)(struct connection *connection);
+	struct server_event event;
 	void *priv;
 	struct service *next;
 };
@@ -16,6 +16,30 @@
 #define TCL_SERVER_VERSION		"TCL Server 0.1"
 #define TCL_LINE_INITIAL		(4*1024)
 #define TCL_LINE_MAX			(4*1024*1024)
+#define TCL_INPUT_SIZE			(64*1024)
+#define TCL_NOTIFY_END			"\r\n\x1a"
+
+/*
+ * Binary protocol, entered with the command tcl_binary. A request is an
+ * 8 byte header (op, 3 reserved bytes, payload length as little endian
+ * u32) followed by the payload. A reply is a 12 byte header (op, 3 reserved
+ * bytes, OpenOCD error code as little endian i32, payload length as little
+ * endian u32) followed by the payload.
+ */
+#define TCL_BIN_REQUEST_SIZE	8
+#define TCL_BIN_REPLY_SIZE		12
+/* target memory is read and written in chunks of this size */
+#define TCL_BIN_CHUNK			(64*1024)
+
+enum tcl_bin_op {
+	TCL_BIN_TEXT = 0,		/* back to the text protocol */
+	TCL_BIN_READ = 1,		/* u64 address, u32 count: data in replies, then an empty one */
+	TCL_BIN_WRITE = 2,		/* u64 address, data */
+	TCL_BIN_CHECKSUM = 3,	/* u64 address, u32 count: u32 crc */
+	TCL_BIN_POLL = 4,		/* u32 target state, state name */
+	TCL_BIN_EVAL = 5,		/* Tcl command: result */
+	TCL_BIN_NOTIFY = 0x80,	/* asynchronous notification or trace */
+};
 
 struct tcl_connection {
 	int tc_linedrop;
@@ -26,6 +50,22 @@ struct tcl_connection {
 	enum target_state tc_laststate;
 	bool tc_notify;
 	bool tc_trace;
+	uint8_t *tc_in;
+	/* binary protocol */
+	bool tc_binary;
+	bool tc_binary_pending;
+	uint8_t tc_bin_header[TCL_BIN_REQUEST_SIZE];
+	unsigned int tc_bin_header_len;
+	uint8_t tc_bin_op;
+	/* payload bytes of the current request not received yet */
+	uint32_t tc_bin_remaining;
+	uint8_t *tc_bin_buf;
+	uint32_t tc_bin_size;
+	uint32_t tc_bin_len;
+	/* next address of a write request, once received */
+	bool tc_bin_have_address;
+	target_addr_t tc_bin_address;
+	int tc_bin_retval;
 };
 
 static char *tcl_port;
@@ -35,6 +75,20 @@ static int tcl_new_connection(struct connection *connection);
 static int tcl_input(struct connection *connection);
 static int tcl_output(struct connection *connection, const void *buf, ssize_t len);
 static int tcl_closed(struct connection *connection);
+static int tcl_bin_reply(struct connection *connection, uint8_t op, int retval,
+		const void *data, uint32_t len);
+
+/* send a notification, ending with TCL_NOTIFY_END */
+static int tcl_notify(struct connection *connection, const char *text)
+{
+	struct tcl_connection *tclc = connection->priv;
+	size_t len = strlen(text);
+
+	if (tclc->tc_binary)
+		return tcl_bin_reply(connection, TCL_BIN_NOTIFY, ERROR_OK, text,
+			len - strlen(TCL_NOTIFY_END));
+	return tcl_output(connection, text, len);
+}
 
 static int tcl_target_callback_event_handler(struct target *target,
 		enum target_event event, void *priv)
@@ -46,15 +100,15 @@ static int tcl_target_callback_event_handler(struct target *target,
 	tclc = connection->priv;
 
 	if (tclc->tc_notify) {
-		snprintf(buf, sizeof(buf), "type target_event event %s\r\n\x1a", target_event_name(event));
-		tcl_output(connection, buf, strlen(buf));
+		snprintf(buf, sizeof(buf), "type target_event event %s" TCL_NOTIFY_END, target_event_name(event));
+		tcl_notify(connection, buf);
 	}
 
 	if (tclc->tc_laststate != target->state) {
 		tclc->tc_laststate = target->state;
 		if (tclc->tc_notify) {
-			snprintf(buf, sizeof(buf), "type target_state state %s\r\n\x1a", target_state_name(target));
-			tcl_output(connection, buf, strlen(buf));
+			snprintf(buf, sizeof(buf), "type target_state state %s" TCL_NOTIFY_END, target_state_name(target));
+			tcl_notify(connection, buf);
 		}
 	}
 
@@ -71,8 +125,8 @@ static int tcl_target_callback_reset_handler(struct target *target,
 	tclc = connection->priv;
 
 	if (tclc->tc_notify) {
-		snprintf(buf, sizeof(buf), "type target_reset mode %s\r\n\x1a", target_reset_mode_name(reset_mode));
-		tcl_output(connection, buf, strlen(buf));
+		snprintf(buf, sizeof(buf), "type target_reset mode %s" TCL_NOTIFY_END, target_reset_mode_name(reset_mode));
+		tcl_notify(connection, buf);
 	}
 
 	return ERROR_OK;
@@ -84,7 +138,7 @@ static int tcl_target_callback_trace_handler(struct target *target,
 	struct connection *connection = priv;
 	struct tcl_connection *tclc;
 	char *header = "type target_trace data ";
-	char *trailer = "\r\n\x1a";
+	char *trailer = TCL_NOTIFY_END;
 	size_t hex_len = len * 2 + 1;
 	size_t max_len = hex_len + strlen(header) + strlen(trailer);
 	char *buf, *hex;
@@ -96,7 +150,7 @@ static int tcl_target_callback_trace_handler(struct target *target,
 		buf = malloc(max_len);
 		hexify(hex, data, len, hex_len);
 		snprintf(buf, max_len, "%s%s%s", header, hex, trailer);
-		tcl_output(connection, buf, strlen(buf));
+		tcl_notify(connection, buf);
 		free(hex);
 		free(buf);
 	}
@@ -139,7 +193,10 @@ static int tcl_new_connection(struct connection *connection)
 
 	tclc->tc_line_size = TCL_LINE_INITIAL;
 	tclc->tc_line = malloc(tclc->tc_line_size);
-	if (!tclc->tc_line) {
+	tclc->tc_in = malloc(TCL_INPUT_SIZE);
+	if (!tclc->tc_line || !tclc->tc_in) {
+		free(tclc->tc_line);
+		free(tclc->tc_in);
 		free(tclc);
 		return ERROR_CONNECTION_REJECTED;
 	}
@@ -160,87 +217,348 @@ static int tcl_new_connection(struct connection *connection)
 	return ERROR_OK;
 }
 
-static int tcl_input(struct connection *connection)
+/* append to the line, growing it: exponential below 1 MB, linear above */
+static void tcl_line_append(struct tcl_connection *tclc, const uint8_t *data, size_t len)
+{
+	if (tclc->tc_linedrop)
+		return;
+
+	size_t needed = tclc->tc_lineoffset + len;
+	if (needed > (size_t)tclc->tc_line_size) {
+		size_t size = tclc->tc_line_size;
+		while (size < needed && size < TCL_LINE_MAX)
+			size = size <= 1*1024*1024 ? size * 2 : size + 1*1024*1024;
+		if (size > TCL_LINE_MAX)
+			size = TCL_LINE_MAX;
+
+		char *line = size >= needed ? realloc(tclc->tc_line, size) : NULL;
+		if (!line) {
+			/* maximum line size reached, drop line */
+			tclc->tc_linedrop = 1;
+			return;
+		}
+		tclc->tc_line = line;
+		tclc->tc_line_size = size;
+	}
+
+	memcpy(tclc->tc_line + tclc->tc_lineoffset, data, len);
+	tclc->tc_lineoffset += len;
+}
+
+/* consume text input up to the end of the first command */
+static int tcl_text_input(struct connection *connection, const uint8_t *in,
+		size_t len, size_t *used)
 {
 	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
-	int retval;
-	int i;
-	ssize_t rlen;
+	struct tcl_connection *tclc = connection->priv;
 	const char *result;
 	int reslen;
-	struct tcl_connection *tclc;
-	unsigned char in[256];
-	char *tc_line_new;
-	int tc_line_size_new;
+	int retval;
 
-	rlen = connection_read(connection, &in, sizeof(in));
-	if (rlen <= 0) {
-		if (rlen < 0)
-			LOG_ERROR("error during read: %s", strerror(errno));
-		return ERROR_SERVER_REMOTE_CLOSED;
+	/* ctrl-z is end of command. When testing from telnet, just
+	 * press ctrl-z a couple of times first to put telnet into the
+	 * mode where it will send 0x1a in response to pressing ctrl-z
+	 */
+	const uint8_t *end = memchr(in, '\x1a', len);
+	*used = end ? (size_t)(end - in) + 1 : len;
+
+	tcl_line_append(tclc, in, *used);
+	if (!end)
+		return ERROR_OK;
+
+	/* process the line */
+	if (tclc->tc_linedrop) {
+#define ESTR "line too long\n"
+		retval = tcl_output(connection, ESTR, sizeof(ESTR));
+		if (retval != ERROR_OK)
+			return retval;
+#undef ESTR
+	} else {
+		tclc->tc_line[tclc->tc_lineoffset-1] = '\0';
+		command_run_line(connection->cmd_ctx, tclc->tc_line);
+		result = Jim_GetString(Jim_GetResult(interp), &reslen);
+		retval = tcl_output(connection, result, reslen);
+		if (retval != ERROR_OK)
+			return retval;
+		/* Always output ctrl-z as end of line to allow multiline results */
+		tcl_output(connection, "\x1a", 1);
 	}
 
-	tclc = connection->priv;
-	if (!tclc)
-		return ERROR_CONNECTION_REJECTED;
+	tclc->tc_lineoffset = 0;
+	tclc->tc_linedrop = 0;
 
-	/* push as much data into the line as possible */
-	for (i = 0; i < rlen; i++) {
-		/* buffer the data */
-		tclc->tc_line[tclc->tc_lineoffset] = in[i];
-		if (tclc->tc_lineoffset + 1 < tclc->tc_line_size) {
-			tclc->tc_lineoffset++;
-		} else if (tclc->tc_line_size >= TCL_LINE_MAX) {
-			/* maximum line size reached, drop line */
-			tclc->tc_linedrop = 1;
-		} else {
-			/* grow line buffer: exponential below 1 MB, linear above */
-			if (tclc->tc_line_size <= 1*1024*1024)
-				tc_line_size_new = tclc->tc_line_size * 2;
-			else
-				tc_line_size_new = tclc->tc_line_size + 1*1024*1024;
-
-			if (tc_line_size_new > TCL_LINE_MAX)
-				tc_line_size_new = TCL_LINE_MAX;
-
-			tc_line_new = realloc(tclc->tc_line, tc_line_size_new);
-			if (!tc_line_new) {
-				tclc->tc_linedrop = 1;
-			} else {
-				tclc->tc_line = tc_line_new;
-				tclc->tc_line_size = tc_line_size_new;
-				tclc->tc_lineoffset++;
-			}
+	/* the reply to tcl_binary was the last one in text */
+	if (tclc->tc_binary_pending) {
+		tclc->tc_binary_pending = false;
+		tclc->tc_binary = true;
+		tclc->tc_bin_header_len = 0;
+	}
 
-		}
+	return ERROR_OK;
+}
+
+static int tcl_bin_reply(struct connection *connection, uint8_t op, int retval,
+		const void *data, uint32_t len)
+{
+	uint8_t header[TCL_BIN_REPLY_SIZE] = { op };
+
+	h_u32_to_le(header + 4, retval);
+	h_u32_to_le(header + 8, len);
+	int wretval = tcl_output(connection, header, sizeof(header));
+	if (wretval != ERROR_OK || !len)
+		return wretval;
+	return tcl_output(connection, data, len);
+}
+
+static int tcl_bin_reserve(struct tcl_connection *tclc, uint32_t size)
+{
+	if (size <= tclc->tc_bin_size)
+		return ERROR_OK;
+
+	uint8_t *buf = realloc(tclc->tc_bin_buf, size);
+	if (!buf)
+		return ERROR_FAIL;
+	tclc->tc_bin_buf = buf;
+	tclc->tc_bin_size = size;
+	return ERROR_OK;
+}
+
+/* stream target memory into the socket, one reply per chunk */
+static int tcl_bin_read(struct connection *connection, struct target *target,
+		target_addr_t address, uint32_t count)
+{
+	struct tcl_connection *tclc = connection->priv;
+	int retval = tcl_bin_reserve(tclc, MIN(count, TCL_BIN_CHUNK));
+
+	while (retval == ERROR_OK && count) {
+		uint32_t n = MIN(count, TCL_BIN_CHUNK);
+
+		retval = target_read_buffer(target, address, n, tclc->tc_bin_buf);
+		if (retval != ERROR_OK)
+			break;
+
+		int wretval = tcl_bin_reply(connection, TCL_BIN_READ, ERROR_OK, tclc->tc_bin_buf, n);
+		if (wretval != ERROR_OK)
+			return wretval;
+
+		address += n;
+		count -= n;
+	}
+
+	/* an empty reply ends the data, with the result of the read */
+	return tcl_bin_reply(connection, TCL_BIN_READ, retval, NULL, 0);
+}
+
+static int tcl_bin_write_flush(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+	struct target *target = get_current_target_or_null(connection->cmd_ctx);
+
+	if (tclc->tc_bin_retval == ERROR_OK && tclc->tc_bin_len) {
+		if (target)
+			tclc->tc_bin_retval = target_write_buffer(target, tclc->tc_bin_address,
+				tclc->tc_bin_len, tclc->tc_bin_buf);
+		else
+			tclc->tc_bin_retval = ERROR_FAIL;
+	}
+	tclc->tc_bin_address += tclc->tc_bin_len;
+	tclc->tc_bin_len = 0;
+	return tclc->tc_bin_retval;
+}
 
-		/* ctrl-z is end of command. When testing from telnet, just
-		 * press ctrl-z a couple of times first to put telnet into the
-		 * mode where it will send 0x1a in response to pressing ctrl-z
-		 */
-		if (in[i] != '\x1a')
+/* write request data is written to the target as it arrives */
+static void tcl_bin_write_data(struct connection *connection, const uint8_t *data, uint32_t len)
+{
+	struct tcl_connection *tclc = connection->priv;
+
+	if (tclc->tc_bin_retval != ERROR_OK)
+		return;
+
+	if (!tclc->tc_bin_have_address) {
+		uint32_t n = MIN(len, 8 - tclc->tc_bin_len);
+		memcpy(tclc->tc_bin_buf + tclc->tc_bin_len, data, n);
+		tclc->tc_bin_len += n;
+		data += n;
+		len -= n;
+		if (tclc->tc_bin_len < 8)
+			return;
+		tclc->tc_bin_address = le_to_h_u64(tclc->tc_bin_buf);
+		tclc->tc_bin_have_address = true;
+		tclc->tc_bin_len = 0;
+	}
+
+	while (len) {
+		if (tclc->tc_bin_retval != ERROR_OK)
+			return;
+
+		/* whole chunks go straight from the input buffer */
+		if (!tclc->tc_bin_len && len >= TCL_BIN_CHUNK) {
+			struct target *target = get_current_target_or_null(connection->cmd_ctx);
+			uint32_t n = len - len % TCL_BIN_CHUNK;
+			tclc->tc_bin_retval = target ? target_write_buffer(target,
+				tclc->tc_bin_address, n, data) : ERROR_FAIL;
+			tclc->tc_bin_address += n;
+			data += n;
+			len -= n;
 			continue;
+		}
 
-		/* process the line */
-		if (tclc->tc_linedrop) {
-#define ESTR "line too long\n"
-			retval = tcl_output(connection, ESTR, sizeof(ESTR));
-			if (retval != ERROR_OK)
-				return retval;
-#undef ESTR
+		uint32_t n = MIN(len, TCL_BIN_CHUNK - tclc->tc_bin_len);
+		memcpy(tclc->tc_bin_buf + tclc->tc_bin_len, data, n);
+		tclc->tc_bin_len += n;
+		data += n;
+		len -= n;
+		if (tclc->tc_bin_len == TCL_BIN_CHUNK)
+			tcl_bin_write_flush(connection);
+	}
+}
+
+/* the whole request has been received */
+static int tcl_bin_request(struct connection *connection)
+{
+	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
+	struct tcl_connection *tclc = connection->priv;
+	struct target *target = get_current_target_or_null(connection->cmd_ctx);
+	const uint8_t *payload = tclc->tc_bin_buf;
+	uint32_t len = tclc->tc_bin_len;
+	uint8_t op = tclc->tc_bin_op;
+	int retval = tclc->tc_bin_retval;
+
+	if (retval != ERROR_OK && op != TCL_BIN_WRITE)
+		return tcl_bin_reply(connection, op, retval, NULL, 0);
+
+	switch (op) {
+	case TCL_BIN_TEXT:
+		tclc->tc_binary = false;
+		return tcl_bin_reply(connection, op, ERROR_OK, NULL, 0);
+	case TCL_BIN_READ:
+	case TCL_BIN_CHECKSUM: {
+		if (len != 12)
+			return tcl_bin_reply(connection, op, ERROR_COMMAND_SYNTAX_ERROR, NULL, 0);
+		if (!target)
+			return tcl_bin_reply(connection, op, ERROR_FAIL, NULL, 0);
+		target_addr_t address = le_to_h_u64(payload);
+		uint32_t count = le_to_h_u32(payload + 8);
+		if (op == TCL_BIN_READ)
+			return tcl_bin_read(connection, target, address, count);
+
+		uint32_t crc = 0;
+		uint8_t reply[4];
+		retval = target_checksum_memory(target, address, count, &crc);
+		h_u32_to_le(reply, crc);
+		return tcl_bin_reply(connection, op, retval, reply, retval == ERROR_OK ? 4 : 0);
+	}
+	case TCL_BIN_WRITE:
+		if (retval == ERROR_OK && !tclc->tc_bin_have_address)
+			return tcl_bin_reply(connection, op, ERROR_COMMAND_SYNTAX_ERROR, NULL, 0);
+		return tcl_bin_reply(connection, op, tcl_bin_write_flush(connection), NULL, 0);
+	case TCL_BIN_POLL: {
+		if (!target)
+			return tcl_bin_reply(connection, op, ERROR_FAIL, NULL, 0);
+		retval = target_poll(target);
+		const char *name = target_state_name(target);
+		uint8_t reply[4 + strlen(name)];
+		h_u32_to_le(reply, target->state);
+		memcpy(reply + 4, name, strlen(name));
+		return tcl_bin_reply(connection, op, retval, reply, sizeof(reply));
+	}
+	case TCL_BIN_EVAL: {
+		const char *result;
+		int reslen;
+
+		tclc->tc_bin_buf[len] = '\0';
+		retval = command_run_line(connection->cmd_ctx, (char *)tclc->tc_bin_buf);
+		result = Jim_GetString(Jim_GetResult(interp), &reslen);
+		return tcl_bin_reply(connection, op, retval, result, reslen);
+	}
+	default:
+		return tcl_bin_reply(connection, op, ERROR_NOT_IMPLEMENTED, NULL, 0);
+	}
+}
+
+/* consume binary input, until the client goes back to the text protocol */
+static int tcl_bin_input(struct connection *connection, const uint8_t *in,
+		size_t len, size_t *used)
+{
+	struct tcl_connection *tclc = connection->priv;
+	size_t done = 0;
+	int retval;
+
+	while (done < len && tclc->tc_binary) {
+		if (tclc->tc_bin_header_len < TCL_BIN_REQUEST_SIZE) {
+			size_t n = MIN(len - done, TCL_BIN_REQUEST_SIZE - tclc->tc_bin_header_len);
+			memcpy(tclc->tc_bin_header + tclc->tc_bin_header_len, in + done, n);
+			tclc->tc_bin_header_len += n;
+			done += n;
+			if (tclc->tc_bin_header_len < TCL_BIN_REQUEST_SIZE)
+				break;
+
+			tclc->tc_bin_op = tclc->tc_bin_header[0];
+			tclc->tc_bin_remaining = le_to_h_u32(tclc->tc_bin_header + 4);
+			tclc->tc_bin_len = 0;
+			tclc->tc_bin_have_address = false;
+			tclc->tc_bin_retval = ERROR_OK;
+
+			/* write data is not kept, the rest must fit in the buffer */
+			if (tclc->tc_bin_op == TCL_BIN_WRITE)
+				retval = tcl_bin_reserve(tclc, TCL_BIN_CHUNK);
+			else if (tclc->tc_bin_remaining >= TCL_LINE_MAX)
+				retval = ERROR_COMMAND_ARGUMENT_INVALID;
+			else
+				retval = tcl_bin_reserve(tclc, tclc->tc_bin_remaining + 1);
+			tclc->tc_bin_retval = retval;
 		} else {
-			tclc->tc_line[tclc->tc_lineoffset-1] = '\0';
-			command_run_line(connection->cmd_ctx, tclc->tc_line);
-			result = Jim_GetString(Jim_GetResult(interp), &reslen);
-			retval = tcl_output(connection, result, reslen);
-			if (retval != ERROR_OK)
-				return retval;
-			/* Always output ctrl-z as end of line to allow multiline results */
-			tcl_output(connection, "\x1a", 1);
+			uint32_t n = MIN(len - done, tclc->tc_bin_remaining);
+			if (tclc->tc_bin_op == TCL_BIN_WRITE) {
+				tcl_bin_write_data(connection, in + done, n);
+			} else if (tclc->tc_bin_retval == ERROR_OK) {
+				memcpy(tclc->tc_bin_buf + tclc->tc_bin_len, in + done, n);
+				tclc->tc_bin_len += n;
+			}
+			done += n;
+			tclc->tc_bin_remaining -= n;
 		}
 
-		tclc->tc_lineoffset = 0;
-		tclc->tc_linedrop = 0;
+		if (tclc->tc_bin_remaining)
+			continue;
+
+		tclc->tc_bin_header_len = 0;
+		retval = tcl_bin_request(connection);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	*used = done;
+	return ERROR_OK;
+}
+
+static int tcl_input(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+	ssize_t rlen;
+	int retval;
+
+	if (!tclc)
+		return ERROR_CONNECTION_REJECTED;
+
+	rlen = connection_read(connection, tclc->tc_in, TCL_INPUT_SIZE);
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	/* a command can switch between the text and the binary protocols */
+	for (size_t done = 0; done < (size_t)rlen; ) {
+		size_t used;
+
+		if (tclc->tc_binary)
+			retval = tcl_bin_input(connection, tclc->tc_in + done, rlen - done, &used);
+		else
+			retval = tcl_text_input(connection, tclc->tc_in + done, rlen - done, &used);
+		if (retval != ERROR_OK)
+			return retval;
+		done += used;
 	}
 
 	return ERROR_OK;
@@ -254,6 +572,8 @@ static int tcl_closed(struct connection *connection)
 	/* cleanup connection context */
 	if (tclc) {
 		free(tclc->tc_line);
+		free(tclc->tc_in);
+		free(tclc->tc_bin_buf);
 		free(tclc);
 		connection->priv = NULL;
 	}
@@ -323,6 +643,23 @@ COMMAND_HANDLER(handle_tcl_trace_command)
 	}
 }
 
+COMMAND_HANDLER(handle_tcl_binary_command)
+{
+	struct connection *connection = CMD_CTX->output_handler_priv;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!connection || strcmp(connection->service->name, "tcl")) {
+		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	struct tcl_connection *tclc = connection->priv;
+	tclc->tc_binary_pending = true;
+	return ERROR_OK;
+}
+
 static const struct command_registration tcl_command_handlers[] = {
 	{
 		.name = "tcl_port",
@@ -347,6 +684,13 @@ static const struct command_registration tcl_command_handlers[] = {
 		.help = "Target trace output",
 		.usage = "[on|off]",
 	},
+	{
+		.name = "tcl_binary",
+		.handler = handle_tcl_binary_command,
+		.mode = COMMAND_EXEC,
+		.help = "Switch the current Tcl RPC connection to the binary protocol",
+		.usage = "",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -319,6 +319,135 @@ int mem_ap_write_atomic_u32(struct adiv5_ap *ap, target_addr_t address,
 	return dap_run(ap->dap);
 }
 
+/**
+ * Start an empty request list for a MEM-AP.
+ *
+ * @param list The list to initialize.
+ * @param ap The MEM-AP the requests are for.
+ */
+void mem_ap_request_list_init(struct mem_ap_request_list *list, struct adiv5_ap *ap)
+{
+	list->ap = ap;
+	list->count = 0;
+}
+
+static int mem_ap_request_add(struct mem_ap_request_list *list,
+		target_addr_t address, uint32_t *read_value, uint32_t write_value)
+{
+	if (list->count == ARRAY_SIZE(list->requests)) {
+		int retval = mem_ap_request_list_queue(list);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	struct mem_ap_request *req = &list->requests[list->count++];
+	req->address = address;
+	req->read_value = read_value;
+	req->write_value = write_value;
+	return ERROR_OK;
+}
+
+/**
+ * Add the read of a word from memory or a system register to a request list.
+ *
+ * @param list The request list.
+ * @param address Address of the 32-bit word to read.
+ * @param value Where the word will be stored once the list is run.
+ *
+ * @return ERROR_OK for success. Otherwise a fault code.
+ */
+int mem_ap_request_read_u32(struct mem_ap_request_list *list,
+		target_addr_t address, uint32_t *value)
+{
+	assert(value);
+	return mem_ap_request_add(list, address, value, 0);
+}
+
+/**
+ * Add the write of a word to memory or a system register to a request list.
+ *
+ * @param list The request list.
+ * @param address Address to be written.
+ * @param value Word that will be written.
+ *
+ * @return ERROR_OK for success. Otherwise a fault code.
+ */
+int mem_ap_request_write_u32(struct mem_ap_request_list *list,
+		target_addr_t address, uint32_t value)
+{
+	return mem_ap_request_add(list, address, NULL, value);
+}
+
+/* Stable sort of a run of reads by bank, in place */
+static void mem_ap_request_sort_reads(struct mem_ap_request *reqs, unsigned int count)
+{
+	for (unsigned int i = 1; i < count; i++) {
+		struct mem_ap_request tmp = reqs[i];
+		target_addr_t bank = tmp.address & ~(target_addr_t)0xF;
+		unsigned int j = i;
+
+		while (j > 0 && (reqs[j - 1].address & ~(target_addr_t)0xF) > bank) {
+			reqs[j] = reqs[j - 1];
+			j--;
+		}
+		reqs[j] = tmp;
+	}
+}
+
+/**
+ * Queue all pending requests of a list to the DAP, without running it.
+ * Requests added afterwards are not reordered with the ones queued here.
+ *
+ * @param list The request list, empty on return.
+ *
+ * @return ERROR_OK for success. Otherwise a fault code.
+ */
+int mem_ap_request_list_queue(struct mem_ap_request_list *list)
+{
+	struct mem_ap_request *reqs = list->requests;
+	unsigned int count = list->count;
+	int retval = ERROR_OK;
+
+	list->count = 0;
+
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; ) {
+		if (!reqs[i].read_value) {
+			retval = mem_ap_write_u32(list->ap, reqs[i].address, reqs[i].write_value);
+			i++;
+			continue;
+		}
+
+		unsigned int end = i;
+		while (end < count && reqs[end].read_value)
+			end++;
+
+		mem_ap_request_sort_reads(&reqs[i], end - i);
+
+		for (; i < end && retval == ERROR_OK; i++)
+			retval = mem_ap_read_u32(list->ap, reqs[i].address, reqs[i].read_value);
+	}
+
+	return retval;
+}
+
+/**
+ * Synchronous completion of a request list. As a side effect, this flushes
+ * any other queued transactions.
+ *
+ * @param list The request list, empty on return.
+ *
+ * @return ERROR_OK for success; the values of all reads are stored.
+ * Otherwise a fault code.
+ */
+int mem_ap_request_list_run(struct mem_ap_request_list *list)
+{
+	int retval = mem_ap_request_list_queue(list);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return dap_run(list->ap->dap);
+}
+
 /**
  * Synchronous write of a block of memory, using a specific access size.
  *
@@ -1219,21 +1348,21 @@ struct cs_component_vals {
  * behind a MEM-AP or directly in the AP.
  *
  * @param mode           Method to access the component (AP or MEM-AP).
- * @param ap             Pointer to AP containing the component.
+ * @param list           Request list of the AP, used on MEM-AP access method.
  * @param component_base On MEM-AP access method, base address of the component.
  * @param reg            Offset of the component's register to read.
  * @param value          Pointer to the store the read value.
  *
  * @return ERROR_OK on success, else a fault code.
  */
-static int dap_queue_read_reg(enum coresight_access_mode mode, struct adiv5_ap *ap,
+static int dap_queue_read_reg(enum coresight_access_mode mode, struct mem_ap_request_list *list,
 		uint64_t component_base, unsigned int reg, uint32_t *value)
 {
 	if (mode == CS_ACCESS_AP)
-		return dap_queue_ap_read(ap, reg, value);
+		return dap_queue_ap_read(list->ap, reg, value);
 
 	/* mode == CS_ACCESS_MEM_AP */
-	return mem_ap_read_u32(ap, component_base + reg, value);
+	return mem_ap_request_read_u32(list, component_base + reg, value);
 }
 
 /**
@@ -1254,13 +1383,14 @@ static int rtp_read_cs_regs(enum coresight_access_mode mode, struct adiv5_ap *ap
 
 	uint32_t cid0, cid1, cid2, cid3;
 	uint32_t pid0, pid1, pid2, pid3, pid4;
+	struct mem_ap_request_list list;
 	int retval = ERROR_OK;
 
 	v->ap = ap;
 	v->component_base = component_base;
 	v->mode = mode;
 
-	/* sort by offset to gain speed */
+	mem_ap_request_list_init(&list, ap);
 
 	/*
 	 * Registers DEVARCH, DEVID and DEVTYPE are valid on Class 0x9 devices
@@ -1268,38 +1398,38 @@ static int rtp_read_cs_regs(enum coresight_access_mode mode, struct adiv5_ap *ap
 	 * without triggering error. Read them for eventual use on Class 0x9.
 	 */
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVARCH, &v->devarch);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_C9_DEVARCH, &v->devarch);
 
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVID, &v->devid);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_C9_DEVID, &v->devid);
 
 	/* Same address as ARM_CS_C1_MEMTYPE */
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_C9_DEVTYPE, &v->devtype_memtype);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_C9_DEVTYPE, &v->devtype_memtype);
 
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR4, &pid4);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_PIDR4, &pid4);
 
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR0, &pid0);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_PIDR0, &pid0);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR1, &pid1);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_PIDR1, &pid1);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR2, &pid2);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_PIDR2, &pid2);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_PIDR3, &pid3);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_PIDR3, &pid3);
 
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR0, &cid0);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_CIDR0, &cid0);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR1, &cid1);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_CIDR1, &cid1);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR2, &cid2);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_CIDR2, &cid2);
 	if (retval == ERROR_OK)
-		retval = dap_queue_read_reg(mode, ap, component_base, ARM_CS_CIDR3, &cid3);
+		retval = dap_queue_read_reg(mode, &list, component_base, ARM_CS_CIDR3, &cid3);
 
 	if (retval == ERROR_OK)
-		retval = dap_run(ap->dap);
+		retval = mem_ap_request_list_run(&list);
 	if (retval != ERROR_OK) {
 		LOG_DEBUG("Failed read CoreSight registers");
 		return retval;
@@ -1738,6 +1868,9 @@ static int rtp_ops_rom_table_entry(const struct rtp_ops *ops,
  */
 #define CORESIGHT_COMPONENT_FOUND (1)
 
+/* Number of ROM table entries read with a single DAP run */
+#define RTP_ROM_ENTRIES_PER_RUN 16
+
 static int rtp_ap(const struct rtp_ops *ops, struct adiv5_ap *ap, int depth);
 static int rtp_cs_component(enum coresight_access_mode mode, const struct rtp_ops *ops,
 		struct adiv5_ap *ap, target_addr_t dbgbase, bool *is_mem_ap, int depth);
@@ -1752,26 +1885,42 @@ static int rtp_rom_loop(enum coresight_access_mode mode, const struct rtp_ops *o
 
 	assert(IS_ALIGNED(base_address, ARM_CS_ALIGN));
 
+	/* ROM table entries are fetched in batches, each with a single DAP run */
+	const unsigned int words = width / 32;
+	uint32_t entries[RTP_ROM_ENTRIES_PER_RUN * 2];
+	unsigned int num_entries = 0, next_entry = 0;
+	struct mem_ap_request_list list;
+
+	mem_ap_request_list_init(&list, ap);
+
 	unsigned int offset = 0;
 	while (max_entries--) {
 		uint64_t romentry;
-		uint32_t romentry_low, romentry_high;
+		uint32_t romentry_low, romentry_high = 0;
 		target_addr_t component_base;
 		unsigned int saved_offset = offset;
-
-		int retval = dap_queue_read_reg(mode, ap, base_address, offset, &romentry_low);
-		offset += 4;
-		if (retval == ERROR_OK && width == 64) {
-			retval = dap_queue_read_reg(mode, ap, base_address, offset, &romentry_high);
-			offset += 4;
-		}
-		if (retval == ERROR_OK)
-			retval = dap_run(ap->dap);
-		if (retval != ERROR_OK) {
-			LOG_DEBUG("Failed read ROM table entry");
-			return retval;
+		int retval = ERROR_OK;
+
+		if (next_entry == num_entries) {
+			/* Don't read past the last entry the table can have */
+			num_entries = MIN(RTP_ROM_ENTRIES_PER_RUN, max_entries + 1);
+			next_entry = 0;
+			for (unsigned int i = 0; i < num_entries * words && retval == ERROR_OK; i++)
+				retval = dap_queue_read_reg(mode, &list, base_address, offset + 4 * i, &entries[i]);
+			if (retval == ERROR_OK)
+				retval = mem_ap_request_list_run(&list);
+			if (retval != ERROR_OK) {
+				LOG_DEBUG("Failed read ROM table entry");
+				return retval;
+			}
 		}
 
+		romentry_low = entries[next_entry * words];
+		if (width == 64)
+			romentry_high = entries[next_entry * words + 1];
+		next_entry++;
+		offset += 4 * words;
+
 		if (width == 64) {
 			romentry = (((uint64_t)romentry_high) << 32) | romentry_low;
 			component_base = base_address +
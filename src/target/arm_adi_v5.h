@@ -671,6 +671,45 @@ int mem_ap_read_atomic_u32(struct adiv5_ap *ap,
 int mem_ap_write_atomic_u32(struct adiv5_ap *ap,
 		target_addr_t address, uint32_t value);
 
+/* Number of requests a mem_ap_request_list holds before they are queued. */
+#define MEM_AP_REQUEST_LIST_SIZE 32
+
+/** A single word transfer held by a mem_ap_request_list. */
+struct mem_ap_request {
+	target_addr_t address;
+	/* Where to store the word read, NULL for a write. */
+	uint32_t *read_value;
+	uint32_t write_value;
+};
+
+/**
+ * Scatter-gather list of single word MEM-AP transfers at arbitrary addresses.
+ *
+ * Requests are collected and queued together, so that many scattered
+ * accesses are completed with a single dap_run(). Reads that are not
+ * separated by a write are grouped by 16 byte bank before they are queued,
+ * so that each bank is reached through the banked data registers with at
+ * most one TAR update. Writes are never reordered and reads never cross a
+ * write. The results of reads are only valid once the list has been run.
+ *
+ * A list lives on the stack of its user, it needs no allocation.
+ */
+struct mem_ap_request_list {
+	struct adiv5_ap *ap;
+	unsigned int count;
+	struct mem_ap_request requests[MEM_AP_REQUEST_LIST_SIZE];
+};
+
+void mem_ap_request_list_init(struct mem_ap_request_list *list, struct adiv5_ap *ap);
+int mem_ap_request_read_u32(struct mem_ap_request_list *list,
+		target_addr_t address, uint32_t *value);
+int mem_ap_request_write_u32(struct mem_ap_request_list *list,
+		target_addr_t address, uint32_t value);
+/* Queue the pending requests to the DAP, without running them. */
+int mem_ap_request_list_queue(struct mem_ap_request_list *list);
+/* Queue the pending requests and run the DAP queue. */
+int mem_ap_request_list_run(struct mem_ap_request_list *list);
+
 /* Synchronous MEM-AP memory mapped bus block transfers. */
 int mem_ap_read_buf(struct adiv5_ap *ap,
 		uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address);
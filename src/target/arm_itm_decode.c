@@ -0,0 +1,801 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/**
+ * @file
+ * Host side decoder of the ITM/DWT trace stream captured through a TPIU/SWO.
+ */
+
+/*
+ * Relevant specifications from ARM include:
+ *
+ * ARMv7-M Architecture Reference Manual, Appendix D4 "Debug ITM and DWT
+ * Packet Protocol"                                              ARM DDI 0403E
+ * CoreSight(tm) Components Technical Reference Manual, "Trace Formatter"
+ *                                                               ARM DDI 0314H
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/bits.h>
+#include <helper/command.h>
+#include <helper/list.h>
+#include <helper/log.h>
+#include <helper/time_support.h>
+#include <helper/types.h>
+#include <server/server.h>
+#include <target/target.h>
+#include "arm_itm_decode.h"
+#include "arm_tpiu_swo.h"
+#include "pc_histogram.h"
+
+#define ITM_SERVICE_NAME		"tpiu_swo_itm"
+
+#define ITM_STIMULUS_PORTS		32
+/* the exception trace has the channel after the stimulus ports */
+#define ITM_EXCEPTION_CHANNEL	ITM_STIMULUS_PORTS
+#define ITM_CHANNELS			(ITM_STIMULUS_PORTS + 1)
+#define ITM_CHANNEL_BUF_SIZE	4096
+/* files are flushed at most once in this interval */
+#define ITM_FLUSH_MS			100
+
+#define TPIU_FRAME_SIZE			16
+#define TPIU_FULL_SYNC			0xffffff7f
+/* trace bus ID given to the ITM by armv7m_trace_itm_config() */
+#define TPIU_DEFAULT_TRACE_ID	1
+
+/* timestamp and extension packets carry at most this many payload bytes */
+#define ITM_MAX_CONTINUATION	6
+
+/* DWT hardware source packets, from the discriminator in the header */
+#define DWT_ID_EVENT_COUNTER	0
+#define DWT_ID_EXCEPTION		1
+#define DWT_ID_PC_SAMPLE		2
+
+enum itm_decoder_state {
+	ITM_STATE_HEADER,
+	ITM_STATE_PAYLOAD,
+	ITM_STATE_CONTINUATION,
+};
+
+struct itm_connection {
+	struct list_head lh;
+	struct connection *connection;
+};
+
+/** A TCP port or a file receiving the data of a stimulus port */
+struct itm_channel {
+	char *destination;
+	FILE *file;
+	/** track TCP connections */
+	struct list_head connections;
+	uint8_t buf[ITM_CHANNEL_BUF_SIZE];
+	size_t len;
+	uint64_t bytes;
+	/** bytes not accepted by a TCP connection */
+	uint64_t dropped;
+};
+
+struct itm_priv_connection {
+	struct itm_channel *channel;
+};
+
+struct itm_decoder_stats {
+	uint64_t frames;
+	uint64_t stimulus_packets;
+	uint64_t pc_samples;
+	uint64_t sleep_samples;
+	uint64_t exceptions;
+	uint64_t other_hw_packets;
+	uint64_t timestamps;
+	uint64_t syncs;
+	uint64_t overflows;
+	uint64_t errors;
+};
+
+struct itm_decoder {
+	bool running;
+	/** where to send each channel, NULL when not decoded */
+	char *destination[ITM_CHANNELS];
+	bool pc_samples;
+	/** the open outputs, while running */
+	struct itm_channel *channels[ITM_CHANNELS];
+	int64_t flush_ms;
+
+	/* TPIU formatter */
+	bool formatter;
+	unsigned int trace_id;
+	unsigned int cur_id;
+	uint32_t sync;
+	uint8_t frame[TPIU_FRAME_SIZE];
+	unsigned int frame_len;
+
+	/* ITM packet being decoded */
+	enum itm_decoder_state state;
+	uint8_t header;
+	unsigned int need;
+	unsigned int got;
+	uint32_t payload;
+	unsigned int zeros;
+
+	struct pc_histogram hist;
+	int64_t hist_start_ms;
+	struct itm_decoder_stats stats;
+};
+
+static const char * const itm_exception_function[] = {
+	"reserved", "enter", "exit", "return",
+};
+
+static void itm_channel_flush(struct itm_channel *ch)
+{
+	struct itm_connection *c;
+
+	if (!ch->len)
+		return;
+
+	if (ch->file && fwrite(ch->buf, 1, ch->len, ch->file) != ch->len)
+		LOG_ERROR("Error writing ITM data to \"%s\"", ch->destination);
+
+	/* the sockets don't block: a client that can't keep up loses data */
+	list_for_each_entry(c, &ch->connections, lh) {
+		int retval = connection_write(c->connection, ch->buf, ch->len);
+		if (retval < (int)ch->len)
+			ch->dropped += ch->len - MAX(retval, 0);
+	}
+
+	ch->bytes += ch->len;
+	ch->len = 0;
+}
+
+static void itm_channel_put(struct itm_channel *ch, const uint8_t *data, size_t len)
+{
+	while (len) {
+		size_t n = MIN(len, ITM_CHANNEL_BUF_SIZE - ch->len);
+		memcpy(ch->buf + ch->len, data, n);
+		ch->len += n;
+		data += n;
+		len -= n;
+		if (ch->len == ITM_CHANNEL_BUF_SIZE)
+			itm_channel_flush(ch);
+	}
+}
+
+static int itm_service_new_connection(struct connection *connection)
+{
+	struct itm_priv_connection *priv = connection->service->priv;
+	struct itm_connection *c = malloc(sizeof(*c));
+	if (!c) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	c->connection = connection;
+	if (connection->service->type == CONNECTION_TCP)
+		socket_nonblock(connection->fd);
+	list_add_tail(&c->lh, &priv->channel->connections);
+	return ERROR_OK;
+}
+
+static int itm_service_input(struct connection *connection)
+{
+	/* read a dummy buffer to check if the connection is still active */
+	long dummy;
+	int bytes_read = connection_read(connection, &dummy, sizeof(dummy));
+
+	if (bytes_read == 0) {
+		return ERROR_SERVER_REMOTE_CLOSED;
+	} else if (bytes_read == -1) {
+		LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	return ERROR_OK;
+}
+
+static int itm_service_connection_closed(struct connection *connection)
+{
+	struct itm_priv_connection *priv = connection->service->priv;
+	struct itm_connection *c, *tmp;
+
+	list_for_each_entry_safe(c, tmp, &priv->channel->connections, lh)
+		if (c->connection == connection) {
+			list_del(&c->lh);
+			free(c);
+			return ERROR_OK;
+		}
+	LOG_ERROR("Failed to find connection to close!");
+	return ERROR_FAIL;
+}
+
+static const struct service_driver itm_service_driver = {
+	.name = ITM_SERVICE_NAME,
+	.new_connection_during_keep_alive_handler = NULL,
+	.new_connection_handler = itm_service_new_connection,
+	.input_handler = itm_service_input,
+	.connection_closed_handler = itm_service_connection_closed,
+	.keep_client_alive_handler = NULL,
+};
+
+static void itm_channel_close(struct itm_channel *ch)
+{
+	itm_channel_flush(ch);
+	if (ch->file)
+		fclose(ch->file);
+	else
+		remove_service(ITM_SERVICE_NAME, &ch->destination[1]);
+	free(ch->destination);
+	free(ch);
+}
+
+static struct itm_channel *itm_channel_open(const char *destination)
+{
+	struct itm_channel *ch = calloc(1, sizeof(*ch));
+	if (!ch) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+	INIT_LIST_HEAD(&ch->connections);
+	ch->destination = strdup(destination);
+	if (!ch->destination) {
+		LOG_ERROR("Out of memory");
+		free(ch);
+		return NULL;
+	}
+
+	if (destination[0] == ':') {
+		struct itm_priv_connection *priv = malloc(sizeof(*priv));
+		if (!priv) {
+			LOG_ERROR("Out of memory");
+			goto error;
+		}
+		priv->channel = ch;
+		if (add_service(&itm_service_driver, &destination[1],
+				CONNECTION_LIMIT_UNLIMITED, priv) != ERROR_OK) {
+			LOG_ERROR("Can't configure ITM TCP port %s", &destination[1]);
+			goto error;
+		}
+	} else {
+		ch->file = fopen(destination, "ab");
+		if (!ch->file) {
+			LOG_ERROR("Can't open ITM destination file \"%s\"", destination);
+			goto error;
+		}
+	}
+	return ch;
+
+error:
+	free(ch->destination);
+	free(ch);
+	return NULL;
+}
+
+static void itm_decoder_clear_histogram(struct itm_decoder *dec)
+{
+	pc_histogram_clear(&dec->hist);
+	dec->hist_start_ms = timeval_ms();
+}
+
+struct itm_decoder *itm_decoder_new(void)
+{
+	struct itm_decoder *dec = calloc(1, sizeof(*dec));
+	if (!dec)
+		return NULL;
+
+	dec->trace_id = TPIU_DEFAULT_TRACE_ID;
+	return dec;
+}
+
+void itm_decoder_free(struct itm_decoder *dec)
+{
+	if (!dec)
+		return;
+
+	itm_decoder_stop(dec);
+	for (unsigned int i = 0; i < ITM_CHANNELS; i++)
+		free(dec->destination[i]);
+	pc_histogram_clear(&dec->hist);
+	free(dec);
+}
+
+static bool itm_decoder_active(const struct itm_decoder *dec)
+{
+	if (dec->pc_samples)
+		return true;
+	for (unsigned int i = 0; i < ITM_CHANNELS; i++)
+		if (dec->destination[i])
+			return true;
+	return false;
+}
+
+static int itm_decoder_open_channel(struct itm_decoder *dec, unsigned int channel)
+{
+	if (dec->channels[channel]) {
+		itm_channel_close(dec->channels[channel]);
+		dec->channels[channel] = NULL;
+	}
+
+	if (!dec->running || !dec->destination[channel])
+		return ERROR_OK;
+
+	dec->channels[channel] = itm_channel_open(dec->destination[channel]);
+	return dec->channels[channel] ? ERROR_OK : ERROR_FAIL;
+}
+
+int itm_decoder_start(struct itm_decoder *dec, bool formatter)
+{
+	itm_decoder_stop(dec);
+
+	dec->formatter = formatter;
+	dec->cur_id = 0;
+	dec->sync = 0;
+	dec->frame_len = 0;
+	dec->state = ITM_STATE_HEADER;
+	dec->zeros = 0;
+	memset(&dec->stats, 0, sizeof(dec->stats));
+	itm_decoder_clear_histogram(dec);
+	dec->flush_ms = timeval_ms();
+
+	dec->running = true;
+	for (unsigned int i = 0; i < ITM_CHANNELS; i++) {
+		int retval = itm_decoder_open_channel(dec, i);
+		if (retval != ERROR_OK) {
+			itm_decoder_stop(dec);
+			return retval;
+		}
+	}
+	return ERROR_OK;
+}
+
+void itm_decoder_stop(struct itm_decoder *dec)
+{
+	dec->running = false;
+	for (unsigned int i = 0; i < ITM_CHANNELS; i++)
+		itm_decoder_open_channel(dec, i);
+}
+
+static void itm_decoder_exception(struct itm_decoder *dec)
+{
+	struct itm_channel *ch = dec->channels[ITM_EXCEPTION_CHANNEL];
+	char line[32];
+
+	dec->stats.exceptions++;
+	if (!ch)
+		return;
+
+	int len = snprintf(line, sizeof(line), "%s %" PRIu32 "\n",
+		itm_exception_function[(dec->payload >> 12) & 3], dec->payload & 0x1ff);
+	itm_channel_put(ch, (const uint8_t *)line, len);
+}
+
+/* a source packet, header and payload, has been received */
+static void itm_decoder_packet(struct itm_decoder *dec)
+{
+	unsigned int id = dec->header >> 3;
+
+	/* software source: ITM stimulus port */
+	if (!(dec->header & 0x04)) {
+		uint8_t data[4];
+
+		dec->stats.stimulus_packets++;
+		if (!dec->channels[id])
+			return;
+		h_u32_to_le(data, dec->payload);
+		itm_channel_put(dec->channels[id], data, dec->need);
+		return;
+	}
+
+	/* hardware source: DWT */
+	switch (id) {
+	case DWT_ID_EXCEPTION:
+		itm_decoder_exception(dec);
+		break;
+	case DWT_ID_PC_SAMPLE:
+		if (dec->need != 4) {
+			/* the core was sleeping */
+			dec->stats.sleep_samples++;
+			break;
+		}
+		dec->stats.pc_samples++;
+		if (dec->pc_samples)
+			pc_histogram_add(&dec->hist, dec->payload);
+		break;
+	default:
+		dec->stats.other_hw_packets++;
+	}
+}
+
+static void itm_decoder_header(struct itm_decoder *dec, uint8_t b)
+{
+	/* synchronization: at least 47 zero bits followed by a one */
+	if (!b) {
+		dec->zeros++;
+		return;
+	}
+	if (b == 0x80 && dec->zeros >= 5) {
+		dec->stats.syncs++;
+		dec->zeros = 0;
+		return;
+	}
+	dec->zeros = 0;
+	dec->header = b;
+	dec->got = 0;
+
+	if (b & 0x03) {
+		/* source packet with 1, 2 or 4 bytes of payload */
+		dec->need = (b & 0x03) == 3 ? 4 : (b & 0x03);
+		dec->payload = 0;
+		dec->state = ITM_STATE_PAYLOAD;
+	} else if (b == 0x70) {
+		dec->stats.overflows++;
+	} else if ((b & 0x8f) == 0x00) {
+		/* local timestamp, format 2 */
+		dec->stats.timestamps++;
+	} else if ((b & 0xcf) == 0xc0 || b == 0x94 || b == 0xb4) {
+		/* local timestamp, format 1, or global timestamp */
+		dec->stats.timestamps++;
+		dec->state = ITM_STATE_CONTINUATION;
+	} else if ((b & 0x0b) == 0x08) {
+		/* extension, e.g. the page of the following stimulus ports */
+		if (b & 0x80)
+			dec->state = ITM_STATE_CONTINUATION;
+	} else {
+		dec->stats.errors++;
+	}
+}
+
+static void itm_decoder_byte(struct itm_decoder *dec, uint8_t b)
+{
+	switch (dec->state) {
+	case ITM_STATE_HEADER:
+		itm_decoder_header(dec, b);
+		break;
+	case ITM_STATE_PAYLOAD:
+		dec->payload |= (uint32_t)b << (8 * dec->got);
+		if (++dec->got == dec->need) {
+			itm_decoder_packet(dec);
+			dec->state = ITM_STATE_HEADER;
+		}
+		break;
+	case ITM_STATE_CONTINUATION:
+		if (!(b & 0x80) || ++dec->got == ITM_MAX_CONTINUATION)
+			dec->state = ITM_STATE_HEADER;
+		break;
+	}
+}
+
+/*
+ * Most of the stream is usually text written one byte at a time to a single
+ * stimulus port: header and data byte alternate. Handle runs of such packets
+ * eight bytes at a time, and return the number of bytes consumed.
+ */
+static size_t itm_decoder_fast_path(struct itm_decoder *dec, const uint8_t *buf, size_t size)
+{
+	uint8_t header = buf[0];
+
+	/* software source packet with one byte of payload */
+	if ((header & 0x07) != 0x01)
+		return 0;
+
+	struct itm_channel *ch = dec->channels[header >> 3];
+	const uint64_t mask = 0x00ff00ff00ff00ffull;
+	const uint64_t pattern = header * 0x0001000100010001ull;
+	size_t done = 0;
+
+	while (size - done >= 8 && (le_to_h_u64(buf + done) & mask) == pattern) {
+		if (ch) {
+			const uint8_t data[4] = {
+				buf[done + 1], buf[done + 3], buf[done + 5], buf[done + 7]
+			};
+			itm_channel_put(ch, data, sizeof(data));
+		}
+		done += 8;
+	}
+
+	dec->stats.stimulus_packets += done / 2;
+	if (done)
+		dec->zeros = 0;
+	return done;
+}
+
+static void itm_decoder_packets(struct itm_decoder *dec, const uint8_t *buf, size_t size)
+{
+	size_t i = 0;
+
+	while (i < size) {
+		if (dec->state == ITM_STATE_HEADER) {
+			i += itm_decoder_fast_path(dec, buf + i, size - i);
+			if (i == size)
+				break;
+		}
+		itm_decoder_byte(dec, buf[i++]);
+	}
+}
+
+/*
+ * A formatter frame has 16 bytes. The even bytes are either an ID change,
+ * with bit 0 set, or data whose bit 0 is in the last byte of the frame. The
+ * odd bytes are always data.
+ */
+static void itm_decoder_frame(struct itm_decoder *dec)
+{
+	const uint8_t *frame = dec->frame;
+	uint8_t aux = frame[TPIU_FRAME_SIZE - 1];
+	uint8_t data[TPIU_FRAME_SIZE - 1];
+	size_t len = 0;
+
+	dec->stats.frames++;
+
+	for (unsigned int i = 0; i < TPIU_FRAME_SIZE / 2; i++) {
+		uint8_t b = frame[2 * i];
+		bool aux_bit = aux & BIT(i);
+		bool last = (i == TPIU_FRAME_SIZE / 2 - 1);
+
+		if (b & 1) {
+			/* with the aux bit set, the next byte still has the old ID */
+			if (aux_bit && !last) {
+				if (dec->cur_id == dec->trace_id)
+					data[len++] = frame[2 * i + 1];
+				dec->cur_id = b >> 1;
+				continue;
+			}
+			dec->cur_id = b >> 1;
+		} else if (dec->cur_id == dec->trace_id) {
+			data[len++] = (b & 0xfe) | aux_bit;
+		}
+
+		if (!last && dec->cur_id == dec->trace_id)
+			data[len++] = frame[2 * i + 1];
+	}
+
+	itm_decoder_packets(dec, data, len);
+}
+
+static void itm_decoder_deframe(struct itm_decoder *dec, const uint8_t *buf, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		dec->sync = (dec->sync << 8) | buf[i];
+		if (dec->sync == TPIU_FULL_SYNC) {
+			/* the next frame starts after a full synchronization packet */
+			dec->frame_len = 0;
+			continue;
+		}
+
+		dec->frame[dec->frame_len++] = buf[i];
+		if (dec->frame_len == TPIU_FRAME_SIZE) {
+			itm_decoder_frame(dec);
+			dec->frame_len = 0;
+		}
+	}
+}
+
+void itm_decoder_feed(struct itm_decoder *dec, const uint8_t *buf, size_t size)
+{
+	if (!dec->running || !itm_decoder_active(dec))
+		return;
+
+	if (dec->formatter)
+		itm_decoder_deframe(dec, buf, size);
+	else
+		itm_decoder_packets(dec, buf, size);
+
+	for (unsigned int i = 0; i < ITM_CHANNELS; i++)
+		if (dec->channels[i])
+			itm_channel_flush(dec->channels[i]);
+
+	int64_t now = timeval_ms();
+	if (now - dec->flush_ms < ITM_FLUSH_MS)
+		return;
+	dec->flush_ms = now;
+	for (unsigned int i = 0; i < ITM_CHANNELS; i++)
+		if (dec->channels[i] && dec->channels[i]->file)
+			fflush(dec->channels[i]->file);
+}
+
+static int itm_decoder_set_destination(struct command_invocation *cmd,
+		struct itm_decoder *dec, unsigned int channel, const char *destination)
+{
+	char *s = NULL;
+
+	if (strcmp(destination, "off")) {
+		s = strdup(destination);
+		if (!s) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+	}
+
+	free(dec->destination[channel]);
+	dec->destination[channel] = s;
+
+	int retval = itm_decoder_open_channel(dec, channel);
+	if (retval != ERROR_OK)
+		command_print(cmd, "Can't open %s", destination);
+	return retval;
+}
+
+COMMAND_HANDLER(handle_itm_decoder_stimulus)
+{
+	struct itm_decoder *dec = arm_tpiu_swo_decoder(CMD_DATA);
+	unsigned int port;
+
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], port);
+	if (port >= ITM_STIMULUS_PORTS) {
+		command_print(CMD, "Invalid stimulus port %u", port);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (CMD_ARGC == 2)
+		return itm_decoder_set_destination(CMD, dec, port, CMD_ARGV[1]);
+
+	command_print(CMD, "%s", dec->destination[port] ? dec->destination[port] : "off");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_itm_decoder_exceptions)
+{
+	struct itm_decoder *dec = arm_tpiu_swo_decoder(CMD_DATA);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		return itm_decoder_set_destination(CMD, dec, ITM_EXCEPTION_CHANNEL, CMD_ARGV[0]);
+
+	const char *destination = dec->destination[ITM_EXCEPTION_CHANNEL];
+	command_print(CMD, "%s", destination ? destination : "off");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_itm_decoder_pc_samples)
+{
+	struct itm_decoder *dec = arm_tpiu_swo_decoder(CMD_DATA);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], dec->pc_samples);
+		itm_decoder_clear_histogram(dec);
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "%s", dec->pc_samples ? "on" : "off");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_itm_decoder_trace_id)
+{
+	struct itm_decoder *dec = arm_tpiu_swo_decoder(CMD_DATA);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int id;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], id);
+		if (id < 1 || id > 0x6f) {
+			command_print(CMD, "Invalid trace ID %u", id);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		dec->trace_id = id;
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "%u", dec->trace_id);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_itm_decoder_gmon)
+{
+	struct itm_decoder *dec = arm_tpiu_swo_decoder(CMD_DATA);
+	uint32_t start_address = 0;
+	uint32_t end_address = 0;
+	bool with_range = false;
+
+	if (CMD_ARGC != 1 && CMD_ARGC != 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 3) {
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], start_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], end_address);
+		if (end_address < start_address) {
+			command_print(CMD, "Invalid address range");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		with_range = true;
+	}
+
+	uint32_t duration_ms = timeval_ms() - dec->hist_start_ms;
+	int retval = pc_histogram_write_gmon(&dec->hist, CMD_ARGV[0], with_range,
+		start_address, end_address, get_current_target(CMD_CTX), duration_ms);
+	if (retval != ERROR_OK)
+		return retval;
+
+	command_print(CMD, "Wrote %s", CMD_ARGV[0]);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_itm_decoder_stats)
+{
+	struct itm_decoder *dec = arm_tpiu_swo_decoder(CMD_DATA);
+	const struct itm_decoder_stats *stats = &dec->stats;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (dec->formatter)
+		command_print(CMD, "formatter frames: %" PRIu64, stats->frames);
+	command_print(CMD, "stimulus packets: %" PRIu64, stats->stimulus_packets);
+	command_print(CMD, "PC samples:       %" PRIu64 " (%" PRIu64 " sleeping, %" PRIu32 " distinct PCs)",
+		stats->pc_samples, stats->sleep_samples, dec->hist.used);
+	command_print(CMD, "exceptions:       %" PRIu64, stats->exceptions);
+	command_print(CMD, "other DWT:        %" PRIu64, stats->other_hw_packets);
+	command_print(CMD, "timestamps:       %" PRIu64, stats->timestamps);
+	command_print(CMD, "syncs:            %" PRIu64, stats->syncs);
+	command_print(CMD, "overflows:        %" PRIu64, stats->overflows);
+	command_print(CMD, "invalid headers:  %" PRIu64, stats->errors);
+
+	for (unsigned int i = 0; i < ITM_CHANNELS; i++) {
+		struct itm_channel *ch = dec->channels[i];
+		if (!ch)
+			continue;
+		if (i == ITM_EXCEPTION_CHANNEL)
+			command_print_sameline(CMD, "exceptions");
+		else
+			command_print_sameline(CMD, "port %u", i);
+		command_print(CMD, " -> %s: %" PRIu64 " bytes, %" PRIu64 " dropped",
+			ch->destination, ch->bytes, ch->dropped);
+	}
+
+	return ERROR_OK;
+}
+
+const struct command_registration itm_decoder_command_handlers[] = {
+	{
+		.name = "stimulus",
+		.mode = COMMAND_ANY,
+		.handler = handle_itm_decoder_stimulus,
+		.help = "Send the data of an ITM stimulus port to a TCP port or a file",
+		.usage = "port [(:tcp_port|filename|off)]",
+	},
+	{
+		.name = "exceptions",
+		.mode = COMMAND_ANY,
+		.handler = handle_itm_decoder_exceptions,
+		.help = "Send the DWT exception trace, as text, to a TCP port or a file",
+		.usage = "[(:tcp_port|filename|off)]",
+	},
+	{
+		.name = "pc-samples",
+		.mode = COMMAND_ANY,
+		.handler = handle_itm_decoder_pc_samples,
+		.help = "Collect the DWT PC samples in a histogram",
+		.usage = "[(on|off)]",
+	},
+	{
+		.name = "trace-id",
+		.mode = COMMAND_ANY,
+		.handler = handle_itm_decoder_trace_id,
+		.help = "Trace ID of the ITM in the TPIU formatter frames",
+		.usage = "[id]",
+	},
+	{
+		.name = "gmon",
+		.mode = COMMAND_EXEC,
+		.handler = handle_itm_decoder_gmon,
+		.help = "Write the PC sample histogram in gmon.out format",
+		.usage = "filename [start end]",
+	},
+	{
+		.name = "stats",
+		.mode = COMMAND_EXEC,
+		.handler = handle_itm_decoder_stats,
+		.help = "Displays the ITM decoder statistics",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_ARM_ITM_DECODE_H
+#define OPENOCD_TARGET_ARM_ITM_DECODE_H
+
+#include <helper/command.h>
+
+/**
+ * @file
+ * Host side decoder of the ITM/DWT packet stream captured through a
+ * TPIU/SWO. It removes the TPIU formatter framing, sends the data of each
+ * ITM stimulus port and the exception trace to their own TCP port or file,
+ * and collects the DWT PC samples in a histogram.
+ */
+
+struct itm_decoder;
+
+struct itm_decoder *itm_decoder_new(void);
+void itm_decoder_free(struct itm_decoder *dec);
+
+/**
+ * Start decoding, when the trace capture is enabled: reset the decoder
+ * state and open the outputs.
+ * @param formatter the TPIU formatter is enabled and the ITM data has to
+ * be extracted from its frames.
+ */
+int itm_decoder_start(struct itm_decoder *dec, bool formatter);
+
+/** Stop decoding and close the TCP ports and the files of the outputs. */
+void itm_decoder_stop(struct itm_decoder *dec);
+
+/** Decode a chunk of the captured trace stream. */
+void itm_decoder_feed(struct itm_decoder *dec, const uint8_t *buf, size_t size);
+
+/**
+ * Commands of the decoder, chained under each TPIU/SWO object. The
+ * command data is the TPIU/SWO object.
+ */
+extern const struct command_registration itm_decoder_command_handlers[];
+
+#endif /* OPENOCD_TARGET_ARM_ITM_DECODE_H */
@@ -30,12 +30,14 @@
 #include <helper/jim-nvp.h>
 #include <helper/list.h>
 #include <helper/log.h>
+#include <helper/time_support.h>
 #include <helper/types.h>
 #include <jtag/interface.h>
 #include <server/server.h>
 #include <target/arm_adi_v5.h>
 #include <target/target.h>
 #include <transport/transport.h>
+#include "arm_itm_decode.h"
 #include "arm_tpiu_swo.h"
 
 /* START_DEPRECATED_TPIU */
@@ -113,6 +115,24 @@ struct arm_tpiu_swo_object {
 	char *out_filename;
 	/** track TCP connections */
 	struct list_head connections;
+	/** id given to the next TCP connection */
+	unsigned int next_connection_id;
+	/** captured trace data, kept until all the TCP connections received it */
+	uint8_t *ring;
+	/** bytes captured since enable, the ring write position */
+	uint64_t ring_head;
+	/** largest amount of captured data not yet sent to a TCP connection */
+	uint64_t ring_peak;
+	/** adapter polls that returned trace data */
+	uint64_t polls;
+	/** bytes dropped by TCP connections that could not keep up */
+	uint64_t dropped;
+	/** bytes written to, and flushed to, the output file */
+	uint64_t file_bytes;
+	uint64_t file_flushed;
+	int64_t file_flush_ms;
+	/** decoder of the ITM/DWT packets in the captured data */
+	struct itm_decoder *decoder;
 	/* START_DEPRECATED_TPIU */
 	bool recheck_ap_cur_target;
 	/* END_DEPRECATED_TPIU */
@@ -121,6 +141,12 @@ struct arm_tpiu_swo_object {
 struct arm_tpiu_swo_connection {
 	struct list_head lh;
 	struct connection *connection;
+	unsigned int id;
+	/** ring position of the next byte to send */
+	uint64_t pos;
+	uint64_t sent;
+	uint64_t dropped;
+	bool lagging;
 };
 
 struct arm_tpiu_swo_priv_connection {
@@ -129,36 +155,124 @@ struct arm_tpiu_swo_priv_connection {
 
 static LIST_HEAD(all_tpiu_swo);
 
-#define ARM_TPIU_SWO_TRACE_BUF_SIZE	4096
+/* the ring is indexed with the free running byte count, size must be a power of 2 */
+#define ARM_TPIU_SWO_RING_SIZE		(256 * 1024)
+#define ARM_TPIU_SWO_RING_MASK		(ARM_TPIU_SWO_RING_SIZE - 1)
+/* largest single read from the adapter */
+#define ARM_TPIU_SWO_POLL_MAX		(64 * 1024)
+/* the output file is flushed at most once in this interval */
+#define ARM_TPIU_SWO_FLUSH_MS		100
+
+static bool arm_tpiu_swo_write_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/*
+ * Send to a client what it has not received yet. A client that falls more
+ * than the ring size behind loses the oldest data; a client whose socket is
+ * full is simply left behind until the next poll.
+ */
+static void arm_tpiu_swo_feed_connection(struct arm_tpiu_swo_object *obj,
+		struct arm_tpiu_swo_connection *c)
+{
+	uint64_t lag = obj->ring_head - c->pos;
+
+	if (lag > ARM_TPIU_SWO_RING_SIZE) {
+		uint64_t lost = lag - ARM_TPIU_SWO_RING_SIZE;
+		if (!c->lagging)
+			LOG_WARNING("%s: trace client %u too slow, dropping data",
+				obj->name, c->id);
+		c->lagging = true;
+		c->dropped += lost;
+		obj->dropped += lost;
+		c->pos += lost;
+	}
+
+	while (c->pos != obj->ring_head) {
+		size_t offset = c->pos & ARM_TPIU_SWO_RING_MASK;
+		size_t len = MIN(obj->ring_head - c->pos, ARM_TPIU_SWO_RING_SIZE - offset);
+
+		int retval = connection_write(c->connection, obj->ring + offset, len);
+		if (retval <= 0) {
+			if (retval < 0 && !arm_tpiu_swo_write_would_block())
+				LOG_DEBUG("%s: error writing to trace client %u", obj->name, c->id);
+			return;
+		}
+		c->pos += retval;
+		c->sent += retval;
+	}
+
+	if (c->lagging)
+		LOG_INFO("%s: trace client %u caught up", obj->name, c->id);
+	c->lagging = false;
+}
 
 static int arm_tpiu_swo_poll_trace(void *priv)
 {
 	struct arm_tpiu_swo_object *obj = priv;
-	uint8_t buf[ARM_TPIU_SWO_TRACE_BUF_SIZE];
-	size_t size = sizeof(buf);
 	struct arm_tpiu_swo_connection *c;
+	size_t total = 0;
+	int retval;
 
-	int retval = adapter_poll_trace(buf, &size);
-	if (retval != ERROR_OK || !size)
-		return retval;
+	/* read straight into the ring, then hand the same bytes to the consumers */
+	do {
+		size_t offset = obj->ring_head & ARM_TPIU_SWO_RING_MASK;
+		size_t room = MIN(ARM_TPIU_SWO_RING_SIZE - offset, ARM_TPIU_SWO_POLL_MAX);
+		size_t size = room;
+		uint8_t *buf = obj->ring + offset;
 
-	target_call_trace_callbacks(/*target*/NULL, size, buf);
+		retval = adapter_poll_trace(buf, &size);
+		if (retval != ERROR_OK || !size)
+			break;
 
-	if (obj->file) {
-		if (fwrite(buf, 1, size, obj->file) == size) {
+		obj->ring_head += size;
+		obj->polls++;
+		total += size;
+
+		target_call_trace_callbacks(/*target*/NULL, size, buf);
+
+		if (obj->file) {
+			if (fwrite(buf, 1, size, obj->file) != size) {
+				LOG_ERROR("Error writing to the SWO trace destination file");
+				return ERROR_FAIL;
+			}
+			obj->file_bytes += size;
+		}
+
+		itm_decoder_feed(obj->decoder, buf, size);
+
+		/* a full read may have left more data in the adapter */
+		if (size < room)
+			break;
+	} while (total < ARM_TPIU_SWO_RING_SIZE / 2);
+
+	if (obj->file && obj->file_bytes != obj->file_flushed) {
+		int64_t now = timeval_ms();
+		if (now - obj->file_flush_ms >= ARM_TPIU_SWO_FLUSH_MS) {
 			fflush(obj->file);
-		} else {
-			LOG_ERROR("Error writing to the SWO trace destination file");
-			return ERROR_FAIL;
+			obj->file_flushed = obj->file_bytes;
+			obj->file_flush_ms = now;
 		}
 	}
 
-	if (obj->out_filename && obj->out_filename[0] == ':')
-		list_for_each_entry(c, &obj->connections, lh)
-			if (connection_write(c->connection, buf, size) != (int)size)
-				LOG_ERROR("Error writing to connection"); /* FIXME: which connection? */
+	size_t occupancy = 0;
+	list_for_each_entry(c, &obj->connections, lh) {
+		arm_tpiu_swo_feed_connection(obj, c);
+		occupancy = MAX(occupancy, obj->ring_head - c->pos);
+	}
+	obj->ring_peak = MAX(obj->ring_peak, occupancy);
 
-	return ERROR_OK;
+	return retval;
+}
+
+struct itm_decoder *arm_tpiu_swo_decoder(struct arm_tpiu_swo_object *obj)
+{
+	return obj->decoder;
 }
 
 static void arm_tpiu_swo_handle_event(struct arm_tpiu_swo_object *obj, enum arm_tpiu_swo_event event)
@@ -203,6 +317,9 @@ static void arm_tpiu_swo_close_output(struct arm_tpiu_swo_object *obj)
 	}
 	if (obj->out_filename && obj->out_filename[0] == ':')
 		remove_service(TCP_SERVICE_NAME, &obj->out_filename[1]);
+	itm_decoder_stop(obj->decoder);
+	free(obj->ring);
+	obj->ring = NULL;
 }
 
 int arm_tpiu_swo_cleanup_all(void)
@@ -237,6 +354,7 @@ int arm_tpiu_swo_cleanup_all(void)
 		if (obj->ap)
 			dap_put_ap(obj->ap);
 
+		itm_decoder_free(obj->decoder);
 		free(obj->name);
 		free(obj->out_filename);
 		free(obj);
@@ -255,7 +373,16 @@ static int arm_tpiu_swo_service_new_connection(struct connection *connection)
 		return ERROR_FAIL;
 	}
 	c->connection = connection;
-	list_add(&c->lh, &obj->connections);
+	c->id = obj->next_connection_id++;
+	/* a new client gets the trace data from now on */
+	c->pos = obj->ring_head;
+	c->sent = 0;
+	c->dropped = 0;
+	c->lagging = false;
+	/* a slow client must not stall the adapter polling */
+	if (connection->service->type == CONNECTION_TCP)
+		socket_nonblock(connection->fd);
+	list_add_tail(&c->lh, &obj->connections);
 	return ERROR_OK;
 }
 
@@ -706,10 +833,24 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_enable)
 	unsigned int swo_pin_freq = obj->swo_pin_freq; /* could be replaced */
 
 	if (obj->out_filename && strcmp(obj->out_filename, "external") && obj->out_filename[0]) {
+		obj->ring = malloc(ARM_TPIU_SWO_RING_SIZE);
+		if (!obj->ring) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		obj->ring_head = 0;
+		obj->ring_peak = 0;
+		obj->polls = 0;
+		obj->dropped = 0;
+		obj->file_bytes = 0;
+		obj->file_flushed = 0;
+		obj->file_flush_ms = timeval_ms();
+
 		if (obj->out_filename[0] == ':') {
 			struct arm_tpiu_swo_priv_connection *priv = malloc(sizeof(*priv));
 			if (!priv) {
 				LOG_ERROR("Out of memory");
+				arm_tpiu_swo_close_output(obj);
 				return ERROR_FAIL;
 			}
 			priv->obj = obj;
@@ -718,16 +859,25 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_enable)
 				CONNECTION_LIMIT_UNLIMITED, priv);
 			if (retval != ERROR_OK) {
 				command_print(CMD, "Can't configure trace TCP port %s", &obj->out_filename[1]);
+				arm_tpiu_swo_close_output(obj);
 				return retval;
 			}
 		} else if (strcmp(obj->out_filename, "-")) {
 			obj->file = fopen(obj->out_filename, "ab");
 			if (!obj->file) {
 				command_print(CMD, "Can't open trace destination file \"%s\"", obj->out_filename);
+				arm_tpiu_swo_close_output(obj);
 				return ERROR_FAIL;
 			}
 		}
 
+		retval = itm_decoder_start(obj->decoder, obj->en_formatter);
+		if (retval != ERROR_OK) {
+			command_print(CMD, "Can't start the ITM decoder");
+			arm_tpiu_swo_close_output(obj);
+			return retval;
+		}
+
 		retval = adapter_config_trace(true, obj->pin_protocol, obj->port_width,
 			&swo_pin_freq, obj->traceclkin_freq, &prescaler);
 		if (retval != ERROR_OK) {
@@ -853,6 +1003,30 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_disable)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_arm_tpiu_swo_stats)
+{
+	struct arm_tpiu_swo_object *obj = CMD_DATA;
+	struct arm_tpiu_swo_connection *c;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	command_print(CMD, "captured %" PRIu64 " bytes in %" PRIu64 " polls",
+		obj->ring_head, obj->polls);
+	command_print(CMD, "ring buffer %u bytes, peak occupancy %" PRIu64 " bytes",
+		ARM_TPIU_SWO_RING_SIZE, obj->ring_peak);
+	command_print(CMD, "dropped %" PRIu64 " bytes", obj->dropped);
+	if (obj->file)
+		command_print(CMD, "file %s: written %" PRIu64 " bytes",
+			obj->out_filename, obj->file_bytes);
+	list_for_each_entry(c, &obj->connections, lh)
+		command_print(CMD, "client %u: sent %" PRIu64 " bytes, dropped %" PRIu64
+			" bytes, pending %" PRIu64 " bytes",
+			c->id, c->sent, c->dropped, obj->ring_head - c->pos);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration arm_tpiu_swo_instance_command_handlers[] = {
 	{
 		.name = "configure",
@@ -889,6 +1063,20 @@ static const struct command_registration arm_tpiu_swo_instance_command_handlers[
 		.usage = "",
 		.help = "Disables the TPIU/SWO output",
 	},
+	{
+		.name = "stats",
+		.mode = COMMAND_EXEC,
+		.handler = handle_arm_tpiu_swo_stats,
+		.usage = "",
+		.help = "Displays the trace capture statistics",
+	},
+	{
+		.name = "decode",
+		.mode = COMMAND_ANY,
+		.help = "ITM/DWT decoder command group",
+		.usage = "",
+		.chain = itm_decoder_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -944,6 +1132,12 @@ static int jim_arm_tpiu_swo_create(Jim_Interp *interp, int argc, Jim_Obj *const
 		return JIM_ERR;
 	}
 	INIT_LIST_HEAD(&obj->connections);
+	obj->decoder = itm_decoder_new();
+	if (!obj->decoder) {
+		LOG_ERROR("Out of memory");
+		free(obj);
+		return JIM_ERR;
+	}
 	adiv5_mem_ap_spot_init(&obj->spot);
 	obj->spot.base = TPIU_SWO_DEFAULT_BASE;
 	obj->port_width = 1;
@@ -953,6 +1147,7 @@ static int jim_arm_tpiu_swo_create(Jim_Interp *interp, int argc, Jim_Obj *const
 	obj->name = strdup(Jim_GetString(n, NULL));
 	if (!obj->name) {
 		LOG_ERROR("Out of memory");
+		itm_decoder_free(obj->decoder);
 		free(obj);
 		return JIM_ERR;
 	}
@@ -975,6 +1170,7 @@ static int jim_arm_tpiu_swo_create(Jim_Interp *interp, int argc, Jim_Obj *const
 	return JIM_OK;
 
 err_exit:
+	itm_decoder_free(obj->decoder);
 	free(obj->name);
 	free(obj->out_filename);
 	free(obj);
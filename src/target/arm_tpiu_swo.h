@@ -18,4 +18,10 @@ extern const struct command_registration arm_tpiu_deprecated_command_handlers[];
 int arm_tpiu_swo_register_commands(struct command_context *cmd_ctx);
 int arm_tpiu_swo_cleanup_all(void);
 
+struct arm_tpiu_swo_object;
+struct itm_decoder;
+
+/** The ITM/DWT decoder of a TPIU/SWO object. */
+struct itm_decoder *arm_tpiu_swo_decoder(struct arm_tpiu_swo_object *obj);
+
 #endif /* OPENOCD_TARGET_ARM_TPIU_SWO_H */
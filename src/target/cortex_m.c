@@ -432,18 +432,33 @@ static int cortex_m_store_core_reg_u32(struct target *target,
 	return retval;
 }
 
-static int cortex_m_write_debug_halt_mask(struct target *target,
-	uint32_t mask_on, uint32_t mask_off)
+/* Add the write of the DHCSR debug halt mask to a request list */
+static int cortex_m_queue_debug_halt_mask(struct target *target,
+	struct mem_ap_request_list *list, uint32_t mask_on, uint32_t mask_off)
 {
 	struct cortex_m_common *cortex_m = target_to_cm(target);
-	struct armv7m_common *armv7m = &cortex_m->armv7m;
 
 	/* mask off status bits */
 	cortex_m->dcb_dhcsr &= ~((0xFFFFul << 16) | mask_off);
 	/* create new register mask */
 	cortex_m->dcb_dhcsr |= DBGKEY | C_DEBUGEN | mask_on;
 
-	return mem_ap_write_atomic_u32(armv7m->debug_ap, DCB_DHCSR, cortex_m->dcb_dhcsr);
+	return mem_ap_request_write_u32(list, DCB_DHCSR, cortex_m->dcb_dhcsr);
+}
+
+static int cortex_m_write_debug_halt_mask(struct target *target,
+	uint32_t mask_on, uint32_t mask_off)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct mem_ap_request_list list;
+
+	mem_ap_request_list_init(&list, armv7m->debug_ap);
+
+	int retval = cortex_m_queue_debug_halt_mask(target, &list, mask_on, mask_off);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return mem_ap_request_list_run(&list);
 }
 
 static int cortex_m_set_maskints(struct target *target, bool mask)
@@ -527,18 +542,25 @@ static int cortex_m_clear_halt(struct target *target)
 {
 	struct cortex_m_common *cortex_m = target_to_cm(target);
 	struct armv7m_common *armv7m = &cortex_m->armv7m;
+	struct mem_ap_request_list list;
 	int retval;
 
+	mem_ap_request_list_init(&list, armv7m->debug_ap);
+
 	/* clear step if any */
-	cortex_m_write_debug_halt_mask(target, C_HALT, C_STEP);
+	retval = cortex_m_queue_debug_halt_mask(target, &list, C_HALT, C_STEP);
 
 	/* Read Debug Fault Status Register */
-	retval = mem_ap_read_atomic_u32(armv7m->debug_ap, NVIC_DFSR, &cortex_m->nvic_dfsr);
+	if (retval == ERROR_OK)
+		retval = mem_ap_request_read_u32(&list, NVIC_DFSR, &cortex_m->nvic_dfsr);
+	if (retval == ERROR_OK)
+		retval = mem_ap_request_list_run(&list);
 	if (retval != ERROR_OK)
 		return retval;
 
-	/* Clear Debug Fault Status */
-	retval = mem_ap_write_atomic_u32(armv7m->debug_ap, NVIC_DFSR, cortex_m->nvic_dfsr);
+	/* Clear Debug Fault Status. The write is flushed by the next DAP run,
+	 * which saves one when halt is processed */
+	retval = mem_ap_write_u32(armv7m->debug_ap, NVIC_DFSR, cortex_m->nvic_dfsr);
 	if (retval != ERROR_OK)
 		return retval;
 	LOG_TARGET_DEBUG(target, "NVIC_DFSR 0x%" PRIx32 "", cortex_m->nvic_dfsr);
@@ -906,7 +928,6 @@ static int cortex_m_poll_one(struct target *target)
 	 */
 	if (cortex_m->dcb_dhcsr & S_LOCKUP) {
 		LOG_TARGET_ERROR(target, "clearing lockup after double fault");
-		cortex_m_write_debug_halt_mask(target, C_HALT, 0);
 		target->debug_reason = DBG_REASON_DBGRQ;
 
 		/* We have to execute the rest (the "finally" equivalent, but
@@ -914,10 +935,17 @@ static int cortex_m_poll_one(struct target *target)
 		 */
 		detected_failure = ERROR_FAIL;
 
-		/* refresh status bits */
-		retval = cortex_m_read_dhcsr_atomic_sticky(target);
+		/* halt and refresh status bits in one go */
+		struct mem_ap_request_list list;
+		mem_ap_request_list_init(&list, armv7m->debug_ap);
+		retval = cortex_m_queue_debug_halt_mask(target, &list, C_HALT, 0);
+		if (retval == ERROR_OK)
+			retval = mem_ap_request_read_u32(&list, DCB_DHCSR, &cortex_m->dcb_dhcsr);
+		if (retval == ERROR_OK)
+			retval = mem_ap_request_list_run(&list);
 		if (retval != ERROR_OK)
 			return retval;
+		cortex_m_cumulate_dhcsr_sticky(cortex_m, cortex_m->dcb_dhcsr);
 	}
 
 	if (cortex_m->dcb_dhcsr_cumulated_sticky & S_RESET_ST) {
@@ -2210,11 +2238,46 @@ void cortex_m_deinit_target(struct target *target)
 	free(cortex_m);
 }
 
+/* PCSR reads queued before each run of the DAP queue */
+#define CORTEX_M_PCSR_BATCH		1024
+
+int cortex_m_sample_pc(struct target *target, uint32_t *samples,
+			      uint32_t max_num_samples, uint32_t *num_samples)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	uint32_t count = MIN(max_num_samples, CORTEX_M_PCSR_BATCH);
+	int retval;
+
+	*num_samples = 0;
+	if (!count)
+		return ERROR_OK;
+
+	if (armv7m->debug_ap) {
+		retval = mem_ap_read_buf_noincr(armv7m->debug_ap, (uint8_t *)samples,
+					4, count, DWT_PCSR);
+		if (retval != ERROR_OK)
+			return retval;
+		for (uint32_t i = 0; i < count; i++)
+			samples[i] = target_buffer_get_u32(target, (uint8_t *)&samples[i]);
+	} else {
+		count = 1;
+		retval = target_read_u32(target, DWT_PCSR, &samples[0]);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* PCSR is RAZ when PC sampling is not implemented */
+	if (!samples[0])
+		return ERROR_NOT_IMPLEMENTED;
+
+	*num_samples = count;
+	return ERROR_OK;
+}
+
 int cortex_m_profiling(struct target *target, uint32_t *samples,
 			      uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
 	struct timeval timeout, now;
-	struct armv7m_common *armv7m = target_to_armv7m(target);
 	uint32_t reg_value;
 	int retval;
 
@@ -2246,18 +2309,11 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 	uint32_t sample_count = 0;
 
 	for (;;) {
-		if (armv7m && armv7m->debug_ap) {
-			uint32_t read_count = max_num_samples - sample_count;
-			if (read_count > 1024)
-				read_count = 1024;
-
-			retval = mem_ap_read_buf_noincr(armv7m->debug_ap,
-						(void *)&samples[sample_count],
-						4, read_count, DWT_PCSR);
-			sample_count += read_count;
-		} else {
-			target_read_u32(target, DWT_PCSR, &samples[sample_count++]);
-		}
+		uint32_t read_count;
+
+		retval = cortex_m_sample_pc(target, &samples[sample_count],
+					max_num_samples - sample_count, &read_count);
+		sample_count += read_count;
 
 		if (retval != ERROR_OK) {
 			LOG_TARGET_ERROR(target, "Error while reading PCSR");
@@ -3116,4 +3172,5 @@ struct target_type cortexm_target = {
 	.deinit_target = cortex_m_deinit_target,
 
 	.profiling = cortex_m_profiling,
+	.sample_pc = cortex_m_sample_pc,
 };
@@ -333,5 +333,7 @@ void cortex_m_enable_watchpoints(struct target *target);
 void cortex_m_deinit_target(struct target *target);
 int cortex_m_profiling(struct target *target, uint32_t *samples,
 	uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
+int cortex_m_sample_pc(struct target *target, uint32_t *samples,
+	uint32_t max_num_samples, uint32_t *num_samples);
 
 #endif /* OPENOCD_TARGET_CORTEX_M_H */
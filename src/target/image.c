@@ -24,6 +24,10 @@
 #include "image.h"
 #include "target.h"
 #include <helper/log.h>
+#include <helper/crc32.h>
+
+/* Amount of data checksummed between calls to keep_alive() */
+#define IMAGE_CHECKSUM_CHUNK	(256 * 1024)
 
 /* convert ELF header field to host endianness */
 #define field16(elf, field) \
@@ -118,6 +122,29 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
+static int image_hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* @returns the byte written as two hex digits at @a s, or -1 if they aren't */
+static int image_hex_byte(const char *s)
+{
+	int hi = image_hex_digit(s[0]);
+	if (hi < 0)
+		return -1;
+	int lo = image_hex_digit(s[1]);
+	if (lo < 0)
+		return -1;
+	return (hi << 4) | lo;
+}
+
 static int image_ihex_buffer_complete_inner(struct image *image,
 	char *lpsz_line,
 	struct imagesection *section)
@@ -138,6 +165,10 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 		return retval;
 
 	ihex->buffer = malloc(filesize >> 1);
+	if (!ihex->buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	cooked_bytes = 0x0;
 	image->num_sections = 0;
 
@@ -194,8 +225,9 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 				}
 
 				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
+					int value = image_hex_byte(&lpsz_line[bytes_read]);
+					if (value < 0)
+						return ERROR_IMAGE_FORMAT_ERROR;
 					ihex->buffer[cooked_bytes] = (uint8_t)value;
 					cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
 					bytes_read += 2;
@@ -672,15 +704,24 @@ static int image_elf32_read_section(struct image *image,
 		LOG_DEBUG("read elf: size = 0x%zx at 0x%" TARGET_PRIxADDR "", read_size,
 			field32(elf, segment->p_offset) + offset);
 		/* read initialized area of the segment */
-		retval = fileio_seek(elf->fileio, field32(elf, segment->p_offset) + offset);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot find ELF segment content, seek failed");
-			return retval;
-		}
-		retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot read ELF segment content, read failed");
-			return retval;
+		if (elf->data) {
+			uint64_t file_offset = field32(elf, segment->p_offset) + offset;
+			if (file_offset > elf->size || read_size > elf->size - file_offset) {
+				LOG_ERROR("cannot read ELF segment content, beyond end of file");
+				return ERROR_IMAGE_FORMAT_ERROR;
+			}
+			memcpy(buffer, elf->data + file_offset, read_size);
+		} else {
+			retval = fileio_seek(elf->fileio, field32(elf, segment->p_offset) + offset);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("cannot find ELF segment content, seek failed");
+				return retval;
+			}
+			retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("cannot read ELF segment content, read failed");
+				return retval;
+			}
 		}
 		size -= read_size;
 		*size_read += read_size;
@@ -715,15 +756,24 @@ static int image_elf64_read_section(struct image *image,
 		LOG_DEBUG("read elf: size = 0x%zx at 0x%" TARGET_PRIxADDR "", read_size,
 			field64(elf, segment->p_offset) + offset);
 		/* read initialized area of the segment */
-		retval = fileio_seek(elf->fileio, field64(elf, segment->p_offset) + offset);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot find ELF segment content, seek failed");
-			return retval;
-		}
-		retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot read ELF segment content, read failed");
-			return retval;
+		if (elf->data) {
+			uint64_t file_offset = field64(elf, segment->p_offset) + offset;
+			if (file_offset > elf->size || read_size > elf->size - file_offset) {
+				LOG_ERROR("cannot read ELF segment content, beyond end of file");
+				return ERROR_IMAGE_FORMAT_ERROR;
+			}
+			memcpy(buffer, elf->data + file_offset, read_size);
+		} else {
+			retval = fileio_seek(elf->fileio, field64(elf, segment->p_offset) + offset);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("cannot find ELF segment content, seek failed");
+				return retval;
+			}
+			retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
+			if (retval != ERROR_OK) {
+				LOG_ERROR("cannot read ELF segment content, read failed");
+				return retval;
+			}
 		}
 		size -= read_size;
 		*size_read += read_size;
@@ -770,6 +820,10 @@ static int image_mot_buffer_complete_inner(struct image *image,
 		return retval;
 
 	mot->buffer = malloc(filesize >> 1);
+	if (!mot->buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 	cooked_bytes = 0x0;
 	image->num_sections = 0;
 
@@ -863,8 +917,9 @@ static int image_mot_buffer_complete_inner(struct image *image,
 				}
 
 				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
+					int value = image_hex_byte(&lpsz_line[bytes_read]);
+					if (value < 0)
+						return ERROR_IMAGE_FORMAT_ERROR;
 					mot->buffer[cooked_bytes] = (uint8_t)value;
 					cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
 					bytes_read += 2;
@@ -953,6 +1008,183 @@ static int image_mot_buffer_complete(struct image *image)
 	return retval;
 }
 
+/* Number of decoded hex files kept for reuse */
+#define IMAGE_DECODED_CACHE_SIZE	4
+
+/*
+ * Contents of an IHEX or S19 file, decoded once and shared by all images
+ * opened from the same, unchanged file.
+ */
+struct image_decoded {
+	char *url;
+	enum image_type type;
+	size_t file_size;
+	time_t mtime;
+	unsigned int refcount;
+	/* still in image_decoded_cache */
+	bool cached;
+
+	uint8_t *buffer;
+	unsigned int num_sections;
+	/* sections before relocation, pointing into buffer */
+	struct imagesection *sections;
+	bool start_address_set;
+	uint32_t start_address;
+
+	struct image_decoded *next;
+};
+
+/* most recently used first */
+static struct image_decoded *image_decoded_cache;
+
+static void image_decoded_free(struct image_decoded *decoded)
+{
+	free(decoded->url);
+	free(decoded->buffer);
+	free(decoded->sections);
+	free(decoded);
+}
+
+static void image_decoded_release(struct image_decoded *decoded)
+{
+	if (!decoded)
+		return;
+
+	if (--decoded->refcount == 0 && !decoded->cached)
+		image_decoded_free(decoded);
+}
+
+static int image_decoded_use(struct image *image, struct image_decoded *decoded)
+{
+	image->sections = malloc(decoded->num_sections * sizeof(struct imagesection));
+	if (!image->sections) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	memcpy(image->sections, decoded->sections,
+		decoded->num_sections * sizeof(struct imagesection));
+	image->num_sections = decoded->num_sections;
+	if (decoded->start_address_set) {
+		image->start_address_set = true;
+		image->start_address = decoded->start_address;
+	}
+
+	decoded->refcount++;
+	return ERROR_OK;
+}
+
+/* Set up @a image from the cache if the file didn't change since it was decoded */
+static struct image_decoded *image_decoded_find(struct image *image, const char *url,
+	struct fileio *fileio)
+{
+	size_t file_size;
+	time_t mtime;
+
+	if (fileio_size(fileio, &file_size) != ERROR_OK
+			|| fileio_mtime(fileio, &mtime) != ERROR_OK)
+		return NULL;
+
+	struct image_decoded **prev = &image_decoded_cache;
+	for (struct image_decoded *decoded = *prev; decoded; prev = &decoded->next, decoded = *prev) {
+		if (decoded->type != image->type || strcmp(decoded->url, url) != 0)
+			continue;
+
+		if (decoded->file_size != file_size || decoded->mtime != mtime) {
+			/* stale, the file changed */
+			*prev = decoded->next;
+			decoded->cached = false;
+			if (decoded->refcount == 0)
+				image_decoded_free(decoded);
+			return NULL;
+		}
+
+		if (image_decoded_use(image, decoded) != ERROR_OK)
+			return NULL;
+
+		/* move to the front */
+		*prev = decoded->next;
+		decoded->next = image_decoded_cache;
+		image_decoded_cache = decoded;
+
+		LOG_DEBUG("reusing decoded image %s", url);
+		return decoded;
+	}
+
+	return NULL;
+}
+
+/*
+ * Take over the buffer @a image was just decoded into. The buffer is
+ * shrunk to the decoded data and the result is kept for reuse.
+ */
+static struct image_decoded *image_decoded_add(struct image *image, const char *url,
+	struct fileio *fileio, uint8_t **buffer)
+{
+	size_t used = 0;
+	for (unsigned int i = 0; i < image->num_sections; i++) {
+		size_t end = (uint8_t *)image->sections[i].private - *buffer + image->sections[i].size;
+		used = MAX(used, end);
+	}
+
+	if (used > 0) {
+		uint8_t *shrunk = realloc(*buffer, used);
+		if (shrunk) {
+			for (unsigned int i = 0; i < image->num_sections; i++)
+				image->sections[i].private = shrunk +
+					((uint8_t *)image->sections[i].private - *buffer);
+			*buffer = shrunk;
+		}
+	}
+
+	struct image_decoded *decoded = calloc(1, sizeof(*decoded));
+	if (!decoded) {
+		LOG_ERROR("Out of memory");
+		return NULL;
+	}
+
+	decoded->url = strdup(url);
+	decoded->sections = malloc(image->num_sections * sizeof(struct imagesection));
+	if (!decoded->url || !decoded->sections) {
+		LOG_ERROR("Out of memory");
+		free(decoded->url);
+		free(decoded->sections);
+		free(decoded);
+		return NULL;
+	}
+	memcpy(decoded->sections, image->sections,
+		image->num_sections * sizeof(struct imagesection));
+	decoded->num_sections = image->num_sections;
+	decoded->type = image->type;
+	decoded->start_address_set = image->start_address_set;
+	decoded->start_address = image->start_address;
+	decoded->buffer = *buffer;
+	decoded->refcount = 1;
+
+	if (fileio_size(fileio, &decoded->file_size) != ERROR_OK
+			|| fileio_mtime(fileio, &decoded->mtime) != ERROR_OK)
+		return decoded;
+
+	decoded->cached = true;
+	decoded->next = image_decoded_cache;
+	image_decoded_cache = decoded;
+
+	/* drop the least recently used ones */
+	unsigned int n = 0;
+	for (struct image_decoded **prev = &image_decoded_cache; *prev; ) {
+		struct image_decoded *d = *prev;
+		if (++n <= IMAGE_DECODED_CACHE_SIZE) {
+			prev = &d->next;
+			continue;
+		}
+		*prev = d->next;
+		d->cached = false;
+		if (d->refcount == 0)
+			image_decoded_free(d);
+	}
+
+	return decoded;
+}
+
 int image_open(struct image *image, const char *url, const char *type_string)
 {
 	int retval = ERROR_OK;
@@ -976,6 +1208,11 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			return retval;
 		}
 
+		/* serve reads from a mapping where possible */
+		if (fileio_mtime(image_binary->fileio, &image_binary->mtime) != ERROR_OK
+				|| fileio_map(image_binary->fileio, &image_binary->data) != ERROR_OK)
+			image_binary->data = NULL;
+
 		image->num_sections = 1;
 		image->sections = malloc(sizeof(struct imagesection));
 		image->sections[0].base_address = 0x0;
@@ -990,13 +1227,25 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			return retval;
 
-		retval = image_ihex_buffer_complete(image);
-		if (retval != ERROR_OK) {
-			LOG_ERROR(
-				"failed buffering IHEX image, check server output for additional information");
-			fileio_close(image_ihex->fileio);
-			return retval;
+		image_ihex->buffer = NULL;
+		image_ihex->decoded = image_decoded_find(image, url, image_ihex->fileio);
+		if (!image_ihex->decoded) {
+			retval = image_ihex_buffer_complete(image);
+			if (retval == ERROR_OK) {
+				image_ihex->decoded = image_decoded_add(image, url,
+						image_ihex->fileio, &image_ihex->buffer);
+				if (!image_ihex->decoded)
+					retval = ERROR_FAIL;
+			}
+			if (retval != ERROR_OK) {
+				LOG_ERROR(
+					"failed buffering IHEX image, check server output for additional information");
+				free(image_ihex->buffer);
+				fileio_close(image_ihex->fileio);
+				return retval;
+			}
 		}
+		image_ihex->buffer = image_ihex->decoded->buffer;
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf;
 
@@ -1011,6 +1260,12 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			fileio_close(image_elf->fileio);
 			return retval;
 		}
+
+		/* serve segment reads from a mapping where possible */
+		if (fileio_size(image_elf->fileio, &image_elf->size) != ERROR_OK
+				|| fileio_mtime(image_elf->fileio, &image_elf->mtime) != ERROR_OK
+				|| fileio_map(image_elf->fileio, &image_elf->data) != ERROR_OK)
+			image_elf->data = NULL;
 	} else if (image->type == IMAGE_MEMORY) {
 		struct target *target = get_target(url);
 
@@ -1041,13 +1296,25 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			return retval;
 
-		retval = image_mot_buffer_complete(image);
-		if (retval != ERROR_OK) {
-			LOG_ERROR(
-				"failed buffering S19 image, check server output for additional information");
-			fileio_close(image_mot->fileio);
-			return retval;
+		image_mot->buffer = NULL;
+		image_mot->decoded = image_decoded_find(image, url, image_mot->fileio);
+		if (!image_mot->decoded) {
+			retval = image_mot_buffer_complete(image);
+			if (retval == ERROR_OK) {
+				image_mot->decoded = image_decoded_add(image, url,
+						image_mot->fileio, &image_mot->buffer);
+				if (!image_mot->decoded)
+					retval = ERROR_FAIL;
+			}
+			if (retval != ERROR_OK) {
+				LOG_ERROR(
+					"failed buffering S19 image, check server output for additional information");
+				free(image_mot->buffer);
+				fileio_close(image_mot->fileio);
+				return retval;
+			}
 		}
+		image_mot->buffer = image_mot->decoded->buffer;
 	} else if (image->type == IMAGE_BUILDER) {
 		image->num_sections = 0;
 		image->base_address_set = false;
@@ -1095,6 +1362,12 @@ int image_read_section(struct image *image,
 		if (section != 0)
 			return ERROR_COMMAND_SYNTAX_ERROR;
 
+		if (image_binary->data) {
+			memcpy(buffer, image_binary->data + offset, size);
+			*size_read = size;
+			return ERROR_OK;
+		}
+
 		/* seek to offset */
 		retval = fileio_seek(image_binary->fileio, offset);
 		if (retval != ERROR_OK)
@@ -1164,6 +1437,70 @@ int image_read_section(struct image *image,
 	return ERROR_OK;
 }
 
+/* A mapped file that got modified may no longer match, or even cover, the mapping */
+static int image_mapping_valid(struct fileio *fileio, time_t mtime)
+{
+	time_t now;
+
+	if (fileio_mtime(fileio, &now) != ERROR_OK || now != mtime) {
+		LOG_ERROR("image file changed since it was opened");
+		return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+	}
+	return ERROR_OK;
+}
+
+/**
+ * Get the contents of @a section without copying them, for images that
+ * hold them in memory: mapped files, decoded hex files and built images.
+ * The data stays valid until the image is closed.
+ * @returns ERROR_IMAGE_TEMPORARILY_UNAVAILABLE if the image does not hold
+ * the section in memory, in which case image_read_section() has to be used.
+ */
+int image_section_data(struct image *image, int section, const uint8_t **data)
+{
+	if (image->type == IMAGE_BINARY) {
+		struct image_binary *image_binary = image->type_private;
+
+		if (!image_binary->data)
+			return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+		int retval = image_mapping_valid(image_binary->fileio, image_binary->mtime);
+		if (retval != ERROR_OK)
+			return retval;
+
+		*data = image_binary->data;
+	} else if (image->type == IMAGE_ELF) {
+		struct image_elf *elf = image->type_private;
+		uint64_t file_offset;
+
+		if (!elf->data)
+			return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+		int retval = image_mapping_valid(elf->fileio, elf->mtime);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (elf->is_64_bit) {
+			Elf64_Phdr *segment = image->sections[section].private;
+			file_offset = field64(elf, segment->p_offset);
+		} else {
+			Elf32_Phdr *segment = image->sections[section].private;
+			file_offset = field32(elf, segment->p_offset);
+		}
+		if (file_offset > elf->size || image->sections[section].size > elf->size - file_offset) {
+			LOG_ERROR("ELF segment content beyond end of file");
+			return ERROR_IMAGE_FORMAT_ERROR;
+		}
+
+		*data = elf->data + file_offset;
+	} else if (image->type == IMAGE_IHEX || image->type == IMAGE_SRECORD
+			|| image->type == IMAGE_BUILDER) {
+		*data = image->sections[section].private;
+	} else {
+		return ERROR_IMAGE_TEMPORARILY_UNAVAILABLE;
+	}
+
+	return ERROR_OK;
+}
+
 int image_add_section(struct image *image, target_addr_t base, uint32_t size, uint64_t flags, uint8_t const *data)
 {
 	struct imagesection *section;
@@ -1212,7 +1549,8 @@ void image_close(struct image *image)
 
 		fileio_close(image_ihex->fileio);
 
-		free(image_ihex->buffer);
+		image_decoded_release(image_ihex->decoded);
+		image_ihex->decoded = NULL;
 		image_ihex->buffer = NULL;
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf = image->type_private;
@@ -1242,7 +1580,8 @@ void image_close(struct image *image)
 
 		fileio_close(image_mot->fileio);
 
-		free(image_mot->buffer);
+		image_decoded_release(image_mot->decoded);
+		image_mot->decoded = NULL;
 		image_mot->buffer = NULL;
 	} else if (image->type == IMAGE_BUILDER) {
 		for (unsigned int i = 0; i < image->num_sections; i++) {
@@ -1263,31 +1602,12 @@ int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *c
 	uint32_t crc = 0xffffffff;
 	LOG_DEBUG("Calculating checksum");
 
-	static uint32_t crc32_table[256];
-
-	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		unsigned int i, j, c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
-		}
-
-		first_init = true;
-	}
-
 	while (nbytes > 0) {
-		int run = nbytes;
-		if (run > 32768)
-			run = 32768;
+		uint32_t run = MIN(nbytes, IMAGE_CHECKSUM_CHUNK);
+
+		crc = crc32_gdb(crc, buffer, run);
+		buffer += run;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
 		keep_alive();
 	}
 
@@ -58,11 +58,16 @@ struct image {
 
 struct image_binary {
 	struct fileio *fileio;
+	const uint8_t *data;	/* contents of the mapped file, or NULL */
+	time_t mtime;		/* modification time of the mapped file */
 };
 
+struct image_decoded;
+
 struct image_ihex {
 	struct fileio *fileio;
 	uint8_t *buffer;
+	struct image_decoded *decoded;
 };
 
 struct image_memory {
@@ -84,17 +89,22 @@ struct image_elf {
 	};
 	uint32_t segment_count;
 	uint8_t endianness;
+	const uint8_t *data;	/* contents of the mapped file, or NULL */
+	size_t size;
+	time_t mtime;		/* modification time of the mapped file */
 };
 
 struct image_mot {
 	struct fileio *fileio;
 	uint8_t *buffer;
+	struct image_decoded *decoded;
 };
 
 int image_open(struct image *image, const char *url, const char *type_string);
 int image_read_section(struct image *image, int section, target_addr_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
 void image_close(struct image *image);
+int image_section_data(struct image *image, int section, const uint8_t **data);
 
 int image_add_section(struct image *image, target_addr_t base, uint32_t size,
 		uint64_t flags, uint8_t const *data);
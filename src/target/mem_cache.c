@@ -0,0 +1,446 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/align.h>
+#include <helper/log.h>
+#include <helper/command.h>
+
+#include "target.h"
+#include "target_type.h"
+#include "smp.h"
+#include "mem_cache.h"
+
+#define MEM_CACHE_DEFAULT_LINE_SIZE 64
+#define MEM_CACHE_DEFAULT_LINES 256
+
+struct mem_cache_region {
+	target_addr_t address;
+	uint64_t size;
+};
+
+struct mem_cache {
+	bool enabled;
+
+	/* direct mapped: line address / line_size selects the slot */
+	unsigned int line_size;
+	unsigned int num_lines;
+	target_addr_t *tags;
+	bool *valid;
+	uint8_t *data;
+	unsigned int valid_lines;
+
+	struct mem_cache_region *uncached;
+	unsigned int num_uncached;
+
+	struct mem_cache_stats stats;
+};
+
+static struct mem_cache *mem_cache_get(struct target *target)
+{
+	if (!target->mem_cache) {
+		struct mem_cache *cache = calloc(1, sizeof(*cache));
+		if (!cache) {
+			LOG_ERROR("Out of memory");
+			return NULL;
+		}
+		cache->line_size = MEM_CACHE_DEFAULT_LINE_SIZE;
+		cache->num_lines = MEM_CACHE_DEFAULT_LINES;
+		target->mem_cache = cache;
+	}
+
+	return target->mem_cache;
+}
+
+static void mem_cache_free_lines(struct mem_cache *cache)
+{
+	free(cache->tags);
+	free(cache->valid);
+	free(cache->data);
+	cache->tags = NULL;
+	cache->valid = NULL;
+	cache->data = NULL;
+	cache->valid_lines = 0;
+}
+
+static int mem_cache_alloc_lines(struct mem_cache *cache)
+{
+	mem_cache_free_lines(cache);
+
+	cache->tags = calloc(cache->num_lines, sizeof(*cache->tags));
+	cache->valid = calloc(cache->num_lines, sizeof(*cache->valid));
+	cache->data = malloc((size_t)cache->num_lines * cache->line_size);
+	if (!cache->tags || !cache->valid || !cache->data) {
+		LOG_ERROR("Out of memory");
+		mem_cache_free_lines(cache);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+void mem_cache_free(struct target *target)
+{
+	struct mem_cache *cache = target->mem_cache;
+
+	if (!cache)
+		return;
+
+	mem_cache_free_lines(cache);
+	free(cache->uncached);
+	free(cache);
+	target->mem_cache = NULL;
+}
+
+bool mem_cache_active(const struct target *target)
+{
+	return target->mem_cache && target->mem_cache->enabled &&
+		target->state == TARGET_HALTED;
+}
+
+void mem_cache_invalidate(struct target *target)
+{
+	struct mem_cache *cache = target->mem_cache;
+
+	if (!cache || !cache->valid_lines)
+		return;
+
+	memset(cache->valid, 0, cache->num_lines * sizeof(*cache->valid));
+	cache->valid_lines = 0;
+	cache->stats.invalidations++;
+}
+
+void mem_cache_invalidate_range(struct target *target, target_addr_t address,
+		uint64_t length)
+{
+	struct mem_cache *cache = target->mem_cache;
+
+	if (!cache || !cache->valid_lines || !length)
+		return;
+
+	target_addr_t first = address & ~(target_addr_t)(cache->line_size - 1);
+	uint64_t num = (address - first + length + cache->line_size - 1) / cache->line_size;
+
+	if (num >= cache->num_lines) {
+		mem_cache_invalidate(target);
+		return;
+	}
+
+	for (uint64_t i = 0; i < num; i++) {
+		target_addr_t line = first + i * cache->line_size;
+		unsigned int slot = (line / cache->line_size) & (cache->num_lines - 1);
+
+		if (cache->valid[slot] && cache->tags[slot] == line) {
+			cache->valid[slot] = false;
+			cache->valid_lines--;
+			cache->stats.invalidations++;
+		}
+	}
+}
+
+void mem_cache_invalidate_smp(struct target *target)
+{
+	if (!target->smp) {
+		mem_cache_invalidate(target);
+		return;
+	}
+
+	struct target_list *head;
+	foreach_smp_target(head, target->smp_targets)
+		mem_cache_invalidate(head->target);
+}
+
+static bool mem_cache_is_uncached(const struct mem_cache *cache,
+		target_addr_t address, uint64_t length)
+{
+	for (unsigned int i = 0; i < cache->num_uncached; i++) {
+		const struct mem_cache_region *r = &cache->uncached[i];
+
+		if (address < r->address + r->size && r->address < address + length)
+			return true;
+	}
+
+	return false;
+}
+
+static int mem_cache_fill(struct target *target, struct mem_cache *cache,
+		target_addr_t line, unsigned int slot)
+{
+	unsigned int width = MIN(4, target_data_bits(target) / 8);
+	uint8_t *data = cache->data + (size_t)slot * cache->line_size;
+
+	if (cache->valid[slot]) {
+		cache->valid[slot] = false;
+		cache->valid_lines--;
+	}
+
+	int retval = target->type->read_memory(target, line, width,
+			cache->line_size / width, data);
+	if (retval != ERROR_OK)
+		return retval;
+
+	cache->tags[slot] = line;
+	cache->valid[slot] = true;
+	cache->valid_lines++;
+	cache->stats.misses++;
+	cache->stats.bytes_filled += cache->line_size;
+
+	return ERROR_OK;
+}
+
+/**
+ * Serve a target_read_memory() request from the cache, filling missing
+ * lines with block reads. Requests touching an uncached region, or whose
+ * lines cannot be read, are passed to the target unchanged.
+ */
+int mem_cache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	struct mem_cache *cache = target->mem_cache;
+	uint64_t length = (uint64_t)size * count;
+
+	if (!length || !cache->data)
+		goto bypass;
+
+	target_addr_t first = address & ~(target_addr_t)(cache->line_size - 1);
+	uint64_t span = (address - first + length + cache->line_size - 1) &
+			~(uint64_t)(cache->line_size - 1);
+
+	if (first + span - 1 < first || mem_cache_is_uncached(cache, first, span))
+		goto bypass;
+
+	target_addr_t pos = address;
+	uint8_t *out = buffer;
+	while (length) {
+		target_addr_t line = pos & ~(target_addr_t)(cache->line_size - 1);
+		unsigned int slot = (line / cache->line_size) & (cache->num_lines - 1);
+		unsigned int offset = pos - line;
+		uint32_t chunk = MIN(length, cache->line_size - offset);
+
+		if (cache->valid[slot] && cache->tags[slot] == line) {
+			cache->stats.hits++;
+		} else if (mem_cache_fill(target, cache, line, slot) != ERROR_OK) {
+			/* the line may reach into unreadable memory, try the exact request */
+			goto bypass;
+		}
+
+		memcpy(out, cache->data + (size_t)slot * cache->line_size + offset, chunk);
+		pos += chunk;
+		out += chunk;
+		length -= chunk;
+	}
+
+	return ERROR_OK;
+
+bypass:
+	cache->stats.bypassed++;
+	return target->type->read_memory(target, address, size, count, buffer);
+}
+
+COMMAND_HANDLER(handle_mem_cache_enable_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	struct mem_cache *cache = mem_cache_get(target);
+	if (!cache)
+		return ERROR_FAIL;
+
+	bool enable = !strcmp(CMD_NAME, "enable");
+	if (enable && !cache->data) {
+		int retval = mem_cache_alloc_lines(cache);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	mem_cache_invalidate(target);
+	cache->enabled = enable;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_geometry_command)
+{
+	if (CMD_ARGC != 0 && CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	struct mem_cache *cache = mem_cache_get(target);
+	if (!cache)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC == 2) {
+		unsigned int line_size, num_lines;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], line_size);
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], num_lines);
+
+		if (line_size < 16 || line_size > 4096 || !IS_PWR_OF_2(line_size)) {
+			command_print(CMD, "line size must be a power of 2 from 16 to 4096");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		if (!num_lines || num_lines > 65536 || !IS_PWR_OF_2(num_lines)) {
+			command_print(CMD, "number of lines must be a power of 2 up to 65536");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+
+		cache->line_size = line_size;
+		cache->num_lines = num_lines;
+		mem_cache_free_lines(cache);
+		if (cache->enabled) {
+			int retval = mem_cache_alloc_lines(cache);
+			if (retval != ERROR_OK) {
+				cache->enabled = false;
+				return retval;
+			}
+		}
+	}
+
+	command_print(CMD, "%u lines of %u bytes", cache->num_lines, cache->line_size);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_uncached_command)
+{
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	struct mem_cache *cache = mem_cache_get(target);
+	if (!cache)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "clear"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		free(cache->uncached);
+		cache->uncached = NULL;
+		cache->num_uncached = 0;
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC == 2) {
+		target_addr_t address;
+		uint64_t size;
+		COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+		COMMAND_PARSE_NUMBER(u64, CMD_ARGV[1], size);
+		if (!size)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+
+		struct mem_cache_region *regions = realloc(cache->uncached,
+				(cache->num_uncached + 1) * sizeof(*regions));
+		if (!regions) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		regions[cache->num_uncached].address = address;
+		regions[cache->num_uncached].size = size;
+		cache->uncached = regions;
+		cache->num_uncached++;
+
+		mem_cache_invalidate_range(target, address, size);
+		return ERROR_OK;
+	}
+
+	for (unsigned int i = 0; i < cache->num_uncached; i++)
+		command_print(CMD, TARGET_ADDR_FMT " 0x%" PRIx64,
+			cache->uncached[i].address, cache->uncached[i].size);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_flush_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	mem_cache_invalidate(get_current_target(CMD_CTX));
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	struct mem_cache *cache = mem_cache_get(target);
+	if (!cache)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(&cache->stats, 0, sizeof(cache->stats));
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "memory cache %s, %u of %u lines valid",
+		cache->enabled ? "enabled" : "disabled", cache->valid_lines, cache->num_lines);
+	command_print(CMD, "hits:          %" PRIu64, cache->stats.hits);
+	command_print(CMD, "misses:        %" PRIu64, cache->stats.misses);
+	command_print(CMD, "bypassed:      %" PRIu64, cache->stats.bypassed);
+	command_print(CMD, "invalidations: %" PRIu64, cache->stats.invalidations);
+	command_print(CMD, "bytes filled:  %" PRIu64, cache->stats.bytes_filled);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration mem_cache_subcommand_handlers[] = {
+	{
+		.name = "enable",
+		.handler = handle_mem_cache_enable_command,
+		.mode = COMMAND_ANY,
+		.help = "cache memory reads while the target is halted",
+		.usage = "",
+	},
+	{
+		.name = "disable",
+		.handler = handle_mem_cache_enable_command,
+		.mode = COMMAND_ANY,
+		.help = "pass all memory reads to the target",
+		.usage = "",
+	},
+	{
+		.name = "geometry",
+		.handler = handle_mem_cache_geometry_command,
+		.mode = COMMAND_ANY,
+		.help = "display or set the line size and number of lines",
+		.usage = "[line_size num_lines]",
+	},
+	{
+		.name = "uncached",
+		.handler = handle_mem_cache_uncached_command,
+		.mode = COMMAND_ANY,
+		.help = "list, add or clear address ranges that are never cached",
+		.usage = "[address size | 'clear']",
+	},
+	{
+		.name = "flush",
+		.handler = handle_mem_cache_flush_command,
+		.mode = COMMAND_ANY,
+		.help = "drop all cached data",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.handler = handle_mem_cache_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "display or reset cache statistics",
+		.usage = "['reset']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration mem_cache_command_handlers[] = {
+	{
+		.name = "mem_cache",
+		.mode = COMMAND_ANY,
+		.help = "target memory read cache",
+		.usage = "",
+		.chain = mem_cache_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_MEM_CACHE_H
+#define OPENOCD_TARGET_MEM_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <target/target.h>
+
+/**
+ * @file
+ * Read cache for the memory of a halted target.
+ *
+ * When enabled for a target, target_read_memory() and target_read_buffer()
+ * are served from fixed size lines that are filled with block reads.
+ * The cache only holds data while the target is halted. It is dropped when
+ * the target resumes, steps, runs an algorithm or is reset, and lines are
+ * dropped when memory they cover is written. Address ranges with side
+ * effects on read, like peripherals, can be excluded.
+ */
+
+struct mem_cache;
+
+struct mem_cache_stats {
+	/** Lines found in the cache. */
+	uint64_t hits;
+	/** Lines read from the target. */
+	uint64_t misses;
+	/** Reads passed to the target because the cache could not serve them. */
+	uint64_t bypassed;
+	/** Times cached data was thrown away. */
+	uint64_t invalidations;
+	/** Bytes read from the target to fill lines. */
+	uint64_t bytes_filled;
+};
+
+/** @returns true if reads of @a target should go through mem_cache_read(). */
+bool mem_cache_active(const struct target *target);
+
+int mem_cache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer);
+
+/** Drop the cached lines covering @a length bytes at @a address. */
+void mem_cache_invalidate_range(struct target *target, target_addr_t address,
+		uint64_t length);
+/** Drop everything cached for @a target. */
+void mem_cache_invalidate(struct target *target);
+/** Drop everything cached for @a target and the targets of its SMP group. */
+void mem_cache_invalidate_smp(struct target *target);
+
+void mem_cache_free(struct target *target);
+
+extern const struct command_registration mem_cache_command_handlers[];
+
+#endif /* OPENOCD_TARGET_MEM_CACHE_H */
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <target/target.h>
+#include "pc_histogram.h"
+
+#define PC_HISTOGRAM_MIN_SIZE	1024
+
+void pc_histogram_clear(struct pc_histogram *hist)
+{
+	free(hist->pcs);
+	free(hist->counts);
+	hist->pcs = NULL;
+	hist->counts = NULL;
+	hist->size = 0;
+	hist->used = 0;
+	hist->total = 0;
+}
+
+static uint32_t pc_histogram_slot(const struct pc_histogram *hist, uint32_t pc)
+{
+	/* Thumb code: bit 0 of the PC is always 0 */
+	uint32_t slot = ((pc >> 1) * 2654435761u) & (hist->size - 1);
+
+	while (hist->counts[slot] && hist->pcs[slot] != pc)
+		slot = (slot + 1) & (hist->size - 1);
+	return slot;
+}
+
+static int pc_histogram_grow(struct pc_histogram *hist)
+{
+	struct pc_histogram bigger = *hist;
+
+	bigger.size = hist->size ? 2 * hist->size : PC_HISTOGRAM_MIN_SIZE;
+	bigger.pcs = malloc(bigger.size * sizeof(*bigger.pcs));
+	bigger.counts = calloc(bigger.size, sizeof(*bigger.counts));
+	if (!bigger.pcs || !bigger.counts) {
+		LOG_ERROR("Out of memory");
+		free(bigger.pcs);
+		free(bigger.counts);
+		return ERROR_FAIL;
+	}
+
+	for (uint32_t i = 0; i < hist->size; i++) {
+		if (!hist->counts[i])
+			continue;
+		uint32_t slot = pc_histogram_slot(&bigger, hist->pcs[i]);
+		bigger.pcs[slot] = hist->pcs[i];
+		bigger.counts[slot] = hist->counts[i];
+	}
+
+	free(hist->pcs);
+	free(hist->counts);
+	*hist = bigger;
+	return ERROR_OK;
+}
+
+int pc_histogram_add(struct pc_histogram *hist, uint32_t pc)
+{
+	/* keep the table at most half full */
+	if (2 * (hist->used + 1) > hist->size) {
+		int retval = pc_histogram_grow(hist);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	uint32_t slot = pc_histogram_slot(hist, pc);
+	if (!hist->counts[slot]) {
+		hist->pcs[slot] = pc;
+		hist->used++;
+	}
+	if (hist->counts[slot] != UINT32_MAX)
+		hist->counts[slot]++;
+	hist->total++;
+	return ERROR_OK;
+}
+
+int pc_histogram_write_gmon(const struct pc_histogram *hist, const char *filename,
+		bool with_range, uint32_t start_address, uint32_t end_address,
+		struct target *target, uint32_t duration_ms)
+{
+	if (!hist->used) {
+		LOG_ERROR("No PC samples collected");
+		return ERROR_FAIL;
+	}
+
+	/* gmon wants the samples, not the hash table */
+	uint32_t *pcs = malloc(hist->used * sizeof(*pcs));
+	uint32_t *counts = malloc(hist->used * sizeof(*counts));
+	if (!pcs || !counts) {
+		LOG_ERROR("Out of memory");
+		free(pcs);
+		free(counts);
+		return ERROR_FAIL;
+	}
+
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < hist->size; i++) {
+		if (!hist->counts[i])
+			continue;
+		pcs[n] = hist->pcs[i];
+		counts[n] = hist->counts[i];
+		n++;
+	}
+
+	target_write_gmon(pcs, counts, n, filename, with_range, start_address,
+		end_address, target, duration_ms ? duration_ms : 1);
+	free(pcs);
+	free(counts);
+	return ERROR_OK;
+}
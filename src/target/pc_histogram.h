@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_PC_HISTOGRAM_H
+#define OPENOCD_TARGET_PC_HISTOGRAM_H
+
+#include <helper/types.h>
+
+struct target;
+
+/**
+ * @file
+ * Compact histogram of PC samples: each distinct PC is stored once with its
+ * count, so long profiling runs don't need to keep every sample.
+ */
+
+struct pc_histogram {
+	uint32_t *pcs;
+	/** zero for a free slot of the hash table */
+	uint32_t *counts;
+	uint32_t size;
+	/** distinct PCs */
+	uint32_t used;
+	/** all the samples added */
+	uint64_t total;
+};
+
+/** Remove all the samples and free the memory of the histogram. */
+void pc_histogram_clear(struct pc_histogram *hist);
+
+/** Count one more sample of @a pc. */
+int pc_histogram_add(struct pc_histogram *hist, uint32_t pc);
+
+/**
+ * Write the histogram to @a filename in the gmon.out format of the
+ * 'profile' command.
+ */
+int pc_histogram_write_gmon(const struct pc_histogram *hist, const char *filename,
+		bool with_range, uint32_t start_address, uint32_t end_address,
+		struct target *target, uint32_t duration_ms);
+
+#endif /* OPENOCD_TARGET_PC_HISTOGRAM_H */
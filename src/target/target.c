@@ -31,6 +31,7 @@
 #endif
 
 #include <helper/align.h>
+#include <helper/crc32.h>
 #include <helper/nvp.h>
 #include <helper/time_support.h>
 #include <jtag/jtag.h>
@@ -48,10 +49,15 @@
 #include "arm_cti.h"
 #include "smp.h"
 #include "semihosting_common.h"
+#include "mem_cache.h"
+#include "pc_histogram.h"
 
 /* default halt wait timeout (ms) */
 #define DEFAULT_HALT_TIMEOUT 5000
 
+/* Size of the blocks read when memory is checksummed on the host */
+#define TARGET_CHECKSUM_CHUNK (64 * 1024)
+
 static int target_read_buffer_default(struct target *target, target_addr_t address,
 		uint32_t count, uint8_t *buffer);
 static int target_write_buffer_default(struct target *target, target_addr_t address,
@@ -65,6 +71,8 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
+static void free_fastload(void);
+static void target_profile_stop_all(void);
 
 static struct target_type *target_types[] = {
 	&arm7tdmi_target,
@@ -605,6 +613,7 @@ int target_resume(struct target *target, int current, target_addr_t address,
 	}
 
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_START);
+	mem_cache_invalidate(target);
 
 	/* note that resume *must* be asynchronous. The CPU can halt before
 	 * we poll. The CPU can even halt at the current PC as a result of
@@ -823,6 +832,7 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	mem_cache_invalidate(target);
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
@@ -868,6 +878,7 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	mem_cache_invalidate(target);
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -919,6 +930,225 @@ done:
 	return retval;
 }
 
+/* State of one run of target_run_flash_async_algorithm() */
+struct async_flash_job {
+	struct target *target;
+	const uint8_t *buffer;
+	const uint8_t *buffer_orig;
+	uint32_t count;
+	uint32_t block_size;
+
+	uint32_t wp_addr;
+	uint32_t rp_addr;
+	uint32_t fifo_start_addr;
+	uint32_t fifo_end_addr;
+	uint32_t wp;
+	uint32_t rp;
+
+	/* The read pointer only moves forward, so free space computed from a
+	 * stale value is safe to fill. It is only read again when that space is
+	 * not enough. */
+	bool rp_fresh;
+	/* Every transfer costs a round trip to the adapter, so don't bother
+	 * with chunks smaller than this. It grows while the algorithm is the
+	 * bottleneck and shrinks when it runs out of data. */
+	uint32_t min_chunk;
+	int timeout;
+	bool timed_out;
+	int retval;
+	struct target_async_algorithm_stats *stats;
+
+	struct async_flash_job *next;
+};
+
+enum async_flash_step {
+	ASYNC_FLASH_PROGRESS,
+	ASYNC_FLASH_STALLED,
+	ASYNC_FLASH_DONE,
+};
+
+/* Runs whose fifo is being fed, innermost first */
+static struct async_flash_job *async_flash_jobs;
+
+static target_async_starter_fn async_flash_starter;
+static void *async_flash_starter_priv;
+
+void target_async_algorithm_set_starter(target_async_starter_fn starter, void *priv)
+{
+	async_flash_starter = starter;
+	async_flash_starter_priv = priv;
+}
+
+static bool async_flash_job_done(const struct async_flash_job *job)
+{
+	return job->count == 0 || job->retval != ERROR_OK;
+}
+
+/* Feed at most one chunk to the fifo of a run */
+static enum async_flash_step async_flash_job_step(struct async_flash_job *job)
+{
+	struct target *target = job->target;
+	struct target_async_algorithm_stats *stats = job->stats;
+	const uint32_t block_size = job->block_size;
+
+	while (!async_flash_job_done(job)) {
+		if (!job->rp_fresh) {
+			uint32_t prev_rp = job->rp;
+
+			job->retval = target_read_u32(target, job->rp_addr, &job->rp);
+			if (job->retval != ERROR_OK) {
+				LOG_ERROR("failed to get read pointer");
+				break;
+			}
+			job->rp_fresh = true;
+			stats->polls++;
+
+			LOG_DEBUG("offs 0x%zx count 0x%" PRIx32 " wp 0x%" PRIx32 " rp 0x%" PRIx32,
+				(size_t) (job->buffer - job->buffer_orig), job->count, job->wp, job->rp);
+
+			if (job->rp == 0) {
+				LOG_ERROR("flash write algorithm aborted by target");
+				job->retval = ERROR_FLASH_OPERATION_FAILED;
+				break;
+			}
+
+			if (!IS_ALIGNED(job->rp - job->fifo_start_addr, block_size)
+					|| job->rp < job->fifo_start_addr || job->rp >= job->fifo_end_addr) {
+				LOG_ERROR("corrupted fifo read pointer 0x%" PRIx32, job->rp);
+				/* the run stopped early, don't report it as a success */
+				job->retval = ERROR_FAIL;
+				break;
+			}
+
+			/* the algorithm made progress */
+			if (job->rp != prev_rp)
+				job->timeout = 0;
+
+			/* the algorithm waited for data, refill sooner */
+			if (job->rp == job->wp) {
+				stats->starved++;
+				job->min_chunk = MAX(block_size, job->min_chunk / 2);
+			}
+		}
+
+		const uint32_t rp = job->rp, wp = job->wp;
+
+		/* Count the number of bytes available in the fifo without
+		 * crossing the wrap around. Make sure to not fill it completely,
+		 * because that would make wp == rp and that's the empty condition. */
+		uint32_t thisrun_bytes;
+		if (rp > wp)
+			thisrun_bytes = rp - wp - block_size;
+		else if (rp > job->fifo_start_addr)
+			thisrun_bytes = job->fifo_end_addr - wp;
+		else
+			thisrun_bytes = job->fifo_end_addr - wp - block_size;
+
+		/* Smallest run worth a transfer. It can't be more than the data
+		 * left, nor than the space up to the wrap around. */
+		uint32_t wanted = MIN(job->min_chunk, job->count * block_size);
+		wanted = MIN(wanted, job->fifo_end_addr - wp);
+
+		if (thisrun_bytes < wanted) {
+			/* the space may just be out of date */
+			if (!job->rp_fresh)
+				continue;
+
+			stats->stalls++;
+			job->min_chunk = MIN(job->min_chunk * 2, MAX(block_size, stats->fifo_size / 2));
+
+			/* to stop an infinite loop on some targets check and increment a timeout
+			 * this issue was observed on a stellaris using the new ICDI interface */
+			if (job->timeout++ >= 2500) {
+				LOG_ERROR("timeout waiting for algorithm, a target reset is recommended");
+				job->retval = ERROR_FLASH_OPERATION_FAILED;
+				job->timed_out = true;
+				break;
+			}
+			job->rp_fresh = false;
+			return ASYNC_FLASH_STALLED;
+		}
+
+		/* Limit to the amount of data we actually want to write */
+		if (thisrun_bytes > job->count * block_size)
+			thisrun_bytes = job->count * block_size;
+
+		/* Force end of large blocks to be word aligned */
+		if (thisrun_bytes >= 16)
+			thisrun_bytes -= (rp + thisrun_bytes) & 0x03;
+
+		/* Write data to fifo */
+		job->retval = target_write_buffer(target, wp, thisrun_bytes, job->buffer);
+		if (job->retval != ERROR_OK)
+			break;
+
+		/* Update counters and wrap write pointer */
+		job->buffer += thisrun_bytes;
+		job->count -= thisrun_bytes / block_size;
+		job->wp += thisrun_bytes;
+		if (job->wp >= job->fifo_end_addr)
+			job->wp = job->fifo_start_addr;
+
+		/* Store updated write pointer to target */
+		job->retval = target_write_u32(target, job->wp_addr, job->wp);
+		if (job->retval != ERROR_OK)
+			break;
+
+		stats->writes++;
+		stats->bytes += thisrun_bytes;
+		job->rp_fresh = false;
+
+		/* Avoid GDB timeouts */
+		keep_alive();
+		return ASYNC_FLASH_PROGRESS;
+	}
+
+	return ASYNC_FLASH_DONE;
+}
+
+/*
+ * Feed the fifos of all runs in progress until none of them has data left.
+ * Once the fifo of @a own holds data, other targets get the chance to start
+ * their own run through the starter hook; such nested runs feed this one
+ * too, so the adapter link keeps busy while the targets are programming.
+ */
+static void async_flash_jobs_feed(struct async_flash_job *own)
+{
+	for (;;) {
+		bool pending = false, progress = false;
+
+		for (struct async_flash_job *job = async_flash_jobs; job; job = job->next) {
+			if (async_flash_job_done(job))
+				continue;
+			switch (async_flash_job_step(job)) {
+			case ASYNC_FLASH_PROGRESS:
+				progress = true;
+				/* fall through */
+			case ASYNC_FLASH_STALLED:
+				pending = true;
+				break;
+			case ASYNC_FLASH_DONE:
+				break;
+			}
+		}
+
+		if (async_flash_starter && (own->stats->writes > 0 || async_flash_job_done(own))) {
+			async_flash_starter(async_flash_starter_priv);
+			continue;
+		}
+
+		if (!pending)
+			break;
+
+		/* Throttle polling a bit if transfer is (much) faster than flash
+		 * programming. The exact delay shouldn't matter as long as it's
+		 * less than buffer size / flash speed. This is very unlikely to
+		 * run when using high latency connections such as USB. */
+		if (!progress)
+			alive_sleep(2);
+	}
+}
+
 /**
  * Streams data to a circular buffer on target intended for consumption by code
  * running asynchronously on target.
@@ -970,27 +1200,50 @@ int target_run_flash_async_algorithm(struct target *target,
 		uint32_t entry_point, uint32_t exit_point, void *arch_info)
 {
 	int retval;
-	int timeout = 0;
 
-	const uint8_t *buffer_orig = buffer;
+	/* validate block_size is 2^n */
+	assert(IS_PWR_OF_2(block_size));
+
+	for (struct async_flash_job *job = async_flash_jobs; job; job = job->next) {
+		if (job->target == target) {
+			LOG_ERROR("%s is already running a flash write algorithm",
+				target_name(target));
+			return ERROR_FAIL;
+		}
+	}
 
 	/* Set up working area. First word is write pointer, second word is read pointer,
 	 * rest is fifo data area. */
-	uint32_t wp_addr = buffer_start;
-	uint32_t rp_addr = buffer_start + 4;
-	uint32_t fifo_start_addr = buffer_start + 8;
-	uint32_t fifo_end_addr = buffer_start + buffer_size;
+	struct async_flash_job job = {
+		.target = target,
+		.buffer = buffer,
+		.buffer_orig = buffer,
+		.count = count,
+		.block_size = block_size,
+		.wp_addr = buffer_start,
+		.rp_addr = buffer_start + 4,
+		.fifo_start_addr = buffer_start + 8,
+		.fifo_end_addr = buffer_start + buffer_size,
+		.wp = buffer_start + 8,
+		.rp = buffer_start + 8,
+		/* it is known to be at the start of the fifo initially */
+		.rp_fresh = true,
+		.retval = ERROR_OK,
+		.stats = &target->async_stats,
+	};
 
-	uint32_t wp = fifo_start_addr;
-	uint32_t rp = fifo_start_addr;
+	struct target_async_algorithm_stats *stats = job.stats;
+	memset(stats, 0, sizeof(*stats));
+	stats->fifo_size = job.fifo_end_addr - job.fifo_start_addr;
+	job.min_chunk = MAX((uint32_t)block_size, stats->fifo_size / 4);
 
-	/* validate block_size is 2^n */
-	assert(IS_PWR_OF_2(block_size));
+	struct duration bench;
+	duration_start(&bench);
 
-	retval = target_write_u32(target, wp_addr, wp);
+	retval = target_write_u32(target, job.wp_addr, job.wp);
 	if (retval != ERROR_OK)
 		return retval;
-	retval = target_write_u32(target, rp_addr, rp);
+	retval = target_write_u32(target, job.rp_addr, job.rp);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -1006,90 +1259,24 @@ int target_run_flash_async_algorithm(struct target *target,
 		return retval;
 	}
 
-	while (count > 0) {
-
-		retval = target_read_u32(target, rp_addr, &rp);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("failed to get read pointer");
-			break;
-		}
-
-		LOG_DEBUG("offs 0x%zx count 0x%" PRIx32 " wp 0x%" PRIx32 " rp 0x%" PRIx32,
-			(size_t) (buffer - buffer_orig), count, wp, rp);
-
-		if (rp == 0) {
-			LOG_ERROR("flash write algorithm aborted by target");
-			retval = ERROR_FLASH_OPERATION_FAILED;
-			break;
-		}
-
-		if (!IS_ALIGNED(rp - fifo_start_addr, block_size) || rp < fifo_start_addr || rp >= fifo_end_addr) {
-			LOG_ERROR("corrupted fifo read pointer 0x%" PRIx32, rp);
-			break;
-		}
-
-		/* Count the number of bytes available in the fifo without
-		 * crossing the wrap around. Make sure to not fill it completely,
-		 * because that would make wp == rp and that's the empty condition. */
-		uint32_t thisrun_bytes;
-		if (rp > wp)
-			thisrun_bytes = rp - wp - block_size;
-		else if (rp > fifo_start_addr)
-			thisrun_bytes = fifo_end_addr - wp;
-		else
-			thisrun_bytes = fifo_end_addr - wp - block_size;
-
-		if (thisrun_bytes == 0) {
-			/* Throttle polling a bit if transfer is (much) faster than flash
-			 * programming. The exact delay shouldn't matter as long as it's
-			 * less than buffer size / flash speed. This is very unlikely to
-			 * run when using high latency connections such as USB. */
-			alive_sleep(2);
-
-			/* to stop an infinite loop on some targets check and increment a timeout
-			 * this issue was observed on a stellaris using the new ICDI interface */
-			if (timeout++ >= 2500) {
-				LOG_ERROR("timeout waiting for algorithm, a target reset is recommended");
-				return ERROR_FLASH_OPERATION_FAILED;
-			}
-			continue;
-		}
-
-		/* reset our timeout */
-		timeout = 0;
+	job.next = async_flash_jobs;
+	async_flash_jobs = &job;
 
-		/* Limit to the amount of data we actually want to write */
-		if (thisrun_bytes > count * block_size)
-			thisrun_bytes = count * block_size;
-
-		/* Force end of large blocks to be word aligned */
-		if (thisrun_bytes >= 16)
-			thisrun_bytes -= (rp + thisrun_bytes) & 0x03;
-
-		/* Write data to fifo */
-		retval = target_write_buffer(target, wp, thisrun_bytes, buffer);
-		if (retval != ERROR_OK)
-			break;
+	async_flash_jobs_feed(&job);
 
-		/* Update counters and wrap write pointer */
-		buffer += thisrun_bytes;
-		count -= thisrun_bytes / block_size;
-		wp += thisrun_bytes;
-		if (wp >= fifo_end_addr)
-			wp = fifo_start_addr;
+	/* nested runs are over by now, so this one is first */
+	assert(async_flash_jobs == &job);
+	async_flash_jobs = job.next;
 
-		/* Store updated write pointer to target */
-		retval = target_write_u32(target, wp_addr, wp);
-		if (retval != ERROR_OK)
-			break;
+	stats->min_chunk = job.min_chunk;
+	retval = job.retval;
 
-		/* Avoid GDB timeouts */
-		keep_alive();
-	}
+	if (job.timed_out)
+		return retval;
 
 	if (retval != ERROR_OK) {
 		/* abort flash write algorithm on target */
-		target_write_u32(target, wp_addr, 0);
+		target_write_u32(target, job.wp_addr, 0);
 	}
 
 	int retval2 = target_wait_algorithm(target, num_mem_params, mem_params,
@@ -1105,13 +1292,21 @@ int target_run_flash_async_algorithm(struct target *target,
 
 	if (retval == ERROR_OK) {
 		/* check if algorithm set rp = 0 after fifo writer loop finished */
-		retval = target_read_u32(target, rp_addr, &rp);
+		uint32_t rp;
+		retval = target_read_u32(target, job.rp_addr, &rp);
 		if (retval == ERROR_OK && rp == 0) {
 			LOG_ERROR("flash write algorithm aborted by target");
 			retval = ERROR_FLASH_OPERATION_FAILED;
 		}
 	}
 
+	if (duration_measure(&bench) == ERROR_OK)
+		stats->elapsed = duration_elapsed(&bench);
+	LOG_DEBUG("async algorithm: %" PRIu32 " bytes in %u writes, %u polls, %u stalls, "
+		"%u starved, min chunk %" PRIu32 ", %fs",
+		stats->bytes, stats->writes, stats->polls, stats->stalls,
+		stats->starved, stats->min_chunk, stats->elapsed);
+
 	return retval;
 }
 
@@ -1265,6 +1460,24 @@ int target_run_read_async_algorithm(struct target *target,
 	return retval;
 }
 
+/*
+ * Drop cached lines of all targets that may see memory written through
+ * @a target. Writes through other means (DMA, other cores outside an SMP
+ * group) must be covered by uncached regions.
+ */
+static void target_mem_cache_written(struct target *target,
+		target_addr_t address, uint64_t length)
+{
+	if (!target->smp) {
+		mem_cache_invalidate_range(target, address, length);
+		return;
+	}
+
+	struct target_list *head;
+	foreach_smp_target(head, target->smp_targets)
+		mem_cache_invalidate_range(head->target, address, length);
+}
+
 int target_read_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t count, uint8_t *buffer)
 {
@@ -1276,6 +1489,8 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	if (mem_cache_active(target))
+		return mem_cache_read(target, address, size, count, buffer);
 	return target->type->read_memory(target, address, size, count, buffer);
 }
 
@@ -1304,6 +1519,7 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_mem_cache_written(target, address, (uint64_t)size * count);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1318,6 +1534,8 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	/* virtual addresses of cached lines are unknown here */
+	mem_cache_invalidate_smp(target);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1444,6 +1662,7 @@ int target_step(struct target *target,
 	int retval;
 
 	target_call_event_callbacks(target, TARGET_EVENT_STEP_START);
+	mem_cache_invalidate(target);
 
 	retval = target->type->step(target, current, address, handle_breakpoints);
 	if (retval != ERROR_OK)
@@ -1502,6 +1721,15 @@ static int target_profiling(struct target *target, uint32_t *samples,
 			num_samples, seconds);
 }
 
+static int target_sample_pc(struct target *target, uint32_t *samples,
+			uint32_t max_num_samples, uint32_t *num_samples)
+{
+	*num_samples = 0;
+	if (!target->type->sample_pc)
+		return ERROR_NOT_IMPLEMENTED;
+	return target->type->sample_pc(target, samples, max_num_samples, num_samples);
+}
+
 static int handle_target(void *priv);
 
 static int target_init_one(struct command_context *cmd_ctx,
@@ -1806,6 +2034,20 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 			target_event_name(event),
 			target_name(target));
 
+	switch (event) {
+	case TARGET_EVENT_HALTED:
+	case TARGET_EVENT_RESUMED:
+	case TARGET_EVENT_DEBUG_HALTED:
+	case TARGET_EVENT_DEBUG_RESUMED:
+	case TARGET_EVENT_RESET_ASSERT:
+	case TARGET_EVENT_RESET_INIT:
+		/* memory may have changed behind our back */
+		mem_cache_invalidate(target);
+		break;
+	default:
+		break;
+	}
+
 	target_handle_event(target, event);
 
 	while (callback) {
@@ -2246,6 +2488,7 @@ static void target_destroy(struct target *target)
 	}
 
 	rtos_destroy(target);
+	mem_cache_free(target);
 
 	free(target->gdb_port_override);
 	free(target->type);
@@ -2257,6 +2500,9 @@ static void target_destroy(struct target *target)
 
 void target_quit(void)
 {
+	/* write the background profiles while their targets still exist */
+	target_profile_stop_all();
+
 	struct target_event_callback *pe = target_event_callbacks;
 	while (pe) {
 		struct target_event_callback *t = pe->next;
@@ -2282,6 +2528,8 @@ void target_quit(void)
 	}
 
 	all_targets = NULL;
+
+	free_fastload();
 }
 
 int target_arch_state(struct target *target)
@@ -2388,6 +2636,7 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	target_mem_cache_written(target, address, size);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2453,6 +2702,9 @@ int target_read_buffer(struct target *target, target_addr_t address, uint32_t si
 		return ERROR_FAIL;
 	}
 
+	/* the cache serves any mix of access sizes, bypass target specific code */
+	if (mem_cache_active(target))
+		return target_read_buffer_default(target, address, size, buffer);
 	return target->type->read_buffer(target, address, size, buffer);
 }
 
@@ -2496,7 +2748,6 @@ int target_checksum_memory(struct target *target, target_addr_t address, uint32_
 {
 	uint8_t *buffer;
 	int retval;
-	uint32_t i;
 	uint32_t checksum = 0;
 	if (!target_was_examined(target)) {
 		LOG_ERROR("Target not examined yet");
@@ -2509,26 +2760,28 @@ int target_checksum_memory(struct target *target, target_addr_t address, uint32_
 
 	retval = target->type->checksum_memory(target, address, size, &checksum);
 	if (retval != ERROR_OK) {
-		buffer = malloc(size);
+		/* Read the memory in chunks and checksum it on the host */
+		uint32_t chunk = MIN(size, TARGET_CHECKSUM_CHUNK);
+		buffer = malloc(chunk);
 		if (!buffer) {
-			LOG_ERROR("error allocating buffer for section (%" PRIu32 " bytes)", size);
+			LOG_ERROR("error allocating buffer for section (%" PRIu32 " bytes)", chunk);
 			return ERROR_COMMAND_SYNTAX_ERROR;
 		}
-		retval = target_read_buffer(target, address, size, buffer);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			return retval;
-		}
 
-		/* convert to target endianness */
-		for (i = 0; i < (size/sizeof(uint32_t)); i++) {
-			uint32_t target_data;
-			target_data = target_buffer_get_u32(target, &buffer[i*sizeof(uint32_t)]);
-			target_buffer_set_u32(target, &buffer[i*sizeof(uint32_t)], target_data);
-		}
+		checksum = 0xffffffff;
+		for (uint32_t offset = 0; offset < size; offset += chunk) {
+			uint32_t run = MIN(size - offset, chunk);
 
-		retval = image_calculate_checksum(buffer, size, &checksum);
+			retval = target_read_buffer(target, address + offset, run, buffer);
+			if (retval != ERROR_OK)
+				break;
+
+			checksum = crc32_gdb(checksum, buffer, run);
+			keep_alive();
+		}
 		free(buffer);
+		if (retval != ERROR_OK)
+			return retval;
 	}
 
 	*crc = checksum;
@@ -4197,8 +4450,9 @@ static void write_string(FILE *f, char *s)
 typedef unsigned char UNIT[2];  /* unit of profiling */
 
 /* Dump a gmon.out histogram file. */
-static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filename, bool with_range,
-			uint32_t start_address, uint32_t end_address, struct target *target, uint32_t duration_ms)
+void target_write_gmon(const uint32_t *samples, const uint32_t *counts, uint32_t sample_num,
+			const char *filename, bool with_range, uint32_t start_address, uint32_t end_address,
+			struct target *target, uint32_t duration_ms)
 {
 	uint32_t i;
 	FILE *f = fopen(filename, "w");
@@ -4257,8 +4511,12 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 		return;
 	}
 	memset(buckets, 0, sizeof(int) * num_buckets);
+	uint64_t total = 0;
 	for (i = 0; i < sample_num; i++) {
 		uint32_t address = samples[i];
+		uint32_t count = counts ? counts[i] : 1;
+
+		total += count;
 
 		if ((address < min) || (max <= address))
 			continue;
@@ -4267,14 +4525,14 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 		long long b = num_buckets;
 		long long c = address_space;
 		int index_t = (a * b) / c; /* danger!!!! int32 overflows */
-		buckets[index_t]++;
+		buckets[index_t] += count;
 	}
 
 	/* append binary memory gmon.out &profile_hist_hdr ((char*)&profile_hist_hdr + sizeof(struct gmon_hist_hdr)) */
 	write_long(f, min, target);			/* low_pc */
 	write_long(f, max, target);			/* high_pc */
 	write_long(f, num_buckets, target);	/* # of buckets */
-	float sample_rate = sample_num / (duration_ms / 1000.0);
+	float sample_rate = total / (duration_ms / 1000.0);
 	write_long(f, sample_rate, target);
 	write_string(f, "seconds");
 	for (i = 0; i < (15-strlen("seconds")); i++)
@@ -4304,6 +4562,32 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 
 /* profiling samples the CPU PC as quickly as OpenOCD is able,
  * which will be used as a random sampling of PC */
+COMMAND_HANDLER(handle_async_algorithm_stats_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_current_target(CMD_CTX);
+	const struct target_async_algorithm_stats *stats = &target->async_stats;
+
+	if (!stats->fifo_size) {
+		command_print(CMD, "no asynchronous flash algorithm run yet");
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "bytes:     %" PRIu32 " in %fs (%0.3f KiB/s)", stats->bytes,
+		stats->elapsed, stats->elapsed > 0 ? stats->bytes / 1024.0 / stats->elapsed : 0.0);
+	command_print(CMD, "fifo size: %" PRIu32, stats->fifo_size);
+	command_print(CMD, "writes:    %u, %" PRIu32 " bytes average", stats->writes,
+		stats->writes ? stats->bytes / stats->writes : 0);
+	command_print(CMD, "polls:     %u", stats->polls);
+	command_print(CMD, "stalls:    %u", stats->stalls);
+	command_print(CMD, "starved:   %u", stats->starved);
+	command_print(CMD, "min chunk: %" PRIu32, stats->min_chunk);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_profile_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -4384,7 +4668,7 @@ COMMAND_HANDLER(handle_profile_command)
 		return retval;
 	}
 
-	write_gmon(samples, num_of_samples, CMD_ARGV[1],
+	target_write_gmon(samples, NULL, num_of_samples, CMD_ARGV[1],
 		   with_range, start_address, end_address, target, duration_ms);
 	command_print(CMD, "Wrote %s", CMD_ARGV[1]);
 
@@ -4392,6 +4676,212 @@ COMMAND_HANDLER(handle_profile_command)
 	return retval;
 }
 
+/* PC samples taken by each call of the background profiler timer */
+#define PROFILE_BATCH				256
+/* the background profiler rewrites its gmon file with this interval */
+#define PROFILE_WRITE_INTERVAL_MS	1000
+
+/* a profile_start run, sampling the PC without halting the target */
+struct target_profile {
+	struct target *target;
+	char *filename;
+	bool with_range;
+	uint32_t start_address;
+	uint32_t end_address;
+	int64_t start_ms;
+	int64_t end_ms;
+	int64_t written_ms;
+	/* samples taken while the core was halted or sleeping */
+	uint64_t idle;
+	struct pc_histogram hist;
+	struct target_profile *next;
+};
+
+static struct target_profile *profiles;
+
+static struct target_profile **target_profile_find(struct target *target)
+{
+	struct target_profile **p = &profiles;
+
+	while (*p && (*p)->target != target)
+		p = &(*p)->next;
+	return p;
+}
+
+static int target_profile_write(struct target_profile *profile)
+{
+	profile->written_ms = timeval_ms();
+	if (!profile->hist.used)
+		return ERROR_OK;
+	return pc_histogram_write_gmon(&profile->hist, profile->filename,
+		profile->with_range, profile->start_address, profile->end_address,
+		profile->target, profile->written_ms - profile->start_ms);
+}
+
+static int target_profile_poll(void *priv);
+
+static void target_profile_finish(struct target_profile *profile)
+{
+	struct target_profile **p = target_profile_find(profile->target);
+
+	target_unregister_timer_callback(target_profile_poll, profile);
+	*p = profile->next;
+
+	if (target_profile_write(profile) == ERROR_OK)
+		LOG_TARGET_INFO(profile->target, "Profiling completed. %" PRIu64 " samples"
+			" (%" PRIu64 " idle), wrote %s", profile->hist.total, profile->idle,
+			profile->filename);
+
+	pc_histogram_clear(&profile->hist);
+	free(profile->filename);
+	free(profile);
+}
+
+static int target_profile_poll(void *priv)
+{
+	struct target_profile *profile = priv;
+	uint32_t samples[PROFILE_BATCH];
+	uint32_t num_samples;
+
+	int retval = target_sample_pc(profile->target, samples, PROFILE_BATCH, &num_samples);
+	for (uint32_t i = 0; i < num_samples; i++) {
+		if (samples[i] == UINT32_MAX)
+			profile->idle++;
+		else
+			pc_histogram_add(&profile->hist, samples[i]);
+	}
+
+	int64_t now = timeval_ms();
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(profile->target, "Error while sampling the PC, profiling stopped");
+		target_profile_finish(profile);
+	} else if (now >= profile->end_ms) {
+		target_profile_finish(profile);
+	} else if (now - profile->written_ms >= PROFILE_WRITE_INTERVAL_MS) {
+		target_profile_write(profile);
+	}
+
+	return ERROR_OK;
+}
+
+static void target_profile_stop_all(void)
+{
+	while (profiles)
+		target_profile_finish(profiles);
+}
+
+COMMAND_HANDLER(handle_profile_start_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC != 2 && CMD_ARGC != 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	uint32_t seconds;
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], seconds);
+
+	uint32_t start_address = 0;
+	uint32_t end_address = 0;
+	bool with_range = false;
+	if (CMD_ARGC == 4) {
+		with_range = true;
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
+		if (start_address > end_address || (end_address - start_address) < 2) {
+			command_print(CMD, "Error: end - start < 2");
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	if (*target_profile_find(target)) {
+		command_print(CMD, "Target %s is already being profiled", target_name(target));
+		return ERROR_FAIL;
+	}
+
+	/* check that the PC can be sampled without halting the target */
+	uint32_t sample;
+	uint32_t num_samples;
+	int retval = target_sample_pc(target, &sample, 1, &num_samples);
+	if (retval == ERROR_NOT_IMPLEMENTED) {
+		command_print(CMD, "Target %s can't sample the PC while running, use 'profile'",
+			target_name(target));
+		return retval;
+	}
+	if (retval != ERROR_OK) {
+		command_print(CMD, "Error while sampling the PC");
+		return retval;
+	}
+
+	struct target_profile *profile = calloc(1, sizeof(*profile));
+	if (!profile) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	profile->filename = strdup(CMD_ARGV[1]);
+	if (!profile->filename) {
+		LOG_ERROR("Out of memory");
+		free(profile);
+		return ERROR_FAIL;
+	}
+	profile->target = target;
+	profile->with_range = with_range;
+	profile->start_address = start_address;
+	profile->end_address = end_address;
+	profile->start_ms = timeval_ms();
+	profile->end_ms = profile->start_ms + seconds * 1000LL;
+	profile->written_ms = profile->start_ms;
+
+	retval = target_register_timer_callback(target_profile_poll, 1,
+		TARGET_TIMER_TYPE_PERIODIC, profile);
+	if (retval != ERROR_OK) {
+		free(profile->filename);
+		free(profile);
+		return retval;
+	}
+	profile->next = profiles;
+	profiles = profile;
+
+	LOG_TARGET_INFO(target, "Profiling for %" PRIu32 "s in the background", seconds);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_profile_stop_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target_profile *profile = *target_profile_find(target);
+	if (!profile) {
+		command_print(CMD, "Target %s is not being profiled", target_name(target));
+		return ERROR_FAIL;
+	}
+
+	target_profile_finish(profile);
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_profile_status_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	int64_t now = timeval_ms();
+	for (struct target_profile *profile = profiles; profile; profile = profile->next) {
+		float elapsed = (now - profile->start_ms) / 1000.0;
+		uint64_t samples = profile->hist.total + profile->idle;
+
+		command_print(CMD, "%s: %" PRIu64 " samples (%" PRIu64 " idle, %" PRIu32
+			" distinct PCs) in %.1fs, %.0f samples/s, %.1fs left, writing %s",
+			target_name(profile->target), samples, profile->idle, profile->hist.used,
+			elapsed, elapsed > 0 ? samples / elapsed : 0.0,
+			(profile->end_ms - now) / 1000.0, profile->filename);
+	}
+
+	return ERROR_OK;
+}
+
 static int new_u64_array_element(Jim_Interp *interp, const char *varname, int idx, uint64_t val)
 {
 	char *namebuf;
@@ -5771,6 +6261,7 @@ COMMAND_HANDLER(handle_target_reset)
 	target->reset_halt = (a != 0);
 	/* When this happens - all workareas are invalid. */
 	target_free_all_working_areas_restore(target, 0);
+	mem_cache_invalidate(target);
 
 	/* do the assert */
 	if (n->value == NVP_ASSERT)
@@ -6072,6 +6563,9 @@ static const struct command_registration target_instance_command_handlers[] = {
 		.help = "invoke handler for specified event",
 		.usage = "event_name",
 	},
+	{
+		.chain = mem_cache_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -6490,149 +6984,251 @@ static const struct command_registration target_subcommand_handlers[] = {
 	COMMAND_REGISTRATION_DONE
 };
 
-struct fast_load {
+/* Amount of data written between calls to keep_alive() by fast_load */
+#define FAST_LOAD_CHUNK		(64 * 1024)
+
+struct fast_load_section {
 	target_addr_t address;
-	uint8_t *data;
-	int length;
+	/* part of the image section to load */
+	unsigned int section;
+	uint32_t offset;
+	uint32_t length;
+	/* copy of the data, if the image does not hold it in memory */
+	uint8_t *copy;
+};
 
+/* An image kept by fast_load_image */
+struct fast_load {
+	char *name;
+	struct image image;
+	unsigned int num_sections;
+	struct fast_load_section *sections;
+	struct fast_load *next;
 };
 
-static int fastload_num;
-static struct fast_load *fastload;
+/* Name of the image used when none is given */
+#define FAST_LOAD_DEFAULT	"default"
+
+static struct fast_load *fastloads;
+
+static void fast_load_free(struct fast_load *fastload)
+{
+	for (unsigned int i = 0; i < fastload->num_sections; i++)
+		free(fastload->sections[i].copy);
+	free(fastload->sections);
+	image_close(&fastload->image);
+	free(fastload->name);
+	free(fastload);
+}
+
+static struct fast_load **fast_load_find(const char *name)
+{
+	struct fast_load **p = &fastloads;
+	while (*p && strcmp((*p)->name, name) != 0)
+		p = &(*p)->next;
+	return p;
+}
 
 static void free_fastload(void)
 {
-	if (fastload) {
-		for (int i = 0; i < fastload_num; i++)
-			free(fastload[i].data);
-		free(fastload);
-		fastload = NULL;
+	while (fastloads) {
+		struct fast_load *next = fastloads->next;
+		fast_load_free(fastloads);
+		fastloads = next;
 	}
 }
 
 COMMAND_HANDLER(handle_fast_load_image_command)
 {
-	uint8_t *buffer;
-	size_t buf_cnt;
+	const char *name = FAST_LOAD_DEFAULT;
 	uint32_t image_size;
 	target_addr_t min_address = 0;
 	target_addr_t max_address = -1;
 
-	struct image image;
+	if (CMD_ARGC >= 2 && strcmp(CMD_ARGV[0], "-name") == 0) {
+		name = CMD_ARGV[1];
+		CMD_ARGV += 2;
+		CMD_ARGC -= 2;
+	}
+
+	struct fast_load *fastload = calloc(1, sizeof(*fastload));
+	if (!fastload) {
+		command_print(CMD, "out of memory");
+		return ERROR_FAIL;
+	}
+
+	struct image *image = &fastload->image;
 
 	int retval = CALL_COMMAND_HANDLER(parse_load_image_command,
-			&image, &min_address, &max_address);
-	if (retval != ERROR_OK)
+			image, &min_address, &max_address);
+	if (retval != ERROR_OK) {
+		free(fastload);
 		return retval;
+	}
 
 	struct duration bench;
 	duration_start(&bench);
 
-	retval = image_open(&image, CMD_ARGV[0], (CMD_ARGC >= 3) ? CMD_ARGV[2] : NULL);
-	if (retval != ERROR_OK)
+	retval = image_open(image, CMD_ARGV[0], (CMD_ARGC >= 3) ? CMD_ARGV[2] : NULL);
+	if (retval != ERROR_OK) {
+		free(fastload);
 		return retval;
+	}
 
-	image_size = 0x0;
-	retval = ERROR_OK;
-	fastload_num = image.num_sections;
-	fastload = malloc(sizeof(struct fast_load)*image.num_sections);
-	if (!fastload) {
+	fastload->name = strdup(name);
+	fastload->sections = calloc(image->num_sections, sizeof(struct fast_load_section));
+	if (!fastload->name || !fastload->sections) {
 		command_print(CMD, "out of memory");
-		image_close(&image);
+		fast_load_free(fastload);
 		return ERROR_FAIL;
 	}
-	memset(fastload, 0, sizeof(struct fast_load)*image.num_sections);
-	for (unsigned int i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (!buffer) {
-			command_print(CMD, "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
-
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
-		}
 
+	image_size = 0x0;
+	uint32_t copied = 0;
+	for (unsigned int i = 0; i < image->num_sections; i++) {
 		uint32_t offset = 0;
-		uint32_t length = buf_cnt;
+		uint32_t length = image->sections[i].size;
 
 		/* DANGER!!! beware of unsigned comparison here!!! */
 
-		if ((image.sections[i].base_address + buf_cnt >= min_address) &&
-				(image.sections[i].base_address < max_address)) {
-			if (image.sections[i].base_address < min_address) {
-				/* clip addresses below */
-				offset += min_address-image.sections[i].base_address;
-				length -= offset;
-			}
+		if ((image->sections[i].base_address + length < min_address) ||
+				(image->sections[i].base_address >= max_address))
+			continue;
 
-			if (image.sections[i].base_address + buf_cnt > max_address)
-				length -= (image.sections[i].base_address + buf_cnt)-max_address;
+		if (image->sections[i].base_address < min_address) {
+			/* clip addresses below */
+			offset += min_address - image->sections[i].base_address;
+			length -= offset;
+		}
 
-			fastload[i].address = image.sections[i].base_address + offset;
-			fastload[i].data = malloc(length);
-			if (!fastload[i].data) {
-				free(buffer);
+		if (image->sections[i].base_address + image->sections[i].size > max_address)
+			length -= (image->sections[i].base_address + image->sections[i].size) - max_address;
+
+		struct fast_load_section *section = &fastload->sections[fastload->num_sections++];
+		section->address = image->sections[i].base_address + offset;
+		section->section = i;
+		section->offset = offset;
+		section->length = length;
+
+		/* Reference the data where the image holds it in memory,
+		 * read it into a copy otherwise. */
+		const uint8_t *data;
+		if (image_section_data(image, i, &data) != ERROR_OK) {
+			size_t buf_cnt;
+
+			section->copy = malloc(length);
+			if (!section->copy) {
 				command_print(CMD, "error allocating buffer for section (%" PRIu32 " bytes)",
 							  length);
 				retval = ERROR_FAIL;
 				break;
 			}
-			memcpy(fastload[i].data, buffer + offset, length);
-			fastload[i].length = length;
 
-			image_size += length;
-			command_print(CMD, "%u bytes written at address 0x%8.8x",
-						  (unsigned int)length,
-						  ((unsigned int)(image.sections[i].base_address + offset)));
+			retval = image_read_section(image, i, offset, length, section->copy, &buf_cnt);
+			if (retval != ERROR_OK)
+				break;
+			if (buf_cnt != length) {
+				command_print(CMD, "short read of image section %u", i);
+				retval = ERROR_FAIL;
+				break;
+			}
+			copied += length;
 		}
 
-		free(buffer);
+		image_size += length;
+		command_print(CMD, "%u bytes written at address 0x%8.8x",
+					  (unsigned int)length,
+					  ((unsigned int)(image->sections[i].base_address + offset)));
 	}
 
-	if ((retval == ERROR_OK) && (duration_measure(&bench) == ERROR_OK)) {
+	if (retval != ERROR_OK) {
+		fast_load_free(fastload);
+		return retval;
+	}
+
+	/* replace an image of the same name */
+	struct fast_load **p = fast_load_find(name);
+	if (*p) {
+		fastload->next = (*p)->next;
+		fast_load_free(*p);
+	}
+	*p = fastload;
+
+	if (duration_measure(&bench) == ERROR_OK) {
 		command_print(CMD, "Loaded %" PRIu32 " bytes "
 				"in %fs (%0.3f KiB/s)", image_size,
 				duration_elapsed(&bench), duration_kbps(&bench, image_size));
+		if (copied < image_size)
+			command_print(CMD, "%" PRIu32 " bytes referenced from the image file",
+					image_size - copied);
 
 		command_print(CMD,
 				"WARNING: image has not been loaded to target!"
 				"You can issue a 'fast_load' to finish loading.");
 	}
 
-	image_close(&image);
-
-	if (retval != ERROR_OK)
-		free_fastload();
-
-	return retval;
+	return ERROR_OK;
 }
 
 COMMAND_HANDLER(handle_fast_load_command)
 {
-	if (CMD_ARGC > 0)
+	if (CMD_ARGC > 1)
 		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	const char *name = CMD_ARGC ? CMD_ARGV[0] : FAST_LOAD_DEFAULT;
+	struct fast_load *fastload = *fast_load_find(name);
 	if (!fastload) {
-		LOG_ERROR("No image in memory");
+		if (CMD_ARGC)
+			LOG_ERROR("No image '%s' in memory", name);
+		else
+			LOG_ERROR("No image in memory");
 		return ERROR_FAIL;
 	}
-	int i;
+
+	struct target *target = get_current_target(CMD_CTX);
 	int64_t ms = timeval_ms();
-	int size = 0;
+	uint64_t size = 0;
 	int retval = ERROR_OK;
-	for (i = 0; i < fastload_num; i++) {
-		struct target *target = get_current_target(CMD_CTX);
+	for (unsigned int i = 0; i < fastload->num_sections; i++) {
+		struct fast_load_section *section = &fastload->sections[i];
+		const uint8_t *data = section->copy;
+
+		if (!data) {
+			retval = image_section_data(&fastload->image, section->section, &data);
+			if (retval != ERROR_OK) {
+				command_print(CMD, "image data no longer available, "
+						"repeat 'fast_load_image'");
+				break;
+			}
+			data += section->offset;
+		}
+
 		command_print(CMD, "Write to 0x%08x, length 0x%08x",
-					  (unsigned int)(fastload[i].address),
-					  (unsigned int)(fastload[i].length));
-		retval = target_write_buffer(target, fastload[i].address, fastload[i].length, fastload[i].data);
+					  (unsigned int)(section->address),
+					  (unsigned int)(section->length));
+
+		struct duration bench;
+		duration_start(&bench);
+
+		/* the adapter queues each chunk as one block transfer, splitting
+		 * it up only keeps GDB and the event loop alive on big sections */
+		for (uint32_t done = 0; done < section->length; ) {
+			uint32_t chunk = MIN(section->length - done, FAST_LOAD_CHUNK);
+
+			retval = target_write_buffer(target, section->address + done, chunk, data + done);
+			if (retval != ERROR_OK)
+				break;
+			done += chunk;
+			keep_alive();
+		}
 		if (retval != ERROR_OK)
 			break;
-		size += fastload[i].length;
+
+		if (duration_measure(&bench) == ERROR_OK)
+			command_print(CMD, "wrote %" PRIu32 " bytes in %fs (%0.3f KiB/s)",
+					section->length, duration_elapsed(&bench),
+					duration_kbps(&bench, section->length));
+		size += section->length;
 	}
 	if (retval == ERROR_OK) {
 		int64_t after = timeval_ms();
@@ -6641,6 +7237,46 @@ COMMAND_HANDLER(handle_fast_load_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_fast_load_list_command)
+{
+	if (CMD_ARGC > 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	for (struct fast_load *fastload = fastloads; fastload; fastload = fastload->next) {
+		uint64_t size = 0, copied = 0;
+		for (unsigned int i = 0; i < fastload->num_sections; i++) {
+			size += fastload->sections[i].length;
+			if (fastload->sections[i].copy)
+				copied += fastload->sections[i].length;
+		}
+		command_print(CMD, "%s: %u sections, %" PRIu64 " bytes, %" PRIu64 " bytes copied",
+				fastload->name, fastload->num_sections, size, copied);
+	}
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_fast_load_free_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 0) {
+		free_fastload();
+		return ERROR_OK;
+	}
+
+	struct fast_load **p = fast_load_find(CMD_ARGV[0]);
+	if (!*p) {
+		command_print(CMD, "No image '%s' in memory", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct fast_load *fastload = *p;
+	*p = fastload->next;
+	fast_load_free(fastload);
+	return ERROR_OK;
+}
+
 static const struct command_registration target_command_handlers[] = {
 	{
 		.name = "targets",
@@ -6897,7 +7533,7 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.mode = COMMAND_ANY,
 		.help = "Load image into server memory for later use by "
 			"fast_load; primarily for profiling",
-		.usage = "filename address ['bin'|'ihex'|'elf'|'s19'] "
+		.usage = "['-name' name] filename address ['bin'|'ihex'|'elf'|'s19'] "
 			"[min_address [max_length]]",
 	},
 	{
@@ -6906,6 +7542,28 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.mode = COMMAND_EXEC,
 		.help = "loads active fast load image to current target "
 			"- mainly for profiling purposes",
+		.usage = "[name]",
+	},
+	{
+		.name = "fast_load_list",
+		.handler = handle_fast_load_list_command,
+		.mode = COMMAND_ANY,
+		.help = "list the images kept by fast_load_image",
+		.usage = "",
+	},
+	{
+		.name = "fast_load_free",
+		.handler = handle_fast_load_free_command,
+		.mode = COMMAND_ANY,
+		.help = "drop an image kept by fast_load_image, or all of them",
+		.usage = "[name]",
+	},
+	{
+		.name = "async_algorithm_stats",
+		.handler = handle_async_algorithm_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "report on the last asynchronous flash algorithm run "
+			"of the current target",
 		.usage = "",
 	},
 	{
@@ -6915,6 +7573,29 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.usage = "seconds filename [start end]",
 		.help = "profiling samples the CPU PC",
 	},
+	{
+		.name = "profile_start",
+		.handler = handle_profile_start_command,
+		.mode = COMMAND_EXEC,
+		.usage = "seconds filename [start end]",
+		.help = "sample the CPU PC in the background, without halting the "
+			"target, and write a gmon file",
+	},
+	{
+		.name = "profile_stop",
+		.handler = handle_profile_stop_command,
+		.mode = COMMAND_EXEC,
+		.usage = "",
+		.help = "stop the background profiling of the current target "
+			"and write its gmon file",
+	},
+	{
+		.name = "profile_status",
+		.handler = handle_profile_status_command,
+		.mode = COMMAND_EXEC,
+		.usage = "",
+		.help = "show the progress of the background profiling",
+	},
 	/** @todo don't register virt2phys() unless target supports it */
 	{
 		.name = "virt2phys",
@@ -35,6 +35,7 @@ struct mem_param;
 struct reg_param;
 struct target_list;
 struct gdb_fileio_info;
+struct mem_cache;
 
 /*
  * TARGET_UNKNOWN = 0: we don't know anything about the target yet
@@ -112,6 +113,26 @@ enum target_register_class {
 };
 
 /* target_type.h contains the full definition of struct target_type */
+/** Report of a run of target_run_flash_async_algorithm() */
+struct target_async_algorithm_stats {
+	/* Bytes written to the fifo */
+	uint32_t bytes;
+	/* Size of the fifo data area */
+	uint32_t fifo_size;
+	/* Transfers of data to the fifo */
+	unsigned int writes;
+	/* Reads of the fifo read pointer */
+	unsigned int polls;
+	/* Waits for the algorithm to free space in the fifo */
+	unsigned int stalls;
+	/* Polls that found the fifo drained, the algorithm waited for data */
+	unsigned int starved;
+	/* Smallest transfer the host settled on, in bytes */
+	uint32_t min_chunk;
+	/* Duration of the run, in seconds */
+	float elapsed;
+};
+
 struct target {
 	struct target_type *type;			/* target type definition (name, access functions) */
 	char *cmd_name;				/* tcl Name of target */
@@ -207,6 +228,12 @@ struct target {
 
 	/* The semihosting information, extracted from the target. */
 	struct semihosting *semihosting;
+
+	/* read cache for memory of the halted target, see mem_cache.h */
+	struct mem_cache *mem_cache;
+
+	/* report of the last target_run_flash_async_algorithm() */
+	struct target_async_algorithm_stats async_stats;
 };
 
 struct target_list {
@@ -583,6 +610,19 @@ int target_run_flash_async_algorithm(struct target *target,
 		uint32_t entry_point, uint32_t exit_point,
 		void *arch_info);
 
+typedef void (*target_async_starter_fn)(void *priv);
+
+/**
+ * Let target_run_flash_async_algorithm() start work on other targets.
+ *
+ * While a flash write algorithm runs, @a starter is called as soon as its
+ * fifo holds data. Flash write algorithms started by @a starter on other
+ * targets are fed together with the ones already running. The hook stays
+ * in place until it is set to NULL, which @a starter does once it has
+ * nothing left to start.
+ */
+void target_async_algorithm_set_starter(target_async_starter_fn starter, void *priv);
+
 /**
  * This routine is a wrapper for asynchronous algorithms.
  *
@@ -785,6 +825,15 @@ void target_handle_md_output(struct command_invocation *cmd,
 int target_profiling_default(struct target *target, uint32_t *samples, uint32_t
 		max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
+/**
+ * Write PC samples to @a filename as a gmon.out histogram, as done by the
+ * command 'profile'. Each sample is counted @a counts[i] times, or once
+ * when @a counts is NULL.
+ */
+void target_write_gmon(const uint32_t *samples, const uint32_t *counts, uint32_t sample_num,
+		const char *filename, bool with_range, uint32_t start_address, uint32_t end_address,
+		struct target *target, uint32_t duration_ms);
+
 #define ERROR_TARGET_INVALID	(-300)
 #define ERROR_TARGET_INIT_FAILED (-301)
 #define ERROR_TARGET_TIMEOUT	(-302)
@@ -300,6 +300,14 @@ struct target_type {
 	int (*profiling)(struct target *target, uint32_t *samples,
 			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
+	/* take up to max_num_samples samples of the PC without halting the
+	 * target, e.g. from a PC sample register, as quickly as possible.
+	 * Samples taken while the core is halted or sleeping are UINT32_MAX.
+	 * Optional, used by the background profiler.
+	 */
+	int (*sample_pc)(struct target *target, uint32_t *samples,
+			uint32_t max_num_samples, uint32_t *num_samples);
+
 	/* Return the number of address bits this target supports. This will
 	 * typically be 32 for 32-bit targets, and 64 for 64-bit targets. If not
 	 * implemented, it's assumed to be 32. */